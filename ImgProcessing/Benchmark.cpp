@@ -0,0 +1,466 @@
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <limits>
+#include <iterator>
+#include <random>
+#include <QtCore/qmath.h>
+#include "Benchmark.h"
+#include "SimdKernels.h"
+#include "Pyramid.h"
+#include "KeyPointHelper.h"
+#include "DescriptorExtractor.h"
+#include "ThreadPool.h"
+#include "BufferPool.h"
+#include "KDForest.h"
+#include "LabImage.h"
+
+double Benchmark::measure(const std::function<void()>& f, int repeat)
+{
+	double best = std::numeric_limits<double>::max();
+	for (int i = 0; i < repeat; i++) {
+		auto startTime = std::chrono::high_resolution_clock::now();
+		f();
+		auto endTime = std::chrono::high_resolution_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::milli>(endTime - startTime).count());
+	}
+	return best;
+}
+
+void Benchmark::benchmarkSimd(const DoubleMatrix& source)
+{
+	SimdKernels::Level supported = SimdKernels::getSupportedLevel();
+	SimdKernels::setLevel(SimdKernels::Level::Scalar);
+	DoubleMatrix scalarGauss = source.gaussian(1.6);
+	DoubleMatrix scalarDx = source.dx();
+	double scalarTime = measure([&]() { source.gaussian(1.6); });
+
+	std::cout << "Image " << source.getWidth() << "x" << source.getHeight() << std::endl;
+	std::cout << "gaussian(1.6) " << SimdKernels::getLevelName(SimdKernels::Level::Scalar) << ": " << scalarTime << "ms" << std::endl;
+
+	for (int level = static_cast<int>(SimdKernels::Level::SSE2); level <= static_cast<int>(supported); level++) {
+		SimdKernels::setLevel(static_cast<SimdKernels::Level>(level));
+		DoubleMatrix gauss = source.gaussian(1.6);
+		DoubleMatrix dx = source.dx();
+		double time = measure([&]() { source.gaussian(1.6); });
+		bool close = gauss.allClose(scalarGauss, SimdKernels::Epsilon) && dx.allClose(scalarDx, SimdKernels::Epsilon);
+		std::cout << "gaussian(1.6) " << SimdKernels::getLevelName(SimdKernels::getLevel()) << ": " << time << "ms"
+			<< " (x" << scalarTime / time << ")"
+			<< " allClose(eps=" << SimdKernels::Epsilon << "): " << (close ? "true" : "false") << std::endl;
+	}
+
+	checkNormalizeToBytes(source);
+	checkNormalizeToBytes(source.cast<float>());
+
+	SimdKernels::setLevel(supported);
+}
+
+template<typename T>
+void Benchmark::checkNormalizeToBytes(const Matrix<T>& source)
+{
+	SimdKernels::Level supported = SimdKernels::getSupportedLevel();
+	SimdKernels::setLevel(SimdKernels::Level::Scalar);
+	Matrix<T> normalized(source);
+	normalized.norm255();
+	int n = source.getSize();
+	std::vector<uint8_t> expected(n);
+	for (int i = 0; i < n; i++) {
+		expected[i] = static_cast<uint8_t>(std::min(std::max(static_cast<int>(normalized.at(i)), 0), 255));
+	}
+
+	std::pair<T, T> minMax = source.minMax();
+	std::vector<uint8_t> bytes(n);
+	for (int level = static_cast<int>(SimdKernels::Level::Scalar); level <= static_cast<int>(supported); level++) {
+		SimdKernels::setLevel(static_cast<SimdKernels::Level>(level));
+		SimdKernels::normalizeToBytes(source.data(), bytes.data(), n, minMax.first, minMax.second);
+		std::cout << "normalizeToBytes(" << (sizeof(T) == sizeof(float) ? "float" : "double") << ") "
+			<< SimdKernels::getLevelName(SimdKernels::getLevel()) << ": identical to norm255: "
+			<< (bytes == expected ? "true" : "false") << std::endl;
+	}
+
+	SimdKernels::setLevel(supported);
+}
+
+template<typename T>
+void Benchmark::benchmarkExport(const Matrix<T>& source)
+{
+	QImage oldImage, newImage;
+	double oldTime = measure([&]() {
+		Matrix<T> copy(source);
+		copy.norm255();
+		oldImage = LabImage::getImageFromMatrix(copy);
+	});
+	double newTime = measure([&]() { newImage = LabImage::toGrayImage(source); });
+
+	bool identical = true;
+	for (int i = 0; i < source.getHeight() && identical; i++) {
+		for (int j = 0; j < source.getWidth(); j++) {
+			if (qRed(oldImage.pixel(j, i)) != qRed(newImage.pixel(j, i))) {
+				identical = false;
+				break;
+			}
+		}
+	}
+
+	std::cout << (sizeof(T) == sizeof(float) ? "float" : "double") << ": copy + norm255 + getImageFromMatrix: " << oldTime
+		<< "ms, toGrayImage: " << newTime << "ms (x" << oldTime / newTime << "), identical: " << (identical ? "true" : "false") << std::endl;
+}
+
+template<typename T>
+void Benchmark::benchmarkPipeline(const Matrix<T>& source)
+{
+	BasicPyramid<T> pyramid, doG, gradients, directions;
+	std::vector<KeyPoint> points;
+	std::pair<std::vector<KeyPoint>, std::vector<Descriptor>> result;
+	DescriptorExtractor extractor(1, 1, 1);
+
+	double pyramidTime = measure([&]() { pyramid = BasicPyramid<T>::createWithOverlap(source, 0.5, 1.6, 4, 3, 2); }, 1);
+	double doGTime = measure([&]() { doG = pyramid.createDoGPyramid(); }, 1);
+	double pointsTime = measure([&]() { points = KeyPointHelper::findExtremePoints(pyramid, doG, 0.002, 5); }, 1);
+	double descriptorsTime = measure([&]() { result = extractor.computeScale(pyramid, points); }, 1);
+	gradients = pyramid.createGradientPyramid();
+	directions = pyramid.createDirectionsPyramid();
+
+	std::cout << "  pyramid: " << pyramidTime << "ms, DoG: " << doGTime << "ms, keypoints: " << pointsTime
+		<< "ms, descriptors: " << descriptorsTime << "ms, total: " << pyramidTime + doGTime + pointsTime + descriptorsTime << "ms" << std::endl;
+	std::cout << "  memory (MB): pyramid " << pyramid.getByteSize() / 1048576. << ", DoG " << doG.getByteSize() / 1048576.
+		<< ", gradients " << gradients.getByteSize() / 1048576. << ", directions " << directions.getByteSize() / 1048576. << std::endl;
+	std::cout << "  keypoints: " << points.size() << ", descriptors: " << result.second.size() << std::endl;
+}
+
+void Benchmark::benchmarkFloat(const DoubleMatrix& source)
+{
+	std::cout << "Image " << source.getWidth() << "x" << source.getHeight() << std::endl;
+	std::cout << "double:" << std::endl;
+	benchmarkPipeline(source);
+	std::cout << "float:" << std::endl;
+	benchmarkPipeline(source.cast<float>());
+}
+
+void Benchmark::benchmarkThreads(const DoubleMatrix& source)
+{
+	int threadCount = ThreadPool::getGlobalThreadCount();
+	auto filters = [&]() {
+		std::vector<DoubleMatrix> results;
+		results.push_back(source.gaussian(1.6));
+		results.push_back(source.convolution(DoubleMatrix::createGaussian(1.0)));
+		results.push_back(source.calcSobel());
+		results.push_back(source.gradientDirection());
+		results.push_back(source.mul(source).add(0.5));
+		return results;
+	};
+
+	ThreadPool::setGlobalThreadCount(1);
+	std::vector<DoubleMatrix> sequential = filters();
+	double sequentialTime = measure(filters);
+	ThreadPool::setGlobalThreadCount(threadCount);
+	std::vector<DoubleMatrix> parallel = filters();
+	double parallelTime = measure(filters);
+
+	bool identical = true;
+	for (size_t i = 0; i < sequential.size(); i++) {
+		identical = identical && sequential[i].allClose(parallel[i], 0.0);
+	}
+
+	std::cout << "Image " << source.getWidth() << "x" << source.getHeight() << std::endl;
+	std::cout << "filters 1 thread: " << sequentialTime << "ms" << std::endl;
+	std::cout << "filters " << threadCount << " threads: " << parallelTime << "ms"
+		<< " (x" << sequentialTime / parallelTime << ")"
+		<< " identical: " << (identical ? "true" : "false") << std::endl;
+}
+
+void Benchmark::benchmarkMoravec(const DoubleMatrix& source)
+{
+	std::cout << "Image " << source.getWidth() << "x" << source.getHeight() << std::endl;
+	for (int windowSize : { 3, 9, 15 }) {
+		DoubleMatrix direct, boxSums;
+		double directTime = measure([&]() { direct = source.operatorMoravecDirect(windowSize); }, 1);
+		double boxTime = measure([&]() { boxSums = source.operatorMoravec(windowSize); }, 1);
+		// Бегущие суммы складывают окно в другом порядке, поэтому с прямым суммированием результат совпадает только с точностью до округления
+		bool close = direct.allClose(boxSums, SimdKernels::Epsilon);
+		std::cout << "moravec(" << windowSize << ") direct: " << directTime << "ms, box sums: " << boxTime << "ms"
+			<< " (x" << directTime / boxTime << ")"
+			<< " equal within tolerance (eps=" << SimdKernels::Epsilon << "): " << (close ? "true" : "false") << std::endl;
+	}
+}
+
+void Benchmark::benchmarkExpressions(const DoubleMatrix& source)
+{
+	DoubleMatrix a = source.gaussian(1.0);
+	DoubleMatrix b = source.gaussian(2.0);
+	DoubleMatrix c = source.gaussian(3.0);
+	DoubleMatrix methods, expressions;
+	double coef = 0.04;
+
+	// Отклик Харриса det - coef * trace^2
+	long long startCount = DoubleMatrix::getAllocationCount();
+	double methodsTime = measure([&]() { methods = a.mul(c).sub(b.mul(b)).sub(a.add(c).mul(coef).mul(a.add(c))); }, 1);
+	long long methodsCount = DoubleMatrix::getAllocationCount() - startCount;
+
+	startCount = DoubleMatrix::getAllocationCount();
+	double expressionsTime = measure([&]() { expressions = a * c - b * b - coef * (a + c) * (a + c); }, 1);
+	long long expressionsCount = DoubleMatrix::getAllocationCount() - startCount;
+
+	std::cout << "Image " << source.getWidth() << "x" << source.getHeight() << std::endl;
+	std::cout << "a * c - b * b - k * (a + c)^2 methods: " << methodsTime << "ms, allocations: " << methodsCount << std::endl;
+	std::cout << "a * c - b * b - k * (a + c)^2 expressions: " << expressionsTime << "ms, allocations: " << expressionsCount
+		<< " (x" << methodsTime / expressionsTime << ")"
+		<< " identical: " << (methods.allClose(expressions, 0.0) ? "true" : "false") << std::endl;
+}
+
+void Benchmark::benchmarkPool(const DoubleMatrix& source)
+{
+	std::cout << "Image " << source.getWidth() << "x" << source.getHeight() << std::endl;
+	for (int frame = 0; frame < 3; frame++) {
+		BufferPool::resetCounters();
+		double time = measure([&]() {
+			Pyramid pyramid = Pyramid::createWithOverlap(source, 0.5, 1.6, 4, 3, 2);
+			Pyramid doG = pyramid.createDoGPyramid();
+			Pyramid gradients, directions;
+			pyramid.createGradientPyramids(gradients, directions);
+			Pyramid harris = pyramid.createHarrisPyramid();
+		}, 1);
+		std::cout << "frame " << frame << ": " << time << "ms, pool hits: " << BufferPool::getHits()
+			<< ", misses: " << BufferPool::getMisses()
+			<< ", cached: " << BufferPool::getCachedBytes() / 1048576. << "MB" << std::endl;
+	}
+}
+
+namespace
+{
+	// Отношение расстояний, которое отличается от порога или от 1 меньше чем на эту долю, считается ничьей:
+	// при таком отношении решение NNDR зависит от округления суммы
+	const double MatchTieTolerance = 1e-9;
+
+	// Исходный матчер (до упаковки дескрипторов и SIMD): евклидово расстояние через последовательную сумму
+	// квадратов разностей, как std::accumulate в DoubleMatrix::sum. nearTie[i] - ответ для запроса i определяется ничьей
+	std::vector<int> sequentialMatches(const std::vector<Descriptor>& a, const std::vector<Descriptor>& b, double threshold, std::vector<bool>& nearTie)
+	{
+		std::vector<int> matched(a.size(), -1);
+		nearTie.assign(a.size(), false);
+		if (b.size() < 2) return matched;
+		for (size_t i = 0; i < a.size(); i++) {
+			double best = std::numeric_limits<double>::max();
+			double nextBest = best;
+			int bestIndex = -1;
+			for (size_t j = 0; j < b.size(); j++) {
+				double sum = 0;
+				for (int k = 0; k < a[i].getSize(); k++) {
+					double diff = a[i][k] - b[j][k];
+					sum += diff * diff;
+				}
+				double distance = std::sqrt(sum);
+				if (distance < best) {
+					nextBest = best;
+					best = distance;
+					bestIndex = static_cast<int>(j);
+				}
+				else if (distance < nextBest) {
+					nextBest = distance;
+				}
+			}
+			double ratio = best / nextBest;
+			nearTie[i] = std::abs(ratio - threshold) <= MatchTieTolerance * threshold || 1 - ratio <= MatchTieTolerance;
+			if (ratio < threshold) matched[i] = bestIndex;
+		}
+		return matched;
+	}
+}
+
+void Benchmark::benchmarkMatcher(const DoubleMatrix& source)
+{
+	// Дескрипторы исходного изображения и его размытой копии
+	DescriptorExtractor extractor(16, 4, 8);
+	auto describe = [&](const DoubleMatrix& img) {
+		Pyramid pyramid = Pyramid::createWithOverlap(img, 0.5, 1.6, 4, 3, 2);
+		Pyramid doG = pyramid.createDoGPyramid();
+		std::vector<KeyPoint> points = KeyPointHelper::findExtremePoints(pyramid, doG, 0.002, 5);
+		return extractor.computeScale(pyramid, points).second;
+	};
+	std::vector<Descriptor> a = describe(source);
+	std::vector<Descriptor> b = describe(source.gaussian(0.7));
+	double threshold = 0.8;
+
+	// Полный перебор на всех уровнях SIMD должен давать одинаковые совпадения
+	SimdKernels::Level supported = SimdKernels::getSupportedLevel();
+	std::vector<std::pair<int, int>> bruteForce;
+	std::cout << "Descriptors " << a.size() << " x " << b.size() << std::endl;
+	for (int level = static_cast<int>(SimdKernels::Level::Scalar); level <= static_cast<int>(supported); level++) {
+		SimdKernels::setLevel(static_cast<SimdKernels::Level>(level));
+		std::vector<std::pair<int, int>> matches;
+		double time = measure([&]() { matches = DescriptorExtractor::findMatches(a, b, threshold); }, 1);
+		if (level == static_cast<int>(SimdKernels::Level::Scalar)) bruteForce = matches;
+		std::cout << "brute force " << SimdKernels::getLevelName(SimdKernels::getLevel()) << ": " << time << "ms"
+			<< ", matches: " << matches.size() << ", identical: " << (matches == bruteForce ? "true" : "false") << std::endl;
+	}
+	SimdKernels::setLevel(supported);
+
+	// Сравнение с исходным матчером: частичные суммы ядер округляются иначе, чем последовательная сумма,
+	// поэтому совпадения могут отличаться только для запросов с ничьей
+	std::vector<bool> nearTie;
+	std::vector<int> baseline = sequentialMatches(a, b, threshold, nearTie);
+	std::vector<int> current(a.size(), -1);
+	for (const auto& match : bruteForce) current[match.first] = match.second;
+	int baselineCount = 0;
+	int differences = 0;
+	int tieDifferences = 0;
+	for (size_t i = 0; i < a.size(); i++) {
+		if (baseline[i] >= 0) baselineCount++;
+		if (baseline[i] == current[i]) continue;
+		differences++;
+		if (nearTie[i]) tieDifferences++;
+	}
+	std::cout << "sequential sums (baseline): matches: " << baselineCount << ", differences: " << differences
+		<< " (near ties: " << tieDifferences << "), identical up to ties: " << (differences == tieDifferences ? "true" : "false") << std::endl;
+
+	// Наборы float и uint8 (квантование 512 * v): совпадения сравниваются с полным перебором по double
+	int dims = a.empty() ? 0 : a[0].getSize();
+	auto compare = [&](const char* name, size_t valueSize, const std::vector<std::pair<int, int>>& matches, double time) {
+		std::vector<std::pair<int, int>> found;
+		std::set_intersection(begin(bruteForce), end(bruteForce), begin(matches), end(matches), std::back_inserter(found));
+		double recall = bruteForce.empty() ? 1.0 : static_cast<double>(found.size()) / bruteForce.size();
+		double precision = matches.empty() ? 1.0 : static_cast<double>(found.size()) / matches.size();
+		std::cout << name << ": " << time << "ms, " << (a.size() + b.size()) * dims * valueSize / 1024 << " KB"
+			<< ", matches: " << matches.size() << ", recall: " << recall << ", precision: " << precision << std::endl;
+	};
+	double doubleTime = measure([&]() { DescriptorExtractor::findMatches(a, b, threshold); }, 1);
+	compare("double", sizeof(double), bruteForce, doubleTime);
+	DescriptorSet floatA(a), floatB(b);
+	std::vector<std::pair<int, int>> floatMatches;
+	double floatTime = measure([&]() { floatMatches = DescriptorExtractor::findMatches(floatA, floatB, threshold); }, 1);
+	compare("float set", sizeof(float), floatMatches, floatTime);
+	ByteDescriptorSet byteA(a), byteB(b);
+	std::vector<std::pair<int, int>> byteMatches;
+	double byteTime = measure([&]() { byteMatches = DescriptorExtractor::findMatches(byteA, byteB, threshold); }, 1);
+	compare("uint8 set", sizeof(uint8_t), byteMatches, byteTime);
+
+	std::vector<std::pair<int, int>> forestMatches;
+	double buildTime = measure([&]() { KDForest forest(b); }, 1);
+	KDForest forest(b);
+	for (int checks : { 16, 64, 256, 1024 }) {
+		double time = measure([&]() { forestMatches = forest.match(a, threshold, checks); }, 1);
+		std::vector<std::pair<int, int>> found;
+		std::set_intersection(begin(bruteForce), end(bruteForce), begin(forestMatches), end(forestMatches), std::back_inserter(found));
+		double recall = bruteForce.empty() ? 1.0 : static_cast<double>(found.size()) / bruteForce.size();
+		std::cout << "KD-forest checks=" << checks << ": " << time << "ms (+" << buildTime << "ms build)"
+			<< ", matches: " << forestMatches.size() << ", recall: " << recall << std::endl;
+	}
+}
+
+void Benchmark::benchmarkAnms(const DoubleMatrix& source)
+{
+	const int pointCount = 500;
+	std::mt19937 random(1);
+	std::uniform_real_distribution<double> response(0.0, 1.0);
+	std::cout << "Image " << source.getWidth() << "x" << source.getHeight() << ", keep " << pointCount << " points" << std::endl;
+	for (int candidateCount : { 10000, 30000, 100000 }) {
+		std::vector<KeyPoint> candidates;
+		candidates.reserve(candidateCount);
+		for (int i = 0; i < candidateCount; i++) {
+			candidates.push_back(KeyPoint(random() % source.getWidth(), random() % source.getHeight(), response(random)));
+		}
+
+		std::vector<KeyPoint> points, brownPoints;
+		double anmsTime = measure([&]() { points = candidates; points = KeyPointHelper::anms(points, pointCount); }, 1);
+		double brownTime = measure([&]() { brownPoints = candidates; brownPoints = KeyPointHelper::brownAnms(brownPoints, pointCount); }, 1);
+		std::cout << candidateCount << " candidates: anms " << anmsTime << "ms (" << points.size() << " points)"
+			<< ", brownAnms " << brownTime << "ms (" << brownPoints.size() << " points)" << std::endl;
+	}
+}
+
+void Benchmark::benchmarkPyramid(const DoubleMatrix& source)
+{
+	// Самая маленькая октава не меньше 16 пикселей по короткой стороне
+	int octaveCount = 1;
+	while (octaveCount < 6 && (std::min(source.getWidth(), source.getHeight()) >> octaveCount) >= 16) octaveCount++;
+	int threadCount = ThreadPool::getGlobalThreadCount();
+	auto build = [&]() { return Pyramid::createWithOverlap(source, 0.5, 1.6, octaveCount, 3, 2); };
+
+	ThreadPool::setGlobalThreadCount(1);
+	Pyramid sequential = build();
+	double sequentialTime = measure(build, 1);
+	ThreadPool::setGlobalThreadCount(threadCount);
+	Pyramid parallel = build();
+	double parallelTime = measure(build, 1);
+
+	bool identical = true;
+	for (size_t i = 0; i < sequential.get().size(); i++) {
+		identical = identical && sequential.getImage(i).allClose(parallel.getImage(i), 0.0);
+	}
+
+	std::cout << "Image " << source.getWidth() << "x" << source.getHeight() << ", " << octaveCount << " octaves" << std::endl;
+	std::cout << "pyramid 1 thread: " << sequentialTime << "ms" << std::endl;
+	std::cout << "pyramid " << threadCount << " threads: " << parallelTime << "ms"
+		<< " (x" << sequentialTime / parallelTime << ")"
+		<< " identical: " << (identical ? "true" : "false") << std::endl;
+}
+
+template<typename T>
+void Benchmark::benchmarkGradient(const Matrix<T>& source)
+{
+	Matrix<T> separateMagnitude, separateDirection, magnitude, direction, fastMagnitude, fastDirection;
+	double separateTime = measure([&]() {
+		separateMagnitude = source.calcSobel();
+		separateDirection = source.gradientDirection();
+	});
+	double fusedTime = measure([&]() { source.gradient(magnitude, direction); });
+	double fastTime = measure([&]() { source.gradient(fastMagnitude, fastDirection, true); });
+
+	// Ошибка направления с учетом перехода через 0 и 2pi
+	double maxError = 0;
+	for (int i = 0; i < direction.getSize(); i++) {
+		double error = std::abs(static_cast<double>(fastDirection.at(i)) - direction.at(i));
+		maxError = std::max(maxError, std::min(error, 2 * M_PI - error));
+	}
+
+	std::cout << (sizeof(T) == sizeof(double) ? "double" : "float") << " calcSobel + gradientDirection: " << separateTime << "ms" << std::endl;
+	std::cout << "gradient: " << fusedTime << "ms (x" << separateTime / fusedTime << ")"
+		<< " identical: " << (magnitude.allClose(separateMagnitude, 0.0) && direction.allClose(separateDirection, 0.0) ? "true" : "false") << std::endl;
+	std::cout << "gradient fast atan2 (" << SimdKernels::getLevelName(SimdKernels::getLevel()) << "): " << fastTime << "ms"
+		<< " (x" << separateTime / fastTime << ")"
+		<< " max direction error: " << maxError << std::endl;
+}
+
+void Benchmark::run(const QString& name, const DoubleMatrix& source)
+{
+	if (name == "simd") {
+		benchmarkSimd(source);
+	}
+	else if (name == "float") {
+		benchmarkFloat(source);
+	}
+	else if (name == "threads") {
+		benchmarkThreads(source);
+	}
+	else if (name == "moravec") {
+		benchmarkMoravec(source);
+	}
+	else if (name == "expr") {
+		benchmarkExpressions(source);
+	}
+	else if (name == "pool") {
+		benchmarkPool(source);
+	}
+	else if (name == "matcher") {
+		benchmarkMatcher(source);
+	}
+	else if (name == "anms") {
+		benchmarkAnms(source);
+	}
+	else if (name == "pyramid") {
+		benchmarkPyramid(source);
+	}
+	else if (name == "gradient") {
+		std::cout << "Image " << source.getWidth() << "x" << source.getHeight() << std::endl;
+		benchmarkGradient(source);
+		benchmarkGradient(source.cast<float>());
+	}
+	else if (name == "export") {
+		std::cout << "Image " << source.getWidth() << "x" << source.getHeight() << std::endl;
+		benchmarkExport(source);
+		benchmarkExport(source.cast<float>());
+	}
+	else {
+		std::cout << "Unknown benchmark: " << name.toStdString() << std::endl;
+	}
+}
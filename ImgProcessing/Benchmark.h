@@ -0,0 +1,44 @@
+#pragma once
+#include <functional>
+#include <QtCore/qstring.h>
+#include "DoubleMatrix.h"
+// Замеры производительности отдельных этапов обработки изображения
+class Benchmark
+{
+private:
+	// Время выполнения функции в миллисекундах (лучшее из repeat запусков)
+	static double measure(const std::function<void()>& f, int repeat = 3);
+	// Сравнение скалярных и векторных ядер свертки
+	static void benchmarkSimd(const DoubleMatrix& source);
+	// Совпадение байтов normalizeToBytes на всех уровнях с norm255 и отбрасыванием дробной части
+	template<typename T>
+	static void checkNormalizeToBytes(const Matrix<T>& source);
+	// Сравнение экспорта в Grayscale8 без копии матрицы и старого пути через norm255 и RGB32
+	template<typename T>
+	static void benchmarkExport(const Matrix<T>& source);
+	// Полный конвейер (пирамида, DoG, ключевые точки, дескрипторы) для матриц с элементами типа T
+	template<typename T>
+	static void benchmarkPipeline(const Matrix<T>& source);
+	// Сравнение конвейера на матрицах double и float
+	static void benchmarkFloat(const DoubleMatrix& source);
+	// Сравнение однопоточного и многопоточного выполнения фильтров
+	static void benchmarkThreads(const DoubleMatrix& source);
+	// Сравнение прямого детектора Моравека и детектора на бегущих суммах
+	static void benchmarkMoravec(const DoubleMatrix& source);
+	// Сравнение цепочки методов add/sub/mul и ленивых выражений по времени и числу выделений памяти
+	static void benchmarkExpressions(const DoubleMatrix& source);
+	// Обращения к пулу буферов при обработке последовательности кадров одного разрешения
+	static void benchmarkPool(const DoubleMatrix& source);
+	// Полнота и скорость сопоставления по KD-лесу и по наборам float/uint8 в сравнении с полным перебором по double
+	static void benchmarkMatcher(const DoubleMatrix& source);
+	// Время ANMS на случайных наборах точек размером с изображение
+	static void benchmarkAnms(const DoubleMatrix& source);
+	// Построение пирамиды из 6 октав (или меньше для маленьких изображений) в одном и нескольких потоках
+	static void benchmarkPyramid(const DoubleMatrix& source);
+	// Раздельное и совместное вычисление модуля и направления градиента, точность приближения atan2
+	template<typename T>
+	static void benchmarkGradient(const Matrix<T>& source);
+public:
+	// Запуск замера с заданным именем на заданном изображении
+	static void run(const QString& name, const DoubleMatrix& source);
+};
@@ -0,0 +1,198 @@
+#include <new>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include "BufferPool.h"
+
+struct BufferPool::State
+{
+	std::mutex mutex;
+	// Свободные буферы по размеру в байтах
+	std::unordered_map<size_t, std::vector<void*>> freeBuffers;
+	size_t cachedBytes = 0;
+	size_t capacity = size_t(1) << 30;
+
+	~State()
+	{
+		for (auto& bucket : freeBuffers) {
+			for (void* buffer : bucket.second) ::operator delete(buffer);
+		}
+	}
+};
+
+namespace
+{
+	// Счетчики не входят в State: кэши рабочих потоков общего пула освобождаются при завершении программы,
+	// возможно, уже после удаления State
+	std::atomic<long long> poolHits(0);
+	std::atomic<long long> poolMisses(0);
+	// Суммарный размер свободных буферов в кэшах потоков
+	std::atomic<size_t> threadCachedBytes(0);
+
+	// Наименьший класс размера маленьких буферов - 2^MinSizeClassBits байт, наибольший - MinSharedBytes
+	const int MinSizeClassBits = 4;
+	const int SizeClassCount = 11;
+	// Наибольшее число свободных буферов одного класса в кэше потока
+	const size_t MaxThreadBuffers = 64;
+
+	int getSizeClass(size_t bytes)
+	{
+		int bits = MinSizeClassBits;
+		while ((size_t(1) << bits) < bytes) bits++;
+		return bits - MinSizeClassBits;
+	}
+
+	size_t getClassBytes(int sizeClass)
+	{
+		return size_t(1) << (sizeClass + MinSizeClassBits);
+	}
+
+	// Свободные маленькие буферы потока по классам размера, доступ без блокировок.
+	// Буфер, выделенный в одном потоке и освобожденный в другом, попадает в кэш освободившего потока
+	struct ThreadCache
+	{
+		std::vector<void*> freeBuffers[SizeClassCount];
+
+		void clear()
+		{
+			for (int i = 0; i < SizeClassCount; i++) {
+				for (void* buffer : freeBuffers[i]) ::operator delete(buffer);
+				threadCachedBytes -= freeBuffers[i].size() * getClassBytes(i);
+				freeBuffers[i].clear();
+			}
+		}
+	};
+
+	// Кэш потока удален: статические матрицы освобождаются после thread_local объектов главного потока,
+	// их буферы возвращаются в кучу
+	thread_local bool threadCacheDestroyed = false;
+}
+
+// Состояние создается при первом обращении, чтобы статические матрицы могли использовать пул при инициализации
+BufferPool::State& BufferPool::getState()
+{
+	static State state;
+	return state;
+}
+
+namespace
+{
+	// Кэш потока создается при первом обращении в потоке и освобождается при его завершении
+	struct ThreadCacheHolder
+	{
+		ThreadCache cache;
+
+		~ThreadCacheHolder()
+		{
+			threadCacheDestroyed = true;
+			cache.clear();
+		}
+	};
+
+	// Кэш вызывающего потока (nullptr, если поток завершается и кэш уже удален)
+	ThreadCache* getThreadCache()
+	{
+		if (threadCacheDestroyed) return nullptr;
+		thread_local ThreadCacheHolder holder;
+		return &holder.cache;
+	}
+}
+
+void* BufferPool::allocate(size_t bytes)
+{
+	if (bytes < MinSharedBytes) {
+		int sizeClass = getSizeClass(bytes);
+		ThreadCache* cache = getThreadCache();
+		if (cache && !cache->freeBuffers[sizeClass].empty()) {
+			void* buffer = cache->freeBuffers[sizeClass].back();
+			cache->freeBuffers[sizeClass].pop_back();
+			threadCachedBytes -= getClassBytes(sizeClass);
+			poolHits++;
+			return buffer;
+		}
+		poolMisses++;
+		return ::operator new(getClassBytes(sizeClass));
+	}
+	State& state = getState();
+	{
+		std::lock_guard<std::mutex> lock(state.mutex);
+		auto bucket = state.freeBuffers.find(bytes);
+		if (bucket != state.freeBuffers.end() && !bucket->second.empty()) {
+			void* buffer = bucket->second.back();
+			bucket->second.pop_back();
+			state.cachedBytes -= bytes;
+			poolHits++;
+			return buffer;
+		}
+		poolMisses++;
+	}
+	return ::operator new(bytes);
+}
+
+void BufferPool::deallocate(void* buffer, size_t bytes)
+{
+	if (bytes < MinSharedBytes) {
+		int sizeClass = getSizeClass(bytes);
+		ThreadCache* cache = getThreadCache();
+		if (cache && cache->freeBuffers[sizeClass].size() < MaxThreadBuffers) {
+			cache->freeBuffers[sizeClass].push_back(buffer);
+			threadCachedBytes += getClassBytes(sizeClass);
+			return;
+		}
+		::operator delete(buffer);
+		return;
+	}
+	State& state = getState();
+	{
+		std::lock_guard<std::mutex> lock(state.mutex);
+		if (state.cachedBytes + bytes <= state.capacity) {
+			state.freeBuffers[bytes].push_back(buffer);
+			state.cachedBytes += bytes;
+			return;
+		}
+	}
+	::operator delete(buffer);
+}
+
+long long BufferPool::getHits()
+{
+	return poolHits;
+}
+
+long long BufferPool::getMisses()
+{
+	return poolMisses;
+}
+
+void BufferPool::resetCounters()
+{
+	poolHits = 0;
+	poolMisses = 0;
+}
+
+size_t BufferPool::getCachedBytes()
+{
+	State& state = getState();
+	std::lock_guard<std::mutex> lock(state.mutex);
+	return state.cachedBytes + threadCachedBytes;
+}
+
+void BufferPool::setCapacity(size_t bytes)
+{
+	State& state = getState();
+	std::lock_guard<std::mutex> lock(state.mutex);
+	state.capacity = bytes;
+}
+
+void BufferPool::clear()
+{
+	State& state = getState();
+	ThreadCache* cache = getThreadCache();
+	if (cache) cache->clear();
+	std::lock_guard<std::mutex> lock(state.mutex);
+	for (auto& bucket : state.freeBuffers) {
+		for (void* buffer : bucket.second) ::operator delete(buffer);
+	}
+	state.freeBuffers.clear();
+	state.cachedBytes = 0;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+// Пул буферов памяти, сгруппированных по размеру.
+// Освобожденные буферы не возвращаются в кучу, а переиспользуются при следующем запросе того же размера,
+// поэтому обработка последовательности изображений одного разрешения не выделяет новую память
+class BufferPool
+{
+private:
+	struct State;
+	static State& getState();
+public:
+	// Буферы меньшего размера (дескрипторы, гистограммы, маленькие ядра) хранятся в кэше своего потока
+	// по классам размера (степени двойки) и выделяются без общего мьютекса пула
+	static constexpr size_t MinSharedBytes = 16384;
+
+	// Выделяет буфер заданного размера в байтах (из пула, если есть свободный буфер такого размера)
+	static void* allocate(size_t bytes);
+	// Возвращает буфер в пул (или освобождает, если пул заполнен)
+	static void deallocate(void* buffer, size_t bytes);
+
+	// Число запросов, обслуженных из пула или кэша потока
+	static long long getHits();
+	// Число запросов, для которых пришлось выделить новую память
+	static long long getMisses();
+	static void resetCounters();
+	// Суммарный размер свободных буферов в пуле и кэшах потоков
+	static size_t getCachedBytes();
+	// Максимальный суммарный размер свободных буферов общего пула (по умолчанию 1 ГБ).
+	// Кэш потока ограничен числом буферов каждого класса размера
+	static void setCapacity(size_t bytes);
+	// Освобождает все свободные буферы пула и кэша вызывающего потока
+	static void clear();
+};
+
+// Аллокатор для стандартных контейнеров, берущий память из BufferPool
+template<typename T>
+class PoolAllocator
+{
+public:
+	using value_type = T;
+
+	PoolAllocator() = default;
+	template<typename U>
+	PoolAllocator(const PoolAllocator<U>&) {}
+
+	T* allocate(size_t n) { return static_cast<T*>(BufferPool::allocate(n * sizeof(T))); }
+	void deallocate(T* p, size_t n) { BufferPool::deallocate(p, n * sizeof(T)); }
+
+	template<typename U>
+	bool operator==(const PoolAllocator<U>&) const { return true; }
+	template<typename U>
+	bool operator!=(const PoolAllocator<U>&) const { return false; }
+};
+
+// Вектор, хранящий элементы в памяти из BufferPool
+template<typename T>
+using PoolVector = std::vector<T, PoolAllocator<T>>;
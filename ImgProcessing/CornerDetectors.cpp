@@ -4,15 +4,18 @@
 #include <QtCore\qdebug.h>
 #include "DoubleMatrix.h"
 #include "KeyPoint.h"
+#include "SimdKernels.h"
+#include "ThreadPool.h"
 
-double DoubleMatrix::moravecC(int x, int y, const std::vector<int>& windowSize, const std::vector<int>& d)
+template<typename T>
+T Matrix<T>::moravecC(int x, int y, const std::vector<int>& windowSize, const std::vector<int>& d)
 {
 	int offsetY = windowSize[0] / 2;
 	int offsetX = windowSize[1] / 2;
-	double sum = 0;
+	T sum = 0;
 	for (int u = -offsetY; u <= offsetY; u++) {
 		for (int v = -offsetX; v <= offsetX; v++) {
-			double diff = at(y + u, x + v) - at(y + u + d[0], x + v + d[1]);
+			T diff = at(y + u, x + v) - at(y + u + d[0], x + v + d[1]);
 			sum += diff * diff;
 		}
 	}
@@ -20,25 +23,100 @@ double DoubleMatrix::moravecC(int x, int y, const std::vector<int>& windowSize,
 	return sum;
 }
 
-DoubleMatrix DoubleMatrix::operatorMoravec(int windowSize) const
+template<typename T>
+Matrix<T> Matrix<T>::operatorMoravec(int windowSize) const
 {
-	DoubleMatrix* workImg = new DoubleMatrix(width, height);
+	Matrix<T> workImg;
+	int halfWindow = windowSize / 2;
+	int offset = halfWindow + 1;
+	copyWithBorder(*this, &workImg, offset, offset);
+	int workWidth = workImg.width;
+	int workHeight = workImg.height;
+
+	Matrix<T> sValues(width, height);
+	sValues.fillMatrix(std::numeric_limits<T>::max());
+
+	// Сдвиги (dy, dx), ошибка для противоположного сдвига -d в точке p равна ошибке для d в точке p - d
+	const int shifts[4][2] = { { 0, 1 }, { 1, -1 }, { 1, 0 }, { 1, 1 } };
+	// Квадраты разностей при сдвиге, их суммы по столбцам окна и суммы по всему окну
+	PoolVector<T> diffs(workImg.matrix.size());
+	PoolVector<double> columnSums(workImg.matrix.size());
+	PoolVector<T> boxSums(workImg.matrix.size());
+	for (auto& shift : shifts) {
+		int dy = shift[0];
+		int dx = shift[1];
+		ThreadPool::parallelRows(workHeight, workWidth, [&](int rowBegin, int rowEnd) {
+			for (int y = rowBegin; y < rowEnd; y++) {
+				for (int x = 0; x < workWidth; x++) {
+					// Точки, для которых сдвиг выходит за рабочее изображение, в окна не попадают
+					bool inside = y + dy < workHeight && x + dx > -1 && x + dx < workWidth;
+					T diff = inside ? workImg.at(y, x) - workImg.at(y + dy, x + dx) : 0;
+					diffs[y * workWidth + x] = diff * diff;
+				}
+			}
+		});
+
+		// Бегущие суммы по окну: сначала по столбцам, затем по строкам (накопление в double)
+		ThreadPool::parallelRows(workWidth, workHeight, [&](int colBegin, int colEnd) {
+			for (int x = colBegin; x < colEnd; x++) {
+				double sum = 0;
+				for (int y = 0; y < 2 * halfWindow; y++) sum += diffs[y * workWidth + x];
+				for (int y = halfWindow; y < workHeight - halfWindow; y++) {
+					sum += diffs[(y + halfWindow) * workWidth + x];
+					columnSums[y * workWidth + x] = sum;
+					sum -= diffs[(y - halfWindow) * workWidth + x];
+				}
+			}
+		});
+		ThreadPool::parallelRows(workHeight - 2 * halfWindow, workWidth, [&](int rowBegin, int rowEnd) {
+			for (int y = rowBegin + halfWindow; y < rowEnd + halfWindow; y++) {
+				const double* column = &columnSums[y * workWidth];
+				T* row = &boxSums[y * workWidth];
+				double sum = 0;
+				for (int x = 0; x < 2 * halfWindow; x++) sum += column[x];
+				for (int x = halfWindow; x < workWidth - halfWindow; x++) {
+					sum += column[x + halfWindow];
+					row[x] = static_cast<T>(sum);
+					sum -= column[x - halfWindow];
+				}
+			}
+		});
+
+		ThreadPool::parallelRows(height, width, [&](int rowBegin, int rowEnd) {
+			for (int y = rowBegin; y < rowEnd; y++) {
+				for (int x = 0; x < width; x++) {
+					int center = (y + offset) * workWidth + x + offset;
+					T err = std::min(boxSums[center], boxSums[center - dy * workWidth - dx]);
+					T& pointS = sValues.matrix[y * width + x];
+					pointS = std::min(pointS, err);
+				}
+			}
+		});
+	}
+
+	return sValues;
+}
+
+template<typename T>
+Matrix<T> Matrix<T>::operatorMoravecDirect(int windowSize) const
+{
+	Matrix<T>* workImg = new Matrix<T>(width, height);
     std::vector<int> wSize{ windowSize, windowSize };
 	int offsetY = wSize[0] / 2 + 1;
 	int offsetX = wSize[1] / 2 + 1;
 	std::vector<int> d(2);
 	copyWithBorder(*this, workImg, offsetX, offsetY);
 
-	DoubleMatrix sValues(width, height);
+	Matrix<T> sValues(width, height);
 	for (int y = offsetY; y < workImg->height - offsetY; y++) {
 		for (int x = offsetX ; x < workImg->width - offsetX; x++) {
-			double pointS = std::numeric_limits<double>::max();
+			T pointS = std::numeric_limits<T>::max();
 			for (int i = -1; i <= 1; i++) {
 				for (int j = -1; j <= 1; j++) {
 					if (i != 0 || j != 0) {
 						d[0] = i;
 						d[1] = j;
-						double err = workImg->moravecC(x, y, wSize, d);
+						T err = workImg->moravecC(x, y, wSize, d);
 						pointS = std::min(pointS, err);
 					}
 				}
@@ -49,39 +127,167 @@ DoubleMatrix DoubleMatrix::operatorMoravec(int windowSize) const
 	return sValues;
 }
 
-DoubleMatrix DoubleMatrix::operatorHarris(int windowSize) const
+template<typename T>
+Matrix<T> Matrix<T>::operatorHarris(int windowSize) const
+{
+	// Гауссово окно применяется сепарабельно: сначала по столбцам, затем по строкам
+	Matrix<T> result(width, height);
+	operatorHarris(windowSize, result);
+	return result;
+}
+
+template<typename T>
+void Matrix<T>::operatorHarris(int windowSize, Matrix<T>& result) const
+{
+	Matrix<T> window = createGaussianRow(windowSize / 2 * 2 + 1, windowSize / 6.);
+	result.setSize(width, height);
+
+	// Высота полосы, при которой пять промежуточных буферов полосы помещаются в кэш (~1 МБ)
+	const int cacheBytes = 1 << 20;
+	int bandRows = std::max(32, cacheBytes / std::max(1, 5 * width * static_cast<int>(sizeof(T))));
+
+	ThreadPool::global().parallelFor(0, height, bandRows, [&](int rowBegin, int rowEnd) {
+		for (int i = rowBegin; i < rowEnd; i += bandRows) {
+			harrisBand(window, i, std::min(i + bandRows, rowEnd), result);
+		}
+	});
+}
+
+template<typename T>
+void Matrix<T>::harrisBand(const Matrix<T>& window, int rowBegin, int rowEnd, Matrix<T>& result) const
 {
+	int offset = window.width / 2;
+	int kernelSize = window.width;
+	const T* kernel = window.matrix.data();
+
+	// Строки произведений производных, которые накрывает окно: [firstRow, firstRow + rowCount)
+	int firstRow = rowBegin - offset;
+	int rowCount = rowEnd - rowBegin + 2 * offset;
 
-	DoubleMatrix dx = this->dx();
-	DoubleMatrix dy = this->dy();
-	DoubleMatrix dx2 = dx * dx;
-	DoubleMatrix dy2 = dy * dy;
-	DoubleMatrix dxy = dx * dy;
-	DoubleMatrix gauss = createGaussian(windowSize, windowSize, windowSize / 6.);
+	// Строки изображения, для которых нужны свертки по строке (с учетом заполнения границ)
+	PoolVector<int> productRows(rowCount);
+	PoolVector<int> sourceSlots(height, -1);
+	int slotCount = 0;
+	for (int t = 0; t < rowCount; t++) {
+		int row = getBorderIndex(firstRow + t, height);
+		productRows[t] = row;
+		if (row < 0) continue;
+		for (int r = row - 1; r <= row + 1; r++) {
+			int sourceRow = getBorderIndex(r, height);
+			if (sourceRow >= 0 && sourceSlots[sourceRow] < 0) sourceSlots[sourceRow] = slotCount++;
+		}
+	}
+
+	// Свертки строк по [1, 0, -1] (для dx) и по [1, 2, 1] (для dy)
+	PoolVector<T> rowsX(slotCount * width);
+	PoolVector<T> rowsY(slotCount * width);
+	for (int r = 0; r < height; r++) {
+		int slot = sourceSlots[r];
+		if (slot < 0) continue;
+		convolutionRowAt(row101, r, &rowsX[slot * width]);
+		convolutionRowAt(sobelRow, r, &rowsY[slot * width]);
+	}
 
-	DoubleMatrix a = dx2.convolution(gauss);
-	DoubleMatrix b = dxy.convolution(gauss);
-	DoubleMatrix c = dy2.convolution(gauss);
+	// Произведения dx * dx, dx * dy, dy * dy
+	PoolVector<T> a(rowCount * width);
+	PoolVector<T> b(rowCount * width);
+	PoolVector<T> c(rowCount * width);
+	PoolVector<T> zeros(width, 0);
+	PoolVector<T> dxRow(width);
+	PoolVector<T> dyRow(width);
+	const T* colX[3];
+	const T* colY[3];
+	for (int t = 0; t < rowCount; t++) {
+		int row = productRows[t];
+		if (row < 0) continue;
+		for (int k = 0; k < 3; k++) {
+			int sourceRow = getBorderIndex(row + 1 - k, height);
+			colX[k] = sourceRow < 0 ? zeros.data() : &rowsX[sourceSlots[sourceRow] * width];
+			colY[k] = sourceRow < 0 ? zeros.data() : &rowsY[sourceSlots[sourceRow] * width];
+		}
+		SimdKernels::convolveCol(colX, dxRow.data(), width, sobelRow.matrix.data(), 3);
+		SimdKernels::convolveCol(colY, dyRow.data(), width, row101.matrix.data(), 3);
 
-	return harrisE(a, b, c);
+		T* pa = &a[t * width];
+		T* pb = &b[t * width];
+		T* pc = &c[t * width];
+		for (int j = 0; j < width; j++) {
+			pa[j] = dxRow[j] * dxRow[j];
+			pb[j] = dxRow[j] * dyRow[j];
+			pc[j] = dyRow[j] * dyRow[j];
+		}
+	}
+
+	// Свертка строки с окном, столбцы за границей берутся по типу заполнения границ
+	int interiorBegin = std::min(offset, width);
+	int interiorEnd = std::max(width - offset, interiorBegin);
+	auto convolveWindowRow = [&](const T* src, T* dst) {
+		for (int j = 0; j < width; j++) {
+			if (j == interiorBegin) {
+				SimdKernels::convolveRow(src, dst, interiorBegin, interiorEnd, kernel, kernelSize);
+				j = interiorEnd;
+				if (j >= width) break;
+			}
+			T sum = 0;
+			for (int k = 0; k < kernelSize; k++) {
+				int col = getBorderIndex(j + offset - k, width);
+				if (col >= 0) sum += src[col] * kernel[k];
+			}
+			dst[j] = sum;
+		}
+	};
+
+	PoolVector<const T*> windowRows(kernelSize);
+	PoolVector<T> column(width);
+	PoolVector<T> sumA(width);
+	PoolVector<T> sumB(width);
+	PoolVector<T> sumC(width);
+	for (int i = rowBegin; i < rowEnd; i++) {
+		int t = i - firstRow;
+		for (int k = 0; k < kernelSize; k++) windowRows[k] = &a[(t + offset - k) * width];
+		SimdKernels::convolveCol(windowRows.data(), column.data(), width, kernel, kernelSize);
+		convolveWindowRow(column.data(), sumA.data());
+		for (int k = 0; k < kernelSize; k++) windowRows[k] = &b[(t + offset - k) * width];
+		SimdKernels::convolveCol(windowRows.data(), column.data(), width, kernel, kernelSize);
+		convolveWindowRow(column.data(), sumB.data());
+		for (int k = 0; k < kernelSize; k++) windowRows[k] = &c[(t + offset - k) * width];
+		SimdKernels::convolveCol(windowRows.data(), column.data(), width, kernel, kernelSize);
+		convolveWindowRow(column.data(), sumC.data());
+
+		// Минимальное собственное число тензора [[a, b], [b, c]].
+		// Дискриминант (a + c)^2 - 4(ac - b^2) записан как (a - c)^2 + 4b^2, чтобы не получать отрицательных значений
+		T* dst = &result.matrix[i * width];
+		for (int j = 0; j < width; j++) {
+			T trace = sumA[j] + sumC[j];
+			T diff = sumA[j] - sumC[j];
+			T d = diff * diff + 4 * sumB[j] * sumB[j];
+			dst[j] = (trace - std::sqrt(d)) / 2;
+		}
+	}
 }
 
-DoubleMatrix DoubleMatrix::harrisF(DoubleMatrix& a, DoubleMatrix& b, DoubleMatrix& c, double coef) {
-	DoubleMatrix det = a * c - b * b;
-	DoubleMatrix trace = a + c;
-	return det - coef * trace * trace;
+template<typename T>
+Matrix<T> Matrix<T>::harrisF(Matrix<T>& a, Matrix<T>& b, Matrix<T>& c, double coef) {
+	return a * c - b * b - coef * (a + c) * (a + c);
 }
 
-DoubleMatrix DoubleMatrix::harrisE(DoubleMatrix& a, DoubleMatrix& b, DoubleMatrix& c) {
-	DoubleMatrix bx = a + c;
-	DoubleMatrix cx = a * c - b * b;
-	DoubleMatrix d = bx * bx - 4 * cx;
-	DoubleMatrix result(a.width, b.height);
+template<typename T>
+Matrix<T> Matrix<T>::harrisE(Matrix<T>& a, Matrix<T>& b, Matrix<T>& c) {
+	Matrix<T> bx = a + c;
+	Matrix<T> d = bx * bx - 4 * (a * c - b * b);
+	Matrix<T> result(a.width, b.height);
 	for (int i = 0; i < a.matrix.size(); i++) {
-		double l1 = (bx[i] + sqrt(d[i])) / 2;
-		double l2 = (bx[i] - sqrt(d[i])) / 2;
+		T l1 = (bx[i] + std::sqrt(d[i])) / 2;
+		T l2 = (bx[i] - std::sqrt(d[i])) / 2;
 		result[i] = std::min(l1, l2);
 	}
 
 	return result;
-}
\ No newline at end of file
+}
+
+template Matrix<double> Matrix<double>::operatorMoravec(int windowSize) const;
+template Matrix<double> Matrix<double>::operatorMoravecDirect(int windowSize) const;
+template Matrix<double> Matrix<double>::operatorHarris(int windowSize) const;
+template Matrix<float> Matrix<float>::operatorMoravec(int windowSize) const;
+template Matrix<float> Matrix<float>::operatorMoravecDirect(int windowSize) const;
+template Matrix<float> Matrix<float>::operatorHarris(int windowSize) const;
@@ -1,6 +1,7 @@
 #include <QtCore/qdebug.h>
 #include <QtCore/qmath.h>
 #include "Descriptor.h"
+#include "SimdKernels.h"
 
 void Descriptor::set(int h, int b, double val)
 {
@@ -9,8 +10,7 @@ void Descriptor::set(int h, int b, double val)
 
 double Descriptor::length() const
 {
-	DoubleMatrix sqr = (values * values);
-	return std::sqrt(sqr.sum());
+	return std::sqrt((values * values).sum());
 }
 
 void Descriptor::normalize()
@@ -28,19 +28,51 @@ void Descriptor::truncate(double max)
 	}
 }
 
-double Descriptor::distance(Descriptor a, Descriptor b, DistanceType t)
+double Descriptor::distance(const Descriptor& a, const Descriptor& b, DistanceType t)
+{
+	return distance(a.data(), b.data(), a.getSize(), t);
+}
+
+double Descriptor::distance(const double* a, const double* b, int n, DistanceType t)
+{
+	if (t == DistanceType::L2) {
+		return std::sqrt(SimdKernels::squaredDistance(a, b, n));
+	}
+	else if (t == DistanceType::L1) {
+		return SimdKernels::absDistance(a, b, n);
+	}
+	else if (t == DistanceType::SSD) {
+		return SimdKernels::squaredDistance(a, b, n);
+	}
+
+	return -1;
+}
+
+double Descriptor::distance(const float* a, const float* b, int n, DistanceType t)
+{
+	if (t == DistanceType::L2) {
+		return std::sqrt(SimdKernels::squaredDistance(a, b, n));
+	}
+	else if (t == DistanceType::L1) {
+		return SimdKernels::absDistance(a, b, n);
+	}
+	else if (t == DistanceType::SSD) {
+		return SimdKernels::squaredDistance(a, b, n);
+	}
+
+	return -1;
+}
+
+double Descriptor::distance(const uint8_t* a, const uint8_t* b, int n, DistanceType t)
 {
-	DoubleMatrix diff = a.values - b.values;
 	if (t == DistanceType::L2) {
-		DoubleMatrix square = diff * diff;
-		return std::sqrt(square.sum());
+		return std::sqrt(static_cast<double>(SimdKernels::squaredDistance(a, b, n)));
 	}
 	else if (t == DistanceType::L1) {
-		return diff.abs().sum();
+		return static_cast<double>(SimdKernels::absDistance(a, b, n));
 	}
 	else if (t == DistanceType::SSD) {
-		DoubleMatrix square = diff * diff;
-		return square.sum();
+		return static_cast<double>(SimdKernels::squaredDistance(a, b, n));
 	}
 
 	return -1;
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include "DoubleMatrix.h"
 #include "KeyPoint.h"
 class Descriptor
@@ -30,6 +31,8 @@ public:
 	Descriptor(const DoubleMatrix& m): values(m), gridSize(0), cellSize(0), cellCount(0) {}
 	Descriptor(const Descriptor& other): values(other.values), gridSize(other.gridSize), cellSize(other.cellSize), cellCount(other.cellCount) {}
 	Descriptor(Descriptor&& other) = default;
+	Descriptor& operator=(const Descriptor& other) = default;
+	Descriptor& operator=(Descriptor&& other) = default;
 	
 	int getHistogramCount() const { return values.getHeight(); }
 	int getBinCount() const { return values.getWidth(); }
@@ -39,10 +42,12 @@ public:
 	int getCellCount() const { return cellCount; }
 	
 	double& operator[](int i) { return values[i]; }
+	double operator[](int i) const { return values.at(i); }
 
 	double& at(int histogram, int bin) { return values[histogram * getBinCount() + bin]; }
 	const double& at(int histogram, int bin) const { return values.at(histogram, bin); }
 	DoubleMatrix& vals() { return values; }
+	const double* data() const { return values.data(); }
 
 	void set(int h, int b, double val);
 	double length() const;
@@ -50,6 +55,10 @@ public:
 	// Обрезать большие значения до максимума
 	void truncate(double max);
 	
-	static double distance(Descriptor a, Descriptor b, DistanceType t = DistanceType::Default);
+	static double distance(const Descriptor& a, const Descriptor& b, DistanceType t = DistanceType::Default);
+	// Расстояние между векторами длины n, записанными подряд
+	static double distance(const double* a, const double* b, int n, DistanceType t = DistanceType::Default);
+	static double distance(const float* a, const float* b, int n, DistanceType t = DistanceType::Default);
+	static double distance(const uint8_t* a, const uint8_t* b, int n, DistanceType t = DistanceType::Default);
 };
 
@@ -1,6 +1,10 @@
 #include <QtCore/qmath.h>
 #include <QtCore/qdebug.h>
+#include <algorithm>
+#include <limits>
 #include "DescriptorExtractor.h"
+#include "ThreadPool.h"
+#include "GradientPyramid.h"
 
 std::pair<int, int> DescriptorExtractor::getBinsIndexies(double phi, double binSize, int binCount)
 {
@@ -63,13 +67,44 @@ std::vector<std::pair<int, double>> DescriptorExtractor::getHistogramVals(Descri
 	return resultHistVals;
 }
 
+const DoubleMatrix& DescriptorExtractor::getGaussian(GaussianTable& table, int size, double sigma)
+{
+	auto found = table.find({ size, sigma });
+	if (found == table.end()) {
+		found = table.emplace(std::make_pair(size, sigma), DoubleMatrix::createGaussian(size, size, sigma)).first;
+	}
+	return found->second;
+}
+
+std::vector<DescriptorExtractor::HistogramWeights> DescriptorExtractor::createHistogramWeights(int gridSize, int cellCount)
+{
+	Descriptor layout(gridSize, cellCount, 1);
+	double radius = gridSize / 2.;
+	std::vector<HistogramWeights> weights(gridSize * gridSize);
+	for (int i = 0; i < gridSize; i++) {
+		for (int j = 0; j < gridSize; j++) {
+			HistogramWeights& cell = weights[i * gridSize + j];
+			cell.count = 0;
+			for (auto& val : getHistogramVals(layout, j - radius, i - radius)) {
+				cell.histogram[cell.count] = val.first;
+				cell.weight[cell.count] = val.second;
+				cell.count++;
+			}
+		}
+	}
+	return weights;
+}
+
 DescriptorExtractor::DescriptorExtractor(int gridSize, int cellCount, int histogramCount, int binCount):
-	extractorGridSize(gridSize), extractorCellCount(cellCount), extractorCellSize(gridSize/cellCount), extractorHistogramCount(histogramCount), extractorBinCount(binCount) {}
+	extractorGridSize(gridSize), extractorCellCount(cellCount), extractorCellSize(gridSize/cellCount), extractorHistogramCount(histogramCount), extractorBinCount(binCount),
+	captureGridPoints(false) {}
 
 DescriptorExtractor::DescriptorExtractor(int gridSize, int cellCount, int binCount) :
-	extractorGridSize(gridSize), extractorCellCount(cellCount), extractorCellSize(gridSize / cellCount), extractorHistogramCount(cellCount * cellCount), extractorBinCount(binCount) {}
+	extractorGridSize(gridSize), extractorCellCount(cellCount), extractorCellSize(gridSize / cellCount), extractorHistogramCount(cellCount * cellCount), extractorBinCount(binCount),
+	captureGridPoints(false) {}
 
-void DescriptorExtractor::fillDescriptor(Descriptor& descriptor, const DoubleMatrix& dirs, const DoubleMatrix& grad, KeyPoint& point)
+template<typename T>
+void DescriptorExtractor::fillDescriptor(Descriptor& descriptor, const Matrix<T>& dirs, const Matrix<T>& grad, KeyPoint& point)
 {
 	int radius = extractorGridSize / 2;
 	double binSize = 2 * M_PI / extractorBinCount;
@@ -93,24 +128,57 @@ void DescriptorExtractor::fillDescriptor(Descriptor& descriptor, const DoubleMat
 	}
 }
 
-std::vector<Descriptor> DescriptorExtractor::compute(const DoubleMatrix& img, std::vector<KeyPoint>& points)
+template<typename T>
+std::vector<Descriptor> DescriptorExtractor::compute(const Matrix<T>& img, std::vector<KeyPoint>& points)
 {
-	DoubleMatrix gradient = img.calcSobel();
-	DoubleMatrix gradientDirs = img.gradientDirection();
 	std::vector<Descriptor> descriptors;
-	gridPoints.clear();
-	for (int i = 0; i < points.size(); i++) {
-		descriptors.push_back(Descriptor(extractorGridSize, extractorCellCount, extractorBinCount));
-		fillDescriptorAngle(descriptors[i], gradientDirs, gradient, points[i]);
-		descriptors[i].normalize();
-		descriptors[i].truncate(0.2);
-		descriptors[i].normalize();
-	}
+	computeDescriptors(img, points,
+		[&](int count, int) { descriptors.resize(count); },
+		[&](int i, Descriptor& descriptor) { descriptors[i] = std::move(descriptor); });
+	return descriptors;
+}
 
+template<typename V, typename T>
+BasicDescriptorSet<V> DescriptorExtractor::computeSet(const Matrix<T>& img, std::vector<KeyPoint>& points)
+{
+	BasicDescriptorSet<V> descriptors;
+	computeDescriptors(img, points,
+		[&](int count, int dims) { descriptors = BasicDescriptorSet<V>(count, dims); },
+		[&](int i, Descriptor& descriptor) { descriptors.setRow(i, descriptor); });
 	return descriptors;
 }
 
-void DescriptorExtractor::fillDescriptorAngle(Descriptor& descriptor, const DoubleMatrix& dirs, const DoubleMatrix& grad, KeyPoint& point)
+template<typename T>
+void DescriptorExtractor::computeDescriptors(const Matrix<T>& img, std::vector<KeyPoint>& points,
+	const std::function<void(int, int)>& prepare, const std::function<void(int, Descriptor&)>& store)
+{
+	Matrix<T> gradient, gradientDirs;
+	img.gradient(gradient, gradientDirs);
+	int pointCount = static_cast<int>(points.size());
+	prepare(pointCount, extractorCellCount * extractorCellCount * extractorBinCount);
+	// Точки границ сеток собираются отдельно для каждой точки и объединяются в исходном порядке
+	std::vector<std::vector<KeyPoint>> pointGrids(captureGridPoints ? pointCount : 0);
+	DoubleMatrix gauss = DoubleMatrix::createGaussian(extractorGridSize + 1, extractorGridSize + 1, extractorGridSize / 6.);
+	ThreadPool::global().parallelFor(0, pointCount, 1, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			Descriptor descriptor(extractorGridSize, extractorCellCount, extractorBinCount);
+			fillDescriptorAngle(descriptor, gradientDirs, gradient, points[i], gauss, captureGridPoints ? &pointGrids[i] : nullptr);
+			descriptor.normalize();
+			descriptor.truncate(0.2);
+			descriptor.normalize();
+			store(i, descriptor);
+		}
+	});
+
+	gridPoints.clear();
+	for (const std::vector<KeyPoint>& grid : pointGrids) {
+		gridPoints.insert(gridPoints.end(), grid.begin(), grid.end());
+	}
+}
+
+template<typename T>
+void DescriptorExtractor::fillDescriptorAngle(Descriptor& descriptor, const Matrix<T>& dirs, const Matrix<T>& grad, KeyPoint& point,
+	const DoubleMatrix& gauss, std::vector<KeyPoint>* gridOut)
 {
 	int gridSize = descriptor.getGridSize();
 	int cellSize = descriptor.getCellSize();
@@ -119,17 +187,18 @@ void DescriptorExtractor::fillDescriptorAngle(Descriptor& descriptor, const Doub
 	int radius = gridSize / 2;
 	double binSize = 2 * M_PI / binCount;
 	double twoPi = 2 * M_PI;
-	DoubleMatrix gauss = DoubleMatrix::createGaussian(gridSize + 1, gridSize + 1, gridSize / 6.);
+	double cosAngle = cos(point.angle);
+	double sinAngle = sin(point.angle);
 
 	for (int y = -radius; y < radius; y++) {
 		for (int x = -radius; x < radius; x++) {
-			double x1 = x * cos(point.angle) - y * sin(point.angle);
-			double y1 = y * cos(point.angle) + x * sin(point.angle);
+			double x1 = x * cosAngle - y * sinAngle;
+			double y1 = y * cosAngle + x * sinAngle;
 			x1 = std::round(x1);
 			y1 = std::round(y1);
 
-			if (y == -radius || x == -radius || y == radius - 1 || x == radius - 1) {
-				gridPoints.push_back(KeyPoint(point.x + x1, point.y + y1, 0, point.angle));
+			if (gridOut && (y == -radius || x == -radius || y == radius - 1 || x == radius - 1)) {
+				gridOut->push_back(KeyPoint(point.x + x1, point.y + y1, 0, point.angle));
 			}
 			
 			double phi = dirs.get(point.y + y1, point.x + x1);
@@ -151,22 +220,22 @@ void DescriptorExtractor::fillDescriptorAngle(Descriptor& descriptor, const Doub
 	}
 }
 
-void DescriptorExtractor::fillDescriptorScale(Descriptor& descriptor, const DoubleMatrix& dirs, const DoubleMatrix& grad, KeyPoint& point)
+template<typename T>
+void DescriptorExtractor::fillDescriptorScale(Descriptor& descriptor, const Matrix<T>& dirs, const Matrix<T>& grad, KeyPoint& point,
+	const DoubleMatrix& gauss, const std::vector<HistogramWeights>& histogramWeights)
 {
 	int gridSize = descriptor.getGridSize();
-	double cellSize = descriptor.getCellSize();
-	int cellCount = descriptor.getCellCount();
 	int binCount = descriptor.getBinCount();
 	double radius = gridSize / 2.;
 	double binSize = 2 * M_PI / binCount;
 	double twoPi = 2 * M_PI;
-	int gaussSize = gridSize % 2 == 0 ? gridSize + 1 : gridSize;
-	DoubleMatrix gauss = DoubleMatrix::createGaussian(gaussSize, gaussSize, 0.5 * gridSize);
+	double cosAngle = cos(point.angle);
+	double sinAngle = sin(point.angle);
 
 	for (double y = -radius; y < radius; y++) {
 		for (double x = -radius; x < radius; x++) {
-			double x1 = x * cos(point.angle) - y * sin(point.angle);
-			double y1 = y * cos(point.angle) + x * sin(point.angle);
+			double x1 = x * cosAngle - y * sinAngle;
+			double y1 = y * cosAngle + x * sinAngle;
 			x1 = std::round(x1);
 			y1 = std::round(y1);
 
@@ -181,12 +250,12 @@ void DescriptorExtractor::fillDescriptorScale(Descriptor& descriptor, const Doub
 			double distToBin2Center = binSize - distToBin1Center;
 			int i = std::floor(y + radius);
 			int j = std::floor(x + radius);
-			std::vector<std::pair<int, double>> resultHistVals = getHistogramVals(descriptor, x, y);
+			const HistogramWeights& cell = histogramWeights[i * gridSize + j];
 
 			double gradVal = grad.get(point.y + y1, point.x + x1);
-			for (auto& val : resultHistVals) {
-				int curHistogram = val.first;
-				double w = val.second;
+			for (int k = 0; k < cell.count; k++) {
+				int curHistogram = cell.histogram[k];
+				double w = cell.weight[k];
 				descriptor.at(curHistogram, binsIndex.first) += gradVal * (1 - distToBin1Center / binSize) * w * gauss.at(i, j);
 				descriptor.at(curHistogram, binsIndex.second) += gradVal * (1 - distToBin2Center / binSize) * w * gauss.at(i, j);
 			}
@@ -194,14 +263,13 @@ void DescriptorExtractor::fillDescriptorScale(Descriptor& descriptor, const Doub
 	}
 }
 
-void DescriptorExtractor::calcOrientationHistogram(Descriptor& descriptor, const DoubleMatrix& dirs, const DoubleMatrix& grad, KeyPoint& point)
+template<typename T>
+void DescriptorExtractor::calcOrientationHistogram(Descriptor& descriptor, const Matrix<T>& dirs, const Matrix<T>& grad, KeyPoint& point, const DoubleMatrix& gauss)
 {
 	int bins = descriptor.getBinCount();
 	int gridSize = descriptor.getGridSize();
 	double radius = gridSize / 2.;
 	double binSize = 2 * M_PI / bins;
-	int gaussSize = gridSize % 2 == 0 ? gridSize + 1 : gridSize;
-	DoubleMatrix gauss = DoubleMatrix::createGaussian(gaussSize, gaussSize, 1.5 * (point.sigma == 0.0 ? 1 : point.sigma));
 
 	for (double i = -radius; i < radius; i++) {
 		for (double j = -radius; j < radius; j++) {
@@ -251,117 +319,297 @@ void DescriptorExtractor::addPointWithPeaks(KeyPoint& point, Descriptor& descrip
 	}
 }
 
-std::vector<KeyPoint> DescriptorExtractor::calcPointsOrientation(const DoubleMatrix& img, std::vector<KeyPoint>& points, int bins)
+template<typename T>
+std::vector<KeyPoint> DescriptorExtractor::calcPointsOrientation(const Matrix<T>& img, std::vector<KeyPoint>& points, int bins)
 {
-	DoubleMatrix gradient = img.calcSobel();
-	DoubleMatrix gradientDirs = img.gradientDirection();
-	std::vector<Descriptor> descriptors;
+	Matrix<T> gradient, gradientDirs;
+	img.gradient(gradient, gradientDirs);
 	int gridSize = 16;
-	int radius = gridSize / 2;
+	int pointCount = static_cast<int>(points.size());
+
+	// Ядра Гаусса зависят от масштаба точки и выбираются до параллельного цикла
+	GaussianTable gaussians;
+	std::vector<const DoubleMatrix*> pointGaussians(pointCount);
+	for (int ip = 0; ip < pointCount; ip++) {
+		pointGaussians[ip] = &getGaussian(gaussians, getGaussianSize(gridSize), 1.5 * (points[ip].sigma == 0.0 ? 1 : points[ip].sigma));
+	}
+
+	// Одна или две точки с ориентацией для каждой исходной точки
+	std::vector<std::vector<KeyPoint>> oriented(pointCount);
+	ThreadPool::global().parallelFor(0, pointCount, 1, [&](int begin, int end) {
+		for (int ip = begin; ip < end; ip++) {
+			Descriptor histogram(gridSize, 1, bins);
+			calcOrientationHistogram(histogram, gradientDirs, gradient, points[ip], *pointGaussians[ip]);
+			addPointWithPeaks(points[ip], histogram, oriented[ip], bins);
+		}
+	});
 
 	std::vector<KeyPoint> result;
-	for (int ip = 0; ip < points.size(); ip++) {
-		descriptors.push_back(Descriptor(gridSize, 1, bins));
-		calcOrientationHistogram(descriptors[ip], gradientDirs, gradient, points[ip]);
-		addPointWithPeaks(points[ip], descriptors[ip], result, bins);
+	for (const std::vector<KeyPoint>& pointOrientations : oriented) {
+		result.insert(result.end(), pointOrientations.begin(), pointOrientations.end());
 	}
 
 	return result;
 }
 
-std::pair<std::vector<KeyPoint>, std::vector<Descriptor>>  DescriptorExtractor::computeScale(Pyramid& pyramid, std::vector<KeyPoint>& points)
+template<typename T>
+std::pair<std::vector<KeyPoint>, std::vector<Descriptor>>  DescriptorExtractor::computeScale(BasicPyramid<T>& pyramid, std::vector<KeyPoint>& points)
 {
-	std::vector<KeyPoint> orientPoints;
 	std::vector<Descriptor> descriptors;
-	std::vector<KeyPoint> resultPoints;
+	// Градиенты вычисляются только для изображений, на которые попадают точки
+	BasicGradientPyramid<T> gradients(pyramid);
+	std::vector<KeyPoint> resultPoints = computeScaleDescriptors(pyramid, gradients, points,
+		[&](int count, int) { descriptors.resize(count); },
+		[&](int i, Descriptor& descriptor) { descriptors[i] = std::move(descriptor); });
+	return std::make_pair(resultPoints, descriptors);
+}
+
+template<typename V, typename T>
+std::pair<std::vector<KeyPoint>, BasicDescriptorSet<V>> DescriptorExtractor::computeScaleSet(BasicPyramid<T>& pyramid, std::vector<KeyPoint>& points)
+{
+	BasicGradientPyramid<T> gradients(pyramid);
+	return computeScaleSet<V>(pyramid, gradients, points);
+}
 
+template<typename V, typename T>
+std::pair<std::vector<KeyPoint>, BasicDescriptorSet<V>> DescriptorExtractor::computeScaleSet(BasicPyramid<T>& pyramid, BasicGradientPyramid<T>& gradients, std::vector<KeyPoint>& points)
+{
+	BasicDescriptorSet<V> descriptors;
+	std::vector<KeyPoint> resultPoints = computeScaleDescriptors(pyramid, gradients, points,
+		[&](int count, int dims) { descriptors = BasicDescriptorSet<V>(count, dims); },
+		[&](int i, Descriptor& descriptor) { descriptors.setRow(i, descriptor); });
+	return std::make_pair(std::move(resultPoints), std::move(descriptors));
+}
+
+template<typename T>
+std::vector<KeyPoint> DescriptorExtractor::computeScaleDescriptors(BasicPyramid<T>& pyramid, BasicGradientPyramid<T>& gradients, std::vector<KeyPoint>& points,
+	const std::function<void(int, int)>& prepare, const std::function<void(int, Descriptor&)>& store)
+{
 	int cellCount = 4;
 	int binCount = 8;
 	int octaveCount = pyramid.getOctaveCount();
 	int levelCount = pyramid.getLevelCount();
 	int overlap = pyramid.getOverlapCount();
-	Pyramid gradients = pyramid.createGradientPyramid();
-	Pyramid directions = pyramid.createDirectionsPyramid();
+
+	// Пары (октава, индекс точки) в порядке последовательного обхода: точки обрабатываются параллельно,
+	// а результаты записываются в заранее выделенные ячейки, поэтому порядок не зависит от числа потоков
+	auto collectTasks = [&](const std::vector<KeyPoint>& source) {
+		std::vector<std::pair<int, int>> tasks;
+		for (int iOctave = 0; iOctave < octaveCount; iOctave++) {
+			double firstSigma = pyramid.get(iOctave, 0).sigmaEffective;
+			double lastSigma = pyramid.get(iOctave, levelCount - overlap - 1).sigmaEffective;
+			for (int i = 0; i < static_cast<int>(source.size()); i++) {
+				if (firstSigma < source[i].sigma && source[i].sigma <= lastSigma) tasks.push_back({ iOctave, i });
+			}
+		}
+		return tasks;
+	};
+	auto getGridSize = [&](int iOctave, const KeyPoint& point) {
+		return static_cast<int>(std::round(16 * point.sigma / pyramid.get(iOctave, 0).sigmaEffective));
+	};
+	// Ядра Гаусса и веса гистограмм выбираются для всех точек до параллельных циклов: размеры сеток и масштабы
+	// точек принимают немного значений, таблицы живут до конца вызова, в циклах используются только ссылки
+	GaussianTable gaussians;
+	std::map<int, std::vector<HistogramWeights>> weightTables;
 
 	int bins = 36; 
 	// Определение ориентации точки
-	for (int iOctave = 0; iOctave < octaveCount; iOctave++) {
-		double firstSigma = pyramid.get(iOctave, 0).sigmaEffective;
-		double lastSigma = pyramid.get(iOctave, levelCount - overlap - 1).sigmaEffective;
-		for (KeyPoint& point : points) {
-			if (firstSigma < point.sigma && point.sigma <= lastSigma) {
-				int gridSize = std::round(16 * point.sigma / firstSigma);
-				Descriptor d(gridSize, 1, bins);
-				PyramidRow& dirs = directions.getBySigma(iOctave, point.sigma);
-				PyramidRow& grads = gradients.getBySigma(iOctave, point.sigma);
-				calcOrientationHistogram(d, dirs.image, grads.image, point);
-				addPointWithPeaks(point, d, orientPoints, bins);
-			}
+	std::vector<std::pair<int, int>> orientTasks = collectTasks(points);
+	std::vector<const DoubleMatrix*> orientGaussians(orientTasks.size());
+	for (size_t t = 0; t < orientTasks.size(); t++) {
+		const KeyPoint& point = points[orientTasks[t].second];
+		int gaussSize = getGaussianSize(getGridSize(orientTasks[t].first, point));
+		orientGaussians[t] = &getGaussian(gaussians, gaussSize, 1.5 * (point.sigma == 0.0 ? 1 : point.sigma));
+	}
+	std::vector<std::vector<KeyPoint>> oriented(orientTasks.size());
+	ThreadPool::global().parallelFor(0, static_cast<int>(orientTasks.size()), 1, [&](int begin, int end) {
+		for (int t = begin; t < end; t++) {
+			int iOctave = orientTasks[t].first;
+			KeyPoint& point = points[orientTasks[t].second];
+			Descriptor d(getGridSize(iOctave, point), 1, bins);
+			int level = gradients.getIndexBySigma(iOctave, point.sigma);
+			calcOrientationHistogram(d, gradients.getDirection(level), gradients.getMagnitude(level), point, *orientGaussians[t]);
+			addPointWithPeaks(point, d, oriented[t], bins);
 		}
+	});
+	std::vector<KeyPoint> orientPoints;
+	for (const std::vector<KeyPoint>& pointOrientations : oriented) {
+		orientPoints.insert(orientPoints.end(), pointOrientations.begin(), pointOrientations.end());
 	}
 
 	// Заполнение дескрипторов
-	for (int iOctave = 0; iOctave < octaveCount; iOctave++) {
-		double firstSigma = pyramid.get(iOctave, 0).sigmaEffective;
-		double lastSigma = pyramid.get(iOctave, levelCount - overlap - 1).sigmaEffective;
-		for (KeyPoint& point : orientPoints) {
-			if (firstSigma < point.sigma && point.sigma <= lastSigma) {
-				int gridSize = std::round(16 * point.sigma / firstSigma);
-				Descriptor d(gridSize, cellCount, binCount);
-				PyramidRow& dirs = directions.getBySigma(iOctave, point.sigma);
-				PyramidRow& grads = gradients.getBySigma(iOctave, point.sigma);
-				fillDescriptorScale(d, dirs.image, grads.image, point);
-				d.normalize();
-				d.truncate(0.2);
-				d.normalize();
-				descriptors.push_back(d);
-				// Местоположение точки на изначальном изображении
-				KeyPoint scalePoint(point);
-				int scale = std::pow(2, iOctave);
-				scalePoint.x *= scale;
-				scalePoint.y *= scale;
-				resultPoints.push_back(scalePoint);
-			}
+	std::vector<std::pair<int, int>> descriptorTasks = collectTasks(orientPoints);
+	prepare(static_cast<int>(descriptorTasks.size()), cellCount * cellCount * binCount);
+	std::vector<KeyPoint> resultPoints(descriptorTasks.size());
+	std::vector<const DoubleMatrix*> descriptorGaussians(descriptorTasks.size());
+	std::vector<const std::vector<HistogramWeights>*> descriptorWeights(descriptorTasks.size());
+	for (size_t t = 0; t < descriptorTasks.size(); t++) {
+		int gridSize = getGridSize(descriptorTasks[t].first, orientPoints[descriptorTasks[t].second]);
+		descriptorGaussians[t] = &getGaussian(gaussians, getGaussianSize(gridSize), 0.5 * gridSize);
+		auto found = weightTables.find(gridSize);
+		if (found == weightTables.end()) {
+			found = weightTables.emplace(gridSize, createHistogramWeights(gridSize, cellCount)).first;
 		}
+		descriptorWeights[t] = &found->second;
 	}
+	ThreadPool::global().parallelFor(0, static_cast<int>(descriptorTasks.size()), 1, [&](int begin, int end) {
+		for (int t = begin; t < end; t++) {
+			int iOctave = descriptorTasks[t].first;
+			KeyPoint& point = orientPoints[descriptorTasks[t].second];
+			Descriptor d(getGridSize(iOctave, point), cellCount, binCount);
+			int level = gradients.getIndexBySigma(iOctave, point.sigma);
+			fillDescriptorScale(d, gradients.getDirection(level), gradients.getMagnitude(level), point, *descriptorGaussians[t], *descriptorWeights[t]);
+			d.normalize();
+			d.truncate(0.2);
+			d.normalize();
+			store(t, d);
+			// Местоположение точки на изначальном изображении
+			KeyPoint scalePoint(point);
+			int scale = std::pow(2, iOctave);
+			scalePoint.x *= scale;
+			scalePoint.y *= scale;
+			resultPoints[t] = scalePoint;
+		}
+	});
 	qDebug() << "Proccessed points:" << resultPoints.size();
+	qDebug() << "Gradient levels computed:" << gradients.getMaterializedLevels().size() << "of" << gradients.getLevelCount();
 
-	return std::make_pair(resultPoints, descriptors);
+	return resultPoints;
 }
 
-std::vector<std::pair<int, int>> DescriptorExtractor::findMatches(std::vector<Descriptor> aDescriptors, std::vector<Descriptor> bDescriptors, double threshold)
+namespace
 {
-	// Вектор расстояний дескрипторов изображения A до дескрипторов B и соответствующих индексов B
-	std::vector<std::vector<std::pair<double, int>>> distances(aDescriptors.size());
-	for (auto& row : distances) {
-		row.resize(bDescriptors.size());
+	// Число дескрипторов A, для которых блок дескрипторов B перебирается, пока он лежит в кэше
+	const int MatchQueryBlock = 32;
+	// Число дескрипторов B в одном блоке перебора
+	const int MatchTargetBlock = 256;
+
+	// Дескрипторы, записанные подряд в один буфер
+	std::vector<double> packDescriptors(const std::vector<Descriptor>& descriptors, int dims)
+	{
+		std::vector<double> packed(descriptors.size() * dims);
+		for (size_t i = 0; i < descriptors.size(); i++) {
+			std::copy(descriptors[i].data(), descriptors[i].data() + dims, packed.begin() + i * dims);
+		}
+		return packed;
 	}
+}
 
-	for (int i = 0; i < aDescriptors.size(); i++) {
-		for (int j = 0; j < bDescriptors.size(); j++) {
-			distances[i][j].first = Descriptor::distance(aDescriptors[i], bDescriptors[j]);
-			distances[i][j].second = j;
-		}
+std::vector<std::pair<int, int>> DescriptorExtractor::findMatches(const std::vector<Descriptor>& aDescriptors, const std::vector<Descriptor>& bDescriptors,
+	double threshold, Descriptor::DistanceType t)
+{
+	int aCount = static_cast<int>(aDescriptors.size());
+	int bCount = static_cast<int>(bDescriptors.size());
+	int dims = aCount > 0 ? aDescriptors[0].getSize() : 0;
+	auto hasOtherSize = [dims](const Descriptor& d) { return d.getSize() != dims; };
+	if (std::any_of(aDescriptors.begin(), aDescriptors.end(), hasOtherSize) || std::any_of(bDescriptors.begin(), bDescriptors.end(), hasOtherSize)) {
+		qDebug() << "Descriptor sizes differ, matching skipped";
+		return std::vector<std::pair<int, int>>();
 	}
+	std::vector<double> aData = packDescriptors(aDescriptors, dims);
+	std::vector<double> bData = packDescriptors(bDescriptors, dims);
+	return findMatchesPacked(aData.data(), aCount, bData.data(), bCount, dims, threshold, t);
+}
 
-	// Сортировка по минимальному расстоянию
-	for (auto& vec : distances) {
-		std::sort(begin(vec), end(vec),
-			[&](std::pair<double, int>& a, std::pair<double, int>& b)
-			{ return a.first < b.first; });
+template<typename T>
+std::vector<std::pair<int, int>> DescriptorExtractor::findMatches(const BasicDescriptorSet<T>& aDescriptors, const BasicDescriptorSet<T>& bDescriptors,
+	double threshold, Descriptor::DistanceType t)
+{
+	if (aDescriptors.getCount() > 0 && bDescriptors.getCount() > 0 && aDescriptors.getDims() != bDescriptors.getDims()) {
+		qDebug() << "Descriptor sizes differ:" << aDescriptors.getDims() << bDescriptors.getDims() << ", matching skipped";
+		return std::vector<std::pair<int, int>>();
 	}
+	return findMatchesPacked(aDescriptors.data(), aDescriptors.getCount(), bDescriptors.data(), bDescriptors.getCount(),
+		aDescriptors.getDims(), threshold, t);
+}
 
+template<typename T>
+std::vector<std::pair<int, int>> DescriptorExtractor::findMatchesPacked(const T* aData, int aCount, const T* bData, int bCount, int dims,
+	double threshold, Descriptor::DistanceType t)
+{
 	std::vector<std::pair<int, int>> result;
-	// Определение совпадений с помощью NNDR
-	for (int i = 0; i < aDescriptors.size(); i++) {
-		double minDist = distances[i][0].first;
-		double secondMinDist = distances[i][1].first;
-		if (minDist / secondMinDist < threshold) {
-			result.push_back(std::make_pair(i, distances[i][0].second));
+	if (aCount == 0 || bCount < 2) {
+		qDebug() << "Matches found: " << result.size();
+		return result;
+	}
+
+	// Для L2 соседи ищутся по квадрату расстояния, корень берется только для двух найденных
+	Descriptor::DistanceType searchType = t == Descriptor::DistanceType::L2 ? Descriptor::DistanceType::SSD : t;
+
+	// Индекс ближайшего дескриптора B для каждого дескриптора A или -1
+	std::vector<int> matched(aCount, -1);
+	ThreadPool::global().parallelFor(0, aCount, MatchQueryBlock, [&](int queryBegin, int queryEnd) {
+		const double maxDistance = std::numeric_limits<double>::max();
+		// Два ближайших соседа для каждого запроса блока: расстояние и индекс
+		std::vector<std::pair<double, int>> first(MatchQueryBlock), second(MatchQueryBlock);
+		for (int blockBegin = queryBegin; blockBegin < queryEnd; blockBegin += MatchQueryBlock) {
+			int blockEnd = std::min(blockBegin + MatchQueryBlock, queryEnd);
+			std::fill(first.begin(), first.end(), std::make_pair(maxDistance, -1));
+			std::fill(second.begin(), second.end(), std::make_pair(maxDistance, -1));
+			for (int targetBegin = 0; targetBegin < bCount; targetBegin += MatchTargetBlock) {
+				int targetEnd = std::min(targetBegin + MatchTargetBlock, bCount);
+				for (int i = blockBegin; i < blockEnd; i++) {
+					const T* query = aData + static_cast<size_t>(i) * dims;
+					std::pair<double, int>& best = first[i - blockBegin];
+					std::pair<double, int>& nextBest = second[i - blockBegin];
+					for (int j = targetBegin; j < targetEnd; j++) {
+						double distance = Descriptor::distance(query, bData + static_cast<size_t>(j) * dims, dims, searchType);
+						if (distance < best.first) {
+							nextBest = best;
+							best = std::make_pair(distance, j);
+						}
+						else if (distance < nextBest.first) {
+							nextBest = std::make_pair(distance, j);
+						}
+					}
+				}
+			}
+
+			// Определение совпадений с помощью NNDR
+			for (int i = blockBegin; i < blockEnd; i++) {
+				double minDist = first[i - blockBegin].first;
+				double secondMinDist = second[i - blockBegin].first;
+				if (searchType != t) {
+					minDist = std::sqrt(minDist);
+					secondMinDist = std::sqrt(secondMinDist);
+				}
+				if (minDist / secondMinDist < threshold) {
+					matched[i] = first[i - blockBegin].second;
+				}
+			}
 		}
+	});
+
+	for (int i = 0; i < aCount; i++) {
+		if (matched[i] >= 0) result.push_back(std::make_pair(i, matched[i]));
 	}
 
 	qDebug() << "Matches found: " << result.size();
 
 	return result;
 }
+
+template std::vector<Descriptor> DescriptorExtractor::compute(const DoubleMatrix& img, std::vector<KeyPoint>& points);
+template std::vector<Descriptor> DescriptorExtractor::compute(const FloatMatrix& img, std::vector<KeyPoint>& points);
+template std::pair<std::vector<KeyPoint>, std::vector<Descriptor>> DescriptorExtractor::computeScale(Pyramid& pyramid, std::vector<KeyPoint>& points);
+template std::pair<std::vector<KeyPoint>, std::vector<Descriptor>> DescriptorExtractor::computeScale(FloatPyramid& pyramid, std::vector<KeyPoint>& points);
+template DescriptorSet DescriptorExtractor::computeSet(const DoubleMatrix& img, std::vector<KeyPoint>& points);
+template DescriptorSet DescriptorExtractor::computeSet(const FloatMatrix& img, std::vector<KeyPoint>& points);
+template ByteDescriptorSet DescriptorExtractor::computeSet(const DoubleMatrix& img, std::vector<KeyPoint>& points);
+template ByteDescriptorSet DescriptorExtractor::computeSet(const FloatMatrix& img, std::vector<KeyPoint>& points);
+template std::pair<std::vector<KeyPoint>, DescriptorSet> DescriptorExtractor::computeScaleSet(Pyramid& pyramid, std::vector<KeyPoint>& points);
+template std::pair<std::vector<KeyPoint>, DescriptorSet> DescriptorExtractor::computeScaleSet(FloatPyramid& pyramid, std::vector<KeyPoint>& points);
+template std::pair<std::vector<KeyPoint>, ByteDescriptorSet> DescriptorExtractor::computeScaleSet(Pyramid& pyramid, std::vector<KeyPoint>& points);
+template std::pair<std::vector<KeyPoint>, ByteDescriptorSet> DescriptorExtractor::computeScaleSet(FloatPyramid& pyramid, std::vector<KeyPoint>& points);
+template std::pair<std::vector<KeyPoint>, DescriptorSet> DescriptorExtractor::computeScaleSet(Pyramid& pyramid, GradientPyramid& gradients, std::vector<KeyPoint>& points);
+template std::pair<std::vector<KeyPoint>, DescriptorSet> DescriptorExtractor::computeScaleSet(FloatPyramid& pyramid, FloatGradientPyramid& gradients, std::vector<KeyPoint>& points);
+template std::pair<std::vector<KeyPoint>, ByteDescriptorSet> DescriptorExtractor::computeScaleSet(Pyramid& pyramid, GradientPyramid& gradients, std::vector<KeyPoint>& points);
+template std::pair<std::vector<KeyPoint>, ByteDescriptorSet> DescriptorExtractor::computeScaleSet(FloatPyramid& pyramid, FloatGradientPyramid& gradients, std::vector<KeyPoint>& points);
+template std::vector<KeyPoint> DescriptorExtractor::calcPointsOrientation(const DoubleMatrix& img, std::vector<KeyPoint>& points, int bins);
+template std::vector<KeyPoint> DescriptorExtractor::calcPointsOrientation(const FloatMatrix& img, std::vector<KeyPoint>& points, int bins);
+template std::vector<std::pair<int, int>> DescriptorExtractor::findMatches(const DescriptorSet& aDescriptors, const DescriptorSet& bDescriptors,
+	double threshold, Descriptor::DistanceType t);
+template std::vector<std::pair<int, int>> DescriptorExtractor::findMatches(const ByteDescriptorSet& aDescriptors, const ByteDescriptorSet& bDescriptors,
+	double threshold, Descriptor::DistanceType t);
+template std::vector<std::pair<int, int>> DescriptorExtractor::findMatches(const DoubleDescriptorSet& aDescriptors, const DoubleDescriptorSet& bDescriptors,
+	double threshold, Descriptor::DistanceType t);
@@ -1,9 +1,13 @@
 #pragma once
 #include <vector>
+#include <map>
+#include <functional>
 #include "DoubleMatrix.h"
 #include "KeyPoint.h"
 #include "Descriptor.h"
 #include "Pyramid.h"
+#include "GradientPyramid.h"
+#include "DescriptorSet.h"
 class DescriptorExtractor
 {
 private:
@@ -18,14 +22,27 @@ private:
 	// Число корзин в гистограмме
 	int extractorBinCount;
 
+	// Смежные гистограммы пикселя сетки и их веса (результат getHistogramVals без выделения памяти)
+	struct HistogramWeights
+	{
+		int count;
+		int histogram[4];
+		double weight[4];
+	};
 	// Заполнение одного дескриптора
-	void fillDescriptor(Descriptor& descriptor, const DoubleMatrix& dirs, const DoubleMatrix& grad, KeyPoint& point);
-	// Заполнение одного дескриптора с учетом угла точки
-	void fillDescriptorAngle(Descriptor& descriptor, const DoubleMatrix& dirs, const DoubleMatrix& grad, KeyPoint& point);
+	template<typename T>
+	void fillDescriptor(Descriptor& descriptor, const Matrix<T>& dirs, const Matrix<T>& grad, KeyPoint& point);
+	// Заполнение одного дескриптора с учетом угла точки, gridOut - точки границы сетки (если не nullptr)
+	template<typename T>
+	void fillDescriptorAngle(Descriptor& descriptor, const Matrix<T>& dirs, const Matrix<T>& grad, KeyPoint& point,
+		const DoubleMatrix& gauss, std::vector<KeyPoint>* gridOut);
 	// Заполнение одного дескриптора угол и масштаб
-	void fillDescriptorScale(Descriptor& descriptor, const DoubleMatrix& dirs, const DoubleMatrix& grad, KeyPoint& point);
+	template<typename T>
+	void fillDescriptorScale(Descriptor& descriptor, const Matrix<T>& dirs, const Matrix<T>& grad, KeyPoint& point,
+		const DoubleMatrix& gauss, const std::vector<HistogramWeights>& histogramWeights);
 	// Вычисленние гистограммы ориентации градиентов для точки
-	static void calcOrientationHistogram(Descriptor& descriptor, const DoubleMatrix& dirs, const DoubleMatrix& grad, KeyPoint& point);
+	template<typename T>
+	static void calcOrientationHistogram(Descriptor& descriptor, const Matrix<T>& dirs, const Matrix<T>& grad, KeyPoint& point, const DoubleMatrix& gauss);
 	// Добавляет одну или две точки с разной ориентацией в список на основе значения пиков гистограммы
 	static void addPointWithPeaks(KeyPoint& point, Descriptor& descriptor, std::vector<KeyPoint>& out, int bins);
 	// Возвращает индексы корзин для указанного угла
@@ -33,21 +50,66 @@ private:
 
 	static double dist(double x1, double y1, double x2, double y2) { return sqrt((x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1)); }
 	static std::vector<std::pair<int, double>> getHistogramVals(Descriptor& d, double x, double y);
+
+	// Ядра Гаусса size x size по парам (size, sigma) одного вызова вычисления дескрипторов
+	typedef std::map<std::pair<int, double>, DoubleMatrix> GaussianTable;
+	// Ядро из таблицы, создается при первом обращении. Таблица заполняется до параллельного цикла,
+	// в цикле используются только полученные ссылки (элементы std::map не перемещаются при вставке)
+	static const DoubleMatrix& getGaussian(GaussianTable& table, int size, double sigma);
+	// Нечетный размер ядра Гаусса для сетки gridSize x gridSize
+	static int getGaussianSize(int gridSize) { return gridSize % 2 == 0 ? gridSize + 1 : gridSize; }
+	// Веса гистограмм для всех пикселей сетки gridSize x gridSize из cellCount x cellCount ячеек (по строкам)
+	static std::vector<HistogramWeights> createHistogramWeights(int gridSize, int cellCount);
+	// Общая часть compute и computeSet: prepare(count, dims) вызывается до вычисления,
+	// store(i, descriptor) - для каждого готового дескриптора (из разных потоков, i различны)
+	template<typename T>
+	void computeDescriptors(const Matrix<T>& img, std::vector<KeyPoint>& points,
+		const std::function<void(int, int)>& prepare, const std::function<void(int, Descriptor&)>& store);
+	// Общая часть computeScale и computeScaleSet (как computeDescriptors), возвращает точки дескрипторов
+	template<typename T>
+	std::vector<KeyPoint> computeScaleDescriptors(BasicPyramid<T>& pyramid, BasicGradientPyramid<T>& gradients, std::vector<KeyPoint>& points,
+		const std::function<void(int, int)>& prepare, const std::function<void(int, Descriptor&)>& store);
+	// Полный перебор для дескрипторов, записанных подряд (общая часть findMatches)
+	template<typename T>
+	static std::vector<std::pair<int, int>> findMatchesPacked(const T* aData, int aCount, const T* bData, int bCount, int dims,
+		double threshold, Descriptor::DistanceType t);
+	// Точки границ сеток дескрипторов последнего вызова compute (для отладки)
 	std::vector<KeyPoint> gridPoints;
+	bool captureGridPoints;
 public:
 	// Инициалзиция из размера сетки, числа ячеек в сетке, числа гистограмм и числа корзин в одной гистограмме
 	DescriptorExtractor(int gridSize, int cellCount, int histogramCount, int binCount);
 	// Инициалзиция из размера сетки, числа ячеек в сетке, числа корзин в одной гистограмме (число гистограмм равно числу ячеек в квадрате)
 	DescriptorExtractor(int gridSize, int cellCount, int binCount);
 	// Вычисление дескрипторов изображения на основе заданных точек
-	std::vector<Descriptor> compute(const DoubleMatrix& img, std::vector<KeyPoint>& points);
+	template<typename T>
+	std::vector<Descriptor> compute(const Matrix<T>& img, std::vector<KeyPoint>& points);
 	// Вычисление дескрипторов изображения на основе заданных точек
-	std::pair<std::vector<KeyPoint>, std::vector<Descriptor>> computeScale(Pyramid& pyramid, std::vector<KeyPoint>& points);
+	template<typename T>
+	std::pair<std::vector<KeyPoint>, std::vector<Descriptor>> computeScale(BasicPyramid<T>& pyramid, std::vector<KeyPoint>& points);
+	// То же, что compute и computeScale, но каждый дескриптор сразу записывается в набор с элементами типа V
+	// (для uint8 - квантуется), значения double не хранятся
+	template<typename V, typename T>
+	BasicDescriptorSet<V> computeSet(const Matrix<T>& img, std::vector<KeyPoint>& points);
+	template<typename V, typename T>
+	std::pair<std::vector<KeyPoint>, BasicDescriptorSet<V>> computeScaleSet(BasicPyramid<T>& pyramid, std::vector<KeyPoint>& points);
+	// То же с внешней пирамидой градиентов pyramid (буферы градиентов сохраняются между вызовами, см. BasicGradientPyramid::reset)
+	template<typename V, typename T>
+	std::pair<std::vector<KeyPoint>, BasicDescriptorSet<V>> computeScaleSet(BasicPyramid<T>& pyramid, BasicGradientPyramid<T>& gradients, std::vector<KeyPoint>& points);
 	// Определение угла интересной точки
-	static std::vector<KeyPoint> calcPointsOrientation(const DoubleMatrix& img, std::vector<KeyPoint>& points, int bins = 36);
-	// Поиск ближайших дескрипторов
-	static std::vector<std::pair<int, int>> findMatches(std::vector<Descriptor> aDescriptors, std::vector<Descriptor> bDescriptors, double threshold = 0.66);
+	template<typename T>
+	static std::vector<KeyPoint> calcPointsOrientation(const Matrix<T>& img, std::vector<KeyPoint>& points, int bins = 36);
+	// Поиск ближайших дескрипторов полным перебором: для каждого дескриптора A два ближайших из B, отбор по NNDR.
+	// Дескрипторы разной длины (другие параметры сетки) не сопоставляются: результат пуст
+	static std::vector<std::pair<int, int>> findMatches(const std::vector<Descriptor>& aDescriptors, const std::vector<Descriptor>& bDescriptors,
+		double threshold = 0.66, Descriptor::DistanceType t = Descriptor::DistanceType::Default);
+	// То же для наборов дескрипторов (без копирования значений)
+	template<typename T>
+	static std::vector<std::pair<int, int>> findMatches(const BasicDescriptorSet<T>& aDescriptors, const BasicDescriptorSet<T>& bDescriptors,
+		double threshold = 0.66, Descriptor::DistanceType t = Descriptor::DistanceType::Default);
 
+	// Сохранять точки границ сеток в compute (по умолчанию выключено)
+	void setGridPointsCapture(bool enabled) { captureGridPoints = enabled; }
 	std::vector<KeyPoint> getGridPoints() { return gridPoints; }
 };
 
@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <QtCore/qfile.h>
+#include "DescriptorSet.h"
+
+namespace
+{
+	// Заголовок набора в потоке
+	struct SetHeader
+	{
+		char signature[4];
+		// BasicDescriptorSet::getValueType
+		int32_t valueType;
+		int32_t count;
+		int32_t dims;
+	};
+
+	const char SetSignature[4] = { 'D', 'S', 'E', 'T' };
+
+	// Собственный буфер набора: лишние Alignment байт позволяют выровнять начало блока
+	template<typename T>
+	T* allocateAligned(size_t elementCount, int alignment, std::shared_ptr<const void>& storage)
+	{
+		auto buffer = std::make_shared<std::vector<unsigned char>>(elementCount * sizeof(T) + alignment, 0);
+		uintptr_t address = reinterpret_cast<uintptr_t>(buffer->data());
+		uintptr_t aligned = (address + alignment - 1) / alignment * alignment;
+		storage = buffer;
+		return reinterpret_cast<T*>(aligned);
+	}
+}
+
+template<>
+float BasicDescriptorSet<float>::fromDouble(double value)
+{
+	return static_cast<float>(value);
+}
+
+template<>
+uint8_t BasicDescriptorSet<uint8_t>::fromDouble(double value)
+{
+	return static_cast<uint8_t>(std::min(std::max(std::round(512 * value), 0.0), 255.0));
+}
+
+template<>
+double BasicDescriptorSet<double>::fromDouble(double value)
+{
+	return value;
+}
+
+template<>
+double BasicDescriptorSet<float>::toDouble(float value)
+{
+	return value;
+}
+
+template<>
+double BasicDescriptorSet<uint8_t>::toDouble(uint8_t value)
+{
+	return value / 512.0;
+}
+
+template<>
+double BasicDescriptorSet<double>::toDouble(double value)
+{
+	return value;
+}
+
+template<>
+int32_t BasicDescriptorSet<float>::getValueType()
+{
+	return 0;
+}
+
+template<>
+int32_t BasicDescriptorSet<uint8_t>::getValueType()
+{
+	return 1;
+}
+
+template<>
+int32_t BasicDescriptorSet<double>::getValueType()
+{
+	return 2;
+}
+
+template<typename T>
+BasicDescriptorSet<T>::BasicDescriptorSet(): count(0), dims(0), values(nullptr) {}
+
+template<typename T>
+BasicDescriptorSet<T>::BasicDescriptorSet(int count, int dims): count(count), dims(dims)
+{
+	values = allocateAligned<T>(static_cast<size_t>(count) * dims, Alignment, storage);
+}
+
+template<typename T>
+BasicDescriptorSet<T>::BasicDescriptorSet(int count, int dims, T* values, std::shared_ptr<const void> storage):
+	count(count), dims(dims), values(values), storage(std::move(storage)) {}
+
+template<typename T>
+BasicDescriptorSet<T>::BasicDescriptorSet(const std::vector<Descriptor>& descriptors):
+	BasicDescriptorSet(static_cast<int>(descriptors.size()), descriptors.empty() ? 0 : descriptors[0].getSize())
+{
+	for (int i = 0; i < count; i++) {
+		setRow(i, descriptors[i]);
+	}
+}
+
+template<typename T>
+BasicDescriptorSet<T>::BasicDescriptorSet(BasicDescriptorSet&& other):
+	count(other.count), dims(other.dims), values(other.values), storage(std::move(other.storage))
+{
+	other.count = 0;
+	other.dims = 0;
+	other.values = nullptr;
+}
+
+template<typename T>
+BasicDescriptorSet<T>& BasicDescriptorSet<T>::operator=(BasicDescriptorSet&& other)
+{
+	if (this != &other) {
+		count = other.count;
+		dims = other.dims;
+		values = other.values;
+		storage = std::move(other.storage);
+		other.count = 0;
+		other.dims = 0;
+		other.values = nullptr;
+	}
+	return *this;
+}
+
+template<typename T>
+void BasicDescriptorSet<T>::setRow(int i, const Descriptor& descriptor)
+{
+	T* dst = row(i);
+	const double* src = descriptor.data();
+	int size = std::min(dims, descriptor.getSize());
+	for (int d = 0; d < size; d++) dst[d] = fromDouble(src[d]);
+}
+
+template<typename T>
+Descriptor BasicDescriptorSet<T>::toDescriptor(int i) const
+{
+	Descriptor descriptor(1, dims);
+	const T* src = row(i);
+	for (int d = 0; d < dims; d++) descriptor[d] = toDouble(src[d]);
+	return descriptor;
+}
+
+template<typename T>
+bool BasicDescriptorSet<T>::write(QIODevice& device) const
+{
+	SetHeader header;
+	std::memcpy(header.signature, SetSignature, sizeof(SetSignature));
+	header.valueType = getValueType();
+	header.count = count;
+	header.dims = dims;
+	qint64 bytes = static_cast<qint64>(count) * dims * sizeof(T);
+	if (device.write(reinterpret_cast<const char*>(&header), sizeof(header)) != sizeof(header)) return false;
+	return bytes == 0 || device.write(reinterpret_cast<const char*>(values), bytes) == bytes;
+}
+
+template<typename T>
+BasicDescriptorSet<T> BasicDescriptorSet<T>::read(QIODevice& device)
+{
+	SetHeader header;
+	if (device.read(reinterpret_cast<char*>(&header), sizeof(header)) != sizeof(header)) return BasicDescriptorSet();
+	if (std::memcmp(header.signature, SetSignature, sizeof(SetSignature)) != 0 || header.valueType != getValueType()
+		|| header.count < 0 || header.dims < 0) {
+		return BasicDescriptorSet();
+	}
+	// Размеры из заголовка проверяются до выделения памяти: число элементов должно помещаться в int,
+	// а значения - в оставшуюся часть устройства (для последовательных устройств - в доступные данные)
+	qint64 elementCount = static_cast<qint64>(header.count) * header.dims;
+	if (elementCount > std::numeric_limits<int>::max()) return BasicDescriptorSet();
+	qint64 bytes = elementCount * static_cast<qint64>(sizeof(T));
+	qint64 available = device.isSequential() ? device.bytesAvailable() : device.size() - device.pos();
+	if (bytes > available) return BasicDescriptorSet();
+
+	BasicDescriptorSet set(header.count, header.dims);
+	if (bytes > 0 && device.read(reinterpret_cast<char*>(set.values), bytes) != bytes) return BasicDescriptorSet();
+	return set;
+}
+
+template<typename T>
+bool BasicDescriptorSet<T>::save(const QString& fileName) const
+{
+	QFile file(fileName);
+	if (!file.open(QIODevice::WriteOnly)) return false;
+	return write(file);
+}
+
+template<typename T>
+BasicDescriptorSet<T> BasicDescriptorSet<T>::load(const QString& fileName)
+{
+	QFile file(fileName);
+	if (!file.open(QIODevice::ReadOnly)) return BasicDescriptorSet();
+	return read(file);
+}
+
+template class BasicDescriptorSet<float>;
+template class BasicDescriptorSet<uint8_t>;
+template class BasicDescriptorSet<double>;
@@ -0,0 +1,79 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "Descriptor.h"
+class QIODevice;
+class QString;
+// Набор дескрипторов одинаковой длины, записанных подряд одним выровненным блоком count x dims (по строкам).
+// Строки доступны по указателю без копирования; память принадлежит набору или внешнему владельцу (storage)
+template<typename T>
+class BasicDescriptorSet
+{
+private:
+	int count;
+	int dims;
+	T* values;
+	// Владелец памяти values: собственный буфер набора или внешний источник (например, отображенный файл)
+	std::shared_ptr<const void> storage;
+
+public:
+	// Выравнивание начала блока значений в байтах
+	static constexpr int Alignment = 64;
+
+	BasicDescriptorSet();
+	// Набор из count дескрипторов длины dims, заполненный нулями
+	BasicDescriptorSet(int count, int dims);
+	// Набор поверх внешней памяти без копирования, storage удерживает ее, пока набор существует
+	BasicDescriptorSet(int count, int dims, T* values, std::shared_ptr<const void> storage);
+	// Копия значений дескрипторов (все дескрипторы должны иметь одинаковую длину)
+	explicit BasicDescriptorSet(const std::vector<Descriptor>& descriptors);
+	BasicDescriptorSet(const BasicDescriptorSet&) = delete;
+	BasicDescriptorSet& operator=(const BasicDescriptorSet&) = delete;
+	BasicDescriptorSet(BasicDescriptorSet&& other);
+	BasicDescriptorSet& operator=(BasicDescriptorSet&& other);
+
+	int getCount() const { return count; }
+	int getDims() const { return dims; }
+	bool isEmpty() const { return count == 0; }
+
+	// Значения дескриптора i (dims элементов подряд)
+	T* row(int i) { return values + static_cast<size_t>(i) * dims; }
+	const T* row(int i) const { return values + static_cast<size_t>(i) * dims; }
+	const T* data() const { return values; }
+
+	// Записывает значения дескриптора в строку i
+	void setRow(int i, const Descriptor& descriptor);
+	// Дескриптор из строки i (значения преобразуются toDouble)
+	Descriptor toDescriptor(int i) const;
+
+	// Преобразование значения дескриптора к типу хранения: для float - приведение,
+	// для uint8 - квантование min(255, round(512 * v)) как в SIFT
+	static T fromDouble(double value);
+	// Обратное преобразование (для uint8 - value / 512)
+	static double toDouble(T value);
+	// Код типа значений в файлах: 0 - float, 1 - uint8, 2 - double
+	static int32_t getValueType();
+
+	// Запись в поток: заголовок (сигнатура, тип значений, count, dims), затем значения по строкам
+	bool write(QIODevice& device) const;
+	// Чтение набора, записанного write; пустой набор при ошибке
+	static BasicDescriptorSet read(QIODevice& device);
+	bool save(const QString& fileName) const;
+	static BasicDescriptorSet load(const QString& fileName);
+};
+
+template<> float BasicDescriptorSet<float>::fromDouble(double value);
+template<> uint8_t BasicDescriptorSet<uint8_t>::fromDouble(double value);
+template<> double BasicDescriptorSet<double>::fromDouble(double value);
+template<> double BasicDescriptorSet<float>::toDouble(float value);
+template<> double BasicDescriptorSet<uint8_t>::toDouble(uint8_t value);
+template<> double BasicDescriptorSet<double>::toDouble(double value);
+template<> int32_t BasicDescriptorSet<float>::getValueType();
+template<> int32_t BasicDescriptorSet<uint8_t>::getValueType();
+template<> int32_t BasicDescriptorSet<double>::getValueType();
+
+using DescriptorSet = BasicDescriptorSet<float>;
+using ByteDescriptorSet = BasicDescriptorSet<uint8_t>;
+// Значения без преобразования (точное сохранение результата DescriptorExtractor)
+using DoubleDescriptorSet = BasicDescriptorSet<double>;
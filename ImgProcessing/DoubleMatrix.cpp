@@ -4,18 +4,25 @@
 #include <functional>
 #include <QtCore\qmath.h>
 #include "DoubleMatrix.h"
+#include "SimdKernels.h"
+#include "ThreadPool.h"
 
-DoubleMatrix::BorderType DoubleMatrix::DefaultBorderType = DoubleMatrix::BorderType::Reflect;
-DoubleMatrix DoubleMatrix::row101 = DoubleMatrix{ {1, 0, -1} };
-DoubleMatrix DoubleMatrix::sobelRow = DoubleMatrix{ {1, 2, 1} };
+MatrixBase::BorderType MatrixBase::DefaultBorderType = MatrixBase::BorderType::Reflect;
+std::atomic<long long> MatrixBase::allocationCount(0);
+template<typename T>
+Matrix<T> Matrix<T>::row101 = Matrix<T>{ {1, 0, -1} };
+template<typename T>
+Matrix<T> Matrix<T>::sobelRow = Matrix<T>{ {1, 2, 1} };
 
-double DoubleMatrix::getWithBlackBorder(int i, int j) const
+template<typename T>
+T Matrix<T>::getWithBlackBorder(int i, int j) const
 {
 	if (i > -1 && j > -1 && i < height && j < width) return matrix[i * width + j];
 	else return 0;
 }
 
-double DoubleMatrix::getWithBorderPixel(int i, int j) const
+template<typename T>
+T Matrix<T>::getWithBorderPixel(int i, int j) const
 {
 	int newI = i;
 	int newJ = j;
@@ -28,7 +35,8 @@ double DoubleMatrix::getWithBorderPixel(int i, int j) const
 	return matrix[newI * width + newJ];
 }
 
-double DoubleMatrix::getWithReflectBorder(int i, int j) const
+template<typename T>
+T Matrix<T>::getWithReflectBorder(int i, int j) const
 {
 	int newI = i;
 	int newJ = j;
@@ -44,7 +52,8 @@ double DoubleMatrix::getWithReflectBorder(int i, int j) const
 	return matrix[(newI % height) * width + (newJ % width)];
 }
 
-double DoubleMatrix::getWithWrapBorder(int i, int j) const
+template<typename T>
+T Matrix<T>::getWithWrapBorder(int i, int j) const
 {
 	int newI = i;
 	int newJ = j;
@@ -58,7 +67,8 @@ double DoubleMatrix::getWithWrapBorder(int i, int j) const
 	return matrix[(newI % height) * width + (newJ % width)];
 }
 
-void DoubleMatrix::copyWithBorder(const DoubleMatrix& src, DoubleMatrix* dest, int wOffset, int hOffset)
+template<typename T>
+void Matrix<T>::copyWithBorder(const Matrix<T>& src, Matrix<T>* dest, int wOffset, int hOffset)
 {
 	int newWidth = src.width + wOffset * 2;
 	int newHeight = src.height + hOffset * 2;
@@ -72,98 +82,197 @@ void DoubleMatrix::copyWithBorder(const DoubleMatrix& src, DoubleMatrix* dest, i
 	}
 }
 
-DoubleMatrix DoubleMatrix::convolutionRow(const DoubleMatrix& other) const
+template<typename T>
+T Matrix<T>::convolutionAt(const Matrix<T>& kernel, int i, int j, bool vertical) const
 {
-	int offsetH = 0;
-	int offsetW = other.width / 2;
-	DoubleMatrix result(this->width, this->height);
+	int offsetW = vertical ? 0 : kernel.width / 2;
+	int offsetH = vertical ? kernel.width / 2 : kernel.height / 2;
+	T sum = 0;
+	for (int u = -offsetH; u <= offsetH; u++) {
+		for (int v = -offsetW; v <= offsetW; v++) {
+			T k = vertical ? kernel.at(0, u + offsetH) : kernel.at(u + offsetH, v + offsetW);
+			sum += get(i - u, j - v) * k;
+		}
+	}
 
-	DoubleMatrix* tmp = new DoubleMatrix(this->width, this->height);
-	copyWithBorder(*this, tmp, offsetW, offsetH);
+	return sum;
+}
 
-	for (int i = offsetH; i < result.height + offsetH; i++) {
-		for (int j = offsetW; j < result.width + offsetW; j++) {
-			double sum = 0;
-			for (int v = -offsetW; v <= offsetW; v++) {
-				sum += tmp->at(i, j - v) * other.at(0, v + offsetW);
-			}
-			result.set(i - offsetH, j - offsetW, sum);
-		}
+template<typename T>
+void Matrix<T>::convolutionRowAt(const Matrix<T>& kernel, int i, T* dst) const
+{
+	int offset = kernel.width / 2;
+
+	// Столбцы, для которых ядро не выходит за границы изображения
+	int interiorBegin = std::min(offset, width);
+	int interiorEnd = std::max(width - offset, interiorBegin);
+
+	for (int j = 0; j < interiorBegin; j++) {
+		dst[j] = convolutionAt(kernel, i, j, false);
 	}
+	SimdKernels::convolveRow(&matrix[i * width], dst, interiorBegin, interiorEnd, kernel.matrix.data(), kernel.width);
+	for (int j = interiorEnd; j < width; j++) {
+		dst[j] = convolutionAt(kernel, i, j, false);
+	}
+}
+
+template<typename T>
+Matrix<T> Matrix<T>::convolutionRow(const Matrix<T>& other) const
+{
+	Matrix<T> result(this->width, this->height);
+	convolutionRow(other, result);
+	return result;
+}
+
+template<typename T>
+void Matrix<T>::convolutionRow(const Matrix<T>& other, Matrix<T>& result) const
+{
+	result.setSize(width, height);
 
-	delete tmp;
+	ThreadPool::parallelRows(height, width, [&](int rowBegin, int rowEnd) {
+		for (int i = rowBegin; i < rowEnd; i++) {
+			convolutionRowAt(other, i, &result.matrix[i * width]);
+		}
+	});
+}
 
+template<typename T>
+Matrix<T> Matrix<T>::convolutionCol(const Matrix<T>& other) const
+{
+	Matrix<T> result(this->width, this->height);
+	convolutionCol(other, result);
 	return result;
 }
 
-DoubleMatrix DoubleMatrix::convolutionCol(const DoubleMatrix& other) const
+template<typename T>
+void Matrix<T>::convolutionCol(const Matrix<T>& other, Matrix<T>& result) const
 {
-	int offsetH = other.width / 2;
-	int offsetW = 0;
-	DoubleMatrix result(this->width, this->height);
+	int offset = other.width / 2;
+	int kernelSize = other.width;
+	const T* kernel = other.matrix.data();
+	result.setSize(width, height);
 
-	DoubleMatrix* tmp = new DoubleMatrix(this->width, this->height);
-	copyWithBorder(*this, tmp, offsetW, offsetH);
+	// Строки, для которых ядро не выходит за границы изображения
+	int interiorBegin = std::min(offset, height);
+	int interiorEnd = std::max(height - offset, interiorBegin);
 
-	for (int i = offsetH; i < result.height + offsetH; i++) {
-		for (int j = offsetW; j < result.width + offsetW; j++) {
-			double sum = 0;
-			for (int v = -offsetH; v <= offsetH; v++) {
-				sum += tmp->at(i - v, j) * other.at(0, v + offsetH);
+	ThreadPool::parallelRows(height, width, [&](int rowBegin, int rowEnd) {
+		// Строки изображения, на которые приходится каждый элемент ядра
+		PoolVector<const T*> rows(kernelSize);
+		for (int i = rowBegin; i < rowEnd; i++) {
+			T* dst = &result.matrix[i * width];
+			if (i < interiorBegin || i >= interiorEnd) {
+				for (int j = 0; j < width; j++) {
+					dst[j] = convolutionAt(other, i, j, true);
+				}
+				continue;
+			}
+			for (int t = 0; t < kernelSize; t++) {
+				rows[t] = &matrix[(i + offset - t) * width];
 			}
-			result.set(i - offsetH, j - offsetW, sum);
+			SimdKernels::convolveCol(rows.data(), dst, width, kernel, kernelSize);
 		}
-	}
-
-	delete tmp;
-	return result;
+	});
 }
 
-DoubleMatrix DoubleMatrix::convolution(const DoubleMatrix& other) const
+template<typename T>
+Matrix<T> Matrix<T>::convolution(const Matrix<T>& other) const
 {
 	int offsetW = other.width / 2;
 	int offsetH = other.height / 2;
-	DoubleMatrix result(this->width, this->height);
-
-	DoubleMatrix* tmp = new DoubleMatrix(this->width, this->height);
-	copyWithBorder(*this, tmp, offsetW, offsetH);
-
-	for (int i = offsetH; i < result.height + offsetH; i++) {
-		for (int j = offsetW; j < result.width + offsetW; j++) {
-			double sum = 0;
+	Matrix<T> result(this->width, this->height);
+
+	int rowBegin = std::min(offsetH, height);
+	int rowEnd = std::max(height - offsetH, rowBegin);
+	int colBegin = std::min(offsetW, width);
+	int colEnd = std::max(width - offsetW, colBegin);
+
+	ThreadPool::parallelRows(height, width * other.getSize(), [&](int bandBegin, int bandEnd) {
+		for (int i = bandBegin; i < bandEnd; i++) {
+			T* dst = &result.matrix[i * width];
+			if (i < rowBegin || i >= rowEnd) {
+				for (int j = 0; j < width; j++) {
+					dst[j] = convolutionAt(other, i, j, false);
+				}
+				continue;
+			}
 
-			for (int u = -offsetH; u <= offsetH; u++) {
-				for (int v = -offsetW; v <= offsetW; v++) {
-					int curY = i - u;
-					int curX = j - v;
-					sum += tmp->at(curY, curX) * other.at(u + offsetH, v + offsetW);
+			for (int j = 0; j < colBegin; j++) {
+				dst[j] = convolutionAt(other, i, j, false);
+			}
+			for (int u = 0; u < other.height; u++) {
+				const T* src = &matrix[(i + offsetH - u) * width];
+				const T* kernelRow = &other.matrix[u * other.width];
+				for (int v = 0; v < other.width; v++) {
+					const T* s = src + offsetW - v;
+					T k = kernelRow[v];
+					for (int j = colBegin; j < colEnd; j++) {
+						dst[j] += s[j] * k;
+					}
 				}
 			}
+			for (int j = colEnd; j < width; j++) {
+				dst[j] = convolutionAt(other, i, j, false);
+			}
+		}
+	});
+
+	return result;
+}
 
-			result.set(i - offsetH, j - offsetW, sum);
+template<typename T>
+template<typename F>
+Matrix<T> Matrix<T>::transformElements(F f) const
+{
+	Matrix<T> result(width, height);
+	const T* src = matrix.data();
+	T* dst = result.matrix.data();
+	ThreadPool::global().parallelFor(0, getSize(), ThreadPool::MinBandElements, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			dst[i] = f(src[i]);
 		}
-	}
+	});
+	return result;
+}
 
-	delete tmp;
+template<typename T>
+template<typename F>
+Matrix<T> Matrix<T>::transformElements(const Matrix<T>& other, F f) const
+{
+	Matrix<T> result(width, height);
+	const T* a = matrix.data();
+	const T* b = other.matrix.data();
+	T* dst = result.matrix.data();
+	ThreadPool::global().parallelFor(0, getSize(), ThreadPool::MinBandElements, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			dst[i] = f(a[i], b[i]);
+		}
+	});
 	return result;
 }
 
-int DoubleMatrix::getGaussianSize(double sigma)
+template<typename T>
+int Matrix<T>::getGaussianSize(double sigma)
 {
 	int size = sigma * 3 * 2;
 	if (size % 2 == 0) size += 1;
 	return size;
 }
 
-DoubleMatrix::DoubleMatrix(): width(0), height(0), matrix(0) {}
+template<typename T>
+Matrix<T>::Matrix(): width(0), height(0), matrix(0) {}
 
-DoubleMatrix::DoubleMatrix(int w, int h): width(w), height(h)
+template<typename T>
+Matrix<T>::Matrix(int w, int h): width(w), height(h)
 {
+	allocationCount++;
 	matrix.resize(width * height);
 }
 
-DoubleMatrix::DoubleMatrix(const DoubleMatrix& other): width(other.width), height(other.height)
+template<typename T>
+Matrix<T>::Matrix(const Matrix<T>& other): width(other.width), height(other.height)
 {
+	allocationCount++;
 	matrix.resize(width * height);
 	
 	for (int i = 0; i < width * height; i++) {
@@ -171,8 +280,10 @@ DoubleMatrix::DoubleMatrix(const DoubleMatrix& other): width(other.width), heigh
 	}
 }
 
-DoubleMatrix::DoubleMatrix(std::vector<std::vector<double>> m)
+template<typename T>
+Matrix<T>::Matrix(std::vector<std::vector<T>> m)
 {
+	allocationCount++;
 	height = m.size();
 	width = m[0].size();
 	matrix.resize(height * width);
@@ -184,8 +295,10 @@ DoubleMatrix::DoubleMatrix(std::vector<std::vector<double>> m)
 	}
 }
 
-DoubleMatrix::DoubleMatrix(std::initializer_list<std::initializer_list<double>> arr)
+template<typename T>
+Matrix<T>::Matrix(std::initializer_list<std::initializer_list<T>> arr)
 {
+	allocationCount++;
 	height = arr.size();
 	width = arr.begin()->size();
 	matrix.resize(width * height);
@@ -199,37 +312,53 @@ DoubleMatrix::DoubleMatrix(std::initializer_list<std::initializer_list<double>>
 	}
 }
 
-DoubleMatrix& DoubleMatrix::operator=(const DoubleMatrix& right)
+template<typename T>
+Matrix<T>& Matrix<T>::operator=(const Matrix<T>& right)
 {
 	if (this == &right) return *this;
-	width = right.width;
-	height = right.height;
+	setSize(right.width, right.height);
 	std::copy(begin(right.matrix), end(right.matrix), begin(this->matrix));
 	return *this;
 }
 
-double& DoubleMatrix::operator[](int i)
+template<typename T>
+T& Matrix<T>::operator[](int i)
 {
 	return matrix[i];
 }
 
-DoubleMatrix& DoubleMatrix::fillMatrix(double val)
+template<typename T>
+void Matrix<T>::setSize(int w, int h)
+{
+	if (matrix.size() != static_cast<size_t>(w * h)) {
+		allocationCount++;
+		matrix.resize(w * h);
+	}
+	width = w;
+	height = h;
+}
+
+template<typename T>
+Matrix<T>& Matrix<T>::fillMatrix(T val)
 {
 	fill(begin(matrix), end(matrix), val);
 	return *this;
 }
 
-void DoubleMatrix::set(int i, int j, double val)
+template<typename T>
+void Matrix<T>::set(int i, int j, T val)
 {
 	matrix[i * width + j] = val;
 }
 
-void DoubleMatrix::set(int i, double val)
+template<typename T>
+void Matrix<T>::set(int i, T val)
 {
 	matrix[i] = val;
 }
 
-double DoubleMatrix::get(int i, int j) const
+template<typename T>
+T Matrix<T>::get(int i, int j) const
 {
 	if (DefaultBorderType == BorderType::Black) return getWithBlackBorder(i, j);
 	else if (DefaultBorderType == BorderType::BorderPixel) return getWithBorderPixel(i, j);
@@ -238,23 +367,45 @@ double DoubleMatrix::get(int i, int j) const
 	else return -1;
 }
 
-DoubleMatrix& DoubleMatrix::normalize(double newMin, double newMax)
+template<typename T>
+std::pair<T, T> Matrix<T>::minMax() const
 {
-	//DoubleMatrix* result = new DoubleMatrix(*this);
-	auto minMax = std::minmax_element(begin(matrix), end(matrix));
-	double minEl = *minMax.first;
-	double maxEl = *minMax.second;
+	if (matrix.empty()) return std::make_pair(T(), T());
+	std::pair<T, T> result(matrix[0], matrix[0]);
+	std::mutex resultMutex;
+	const T* values = matrix.data();
+	ThreadPool::global().parallelFor(0, getSize(), ThreadPool::MinBandElements, [&](int begin, int end) {
+		auto bandMinMax = std::minmax_element(values + begin, values + end);
+		std::lock_guard<std::mutex> lock(resultMutex);
+		result.first = std::min(result.first, *bandMinMax.first);
+		result.second = std::max(result.second, *bandMinMax.second);
+	});
 
-	for (int i = 0; i < width * height; i++) {
-		matrix[i] = (matrix[i] - minEl) * (newMax - newMin) / (maxEl - minEl) + newMin;
-	}
+	return result;
+}
+
+template<typename T>
+Matrix<T>& Matrix<T>::normalize(double newMin, double newMax)
+{
+	std::pair<T, T> minMaxEl = minMax();
+	return normalize(newMin, newMax, minMaxEl.first, minMaxEl.second);
+}
+
+template<typename T>
+Matrix<T>& Matrix<T>::normalize(double newMin, double newMax, double minEl, double maxEl)
+{
+	T* values = matrix.data();
+	ThreadPool::global().parallelFor(0, getSize(), ThreadPool::MinBandElements, [&](int begin, int end) {
+		SimdKernels::normalize(values + begin, end - begin, minEl, maxEl, newMin, newMax);
+	});
 
 	return *this;
 }
 
-DoubleMatrix DoubleMatrix::transpose()
+template<typename T>
+Matrix<T> Matrix<T>::transpose()
 {
-	DoubleMatrix result(*this);
+	Matrix<T> result(*this);
 	result.height = width;
 	result.width = height;
 	if (height != 1 && width != 1) {
@@ -269,128 +420,248 @@ DoubleMatrix DoubleMatrix::transpose()
 	return result;
 }
 
-DoubleMatrix DoubleMatrix::calcSobel() const
+template<typename T>
+Matrix<T> Matrix<T>::calcSobel() const
 {
-	DoubleMatrix gX = dx();
-	DoubleMatrix gY = dy();
+	Matrix<T> gX = dx();
+	Matrix<T> gY = dy();
 
 
-	DoubleMatrix result(width, height);
-	std::transform(begin(gX.matrix), end(gX.matrix), begin(gY.matrix), begin(result.matrix), 
-		[](double x, double y) { return sqrt(x * x + y * y);});
-
-	return result;
+	return gX.transformElements(gY, [](T x, T y) { return std::sqrt(x * x + y * y); });
 }
 
-DoubleMatrix DoubleMatrix::gaussian(double sigma) const
+template<typename T>
+Matrix<T> Matrix<T>::gaussian(double sigma) const
 {
-	DoubleMatrix gaussianX = createGaussianRow(sigma);
+	Matrix<T> gaussianX = createGaussianRow(sigma);
 	return this->convolutionRow(gaussianX).convolutionCol(gaussianX);
 }
 
-DoubleMatrix DoubleMatrix::dx() const
+template<typename T>
+void Matrix<T>::gaussian(double sigma, Matrix<T>& result, Matrix<T>& buffer) const
+{
+	Matrix<T> gaussianX = createGaussianRow(sigma);
+	convolutionRow(gaussianX, buffer);
+	buffer.convolutionCol(gaussianX, result);
+}
+
+template<typename T>
+Matrix<T> Matrix<T>::dx() const
 {
 	return this->convolutionRow(row101).convolutionCol(sobelRow);
 }
 
-DoubleMatrix DoubleMatrix::dy() const
+template<typename T>
+Matrix<T> Matrix<T>::dy() const
 {
 	return this->convolutionRow(sobelRow).convolutionCol(row101);
 }
 
-DoubleMatrix DoubleMatrix::add(double val) const
+template<typename T>
+void Matrix<T>::dx(Matrix<T>& result, Matrix<T>& buffer) const
 {
-	DoubleMatrix result(width, height);
-	std::transform(begin(matrix), end(matrix), begin(result.matrix), [&](double x) { return x + val; });
-	return result;
+	convolutionRow(row101, buffer);
+	buffer.convolutionCol(sobelRow, result);
 }
 
-DoubleMatrix DoubleMatrix::add(const DoubleMatrix& other) const
+template<typename T>
+void Matrix<T>::dy(Matrix<T>& result, Matrix<T>& buffer) const
 {
-	DoubleMatrix result(width, height);
-	std::transform(begin(matrix), end(matrix), begin(other.matrix), begin(result.matrix), std::plus<double>());
-	return result;
+	convolutionRow(sobelRow, buffer);
+	buffer.convolutionCol(row101, result);
 }
 
-DoubleMatrix DoubleMatrix::sub(double val) const
+template<typename T>
+Matrix<T> Matrix<T>::add(double val) const
 {
-	DoubleMatrix result(width, height);
-	std::transform(begin(matrix), end(matrix), begin(result.matrix), [&](double x) { return x - val; });
-	return result;
+	return transformElements([val](T x) { return static_cast<T>(x + val); });
 }
 
-DoubleMatrix DoubleMatrix::sub(const DoubleMatrix& other) const
+template<typename T>
+Matrix<T> Matrix<T>::add(const Matrix<T>& other) const
 {
-	DoubleMatrix result(width, height);
-	std::transform(begin(matrix), end(matrix), begin(other.matrix), begin(result.matrix), std::minus<double>());
-	return result;
+	return transformElements(other, std::plus<T>());
 }
 
-DoubleMatrix DoubleMatrix::mul(double val) const
+template<typename T>
+Matrix<T> Matrix<T>::sub(double val) const
 {
-	DoubleMatrix result(width, height);
-	std::transform(begin(matrix), end(matrix), begin(result.matrix), [&](double x) { return x * val; });
-	return result;
+	return transformElements([val](T x) { return static_cast<T>(x - val); });
 }
 
-DoubleMatrix DoubleMatrix::mul(const DoubleMatrix& other) const
+template<typename T>
+Matrix<T> Matrix<T>::sub(const Matrix<T>& other) const
 {
-	DoubleMatrix result(width, height);
-	std::transform(begin(matrix), end(matrix), begin(other.matrix), begin(result.matrix), std::multiplies<double>());
-	return result;
+	return transformElements(other, std::minus<T>());
 }
 
-DoubleMatrix DoubleMatrix::div(const DoubleMatrix& other) const
+template<typename T>
+Matrix<T> Matrix<T>::mul(double val) const
 {
-	DoubleMatrix result(width, height);
-	std::transform(begin(matrix), end(matrix), begin(other.matrix), begin(result.matrix), std::divides<double>());
-	return result;
+	return transformElements([val](T x) { return static_cast<T>(x * val); });
 }
 
-DoubleMatrix DoubleMatrix::div(double val) const
+template<typename T>
+Matrix<T> Matrix<T>::mul(const Matrix<T>& other) const
 {
-	DoubleMatrix result(width, height);
-	std::transform(begin(matrix), end(matrix), begin(result.matrix), [&](double x) { return x / val; });
-	return result;
+	return transformElements(other, std::multiplies<T>());
 }
 
-double DoubleMatrix::sum() const 
+template<typename T>
+Matrix<T> Matrix<T>::div(const Matrix<T>& other) const
+{
+	return transformElements(other, std::divides<T>());
+}
+
+template<typename T>
+Matrix<T> Matrix<T>::div(double val) const
+{
+	return transformElements([val](T x) { return static_cast<T>(x / val); });
+}
+
+template<typename T>
+double Matrix<T>::sum() const 
 {
 	return std::accumulate(begin(matrix), end(matrix), 0.0);
 }
 
-DoubleMatrix DoubleMatrix::abs() const
+template<typename T>
+Matrix<T> Matrix<T>::abs() const
 {
-	DoubleMatrix result(width, height);
-	std::transform(begin(matrix), end(matrix), begin(result.matrix), [&](double x) { return std::abs(x); });
+	Matrix<T> result(width, height);
+	std::transform(begin(matrix), end(matrix), begin(result.matrix), [&](T x) { return std::abs(x); });
 	return result;
 }
 
-bool DoubleMatrix::allClose(DoubleMatrix& other, double eps)
+template<typename T>
+bool Matrix<T>::allClose(Matrix<T>& other, double eps)
 {
-	DoubleMatrix subMatrix = this->sub(other);
+	Matrix<T> subMatrix = this->sub(other);
 	auto minMaxIterator = std::minmax_element(begin(subMatrix.matrix), end(subMatrix.matrix));
 	double absMax = std::max(std::abs(*minMaxIterator.first), std::abs(*minMaxIterator.second));
 	//std::cout << "MAX=" << absMax << std::endl;
 	return absMax <= eps;
 }
 
-DoubleMatrix DoubleMatrix::downsample(int pow)
+namespace
+{
+	// Максимумы скользящего окна длины windowLength по src длины n + windowLength - 1 (алгоритм ван Херка - Гил-Вермана).
+	// В блоках длины окна считаются максимумы от начала блока (prefix) и до конца блока (suffix),
+	// окно [i, i + windowLength) - это конец одного блока и начало следующего
+	template<typename T>
+	void slidingMax(const T* src, T* dst, int n, int windowLength, T* prefix, T* suffix)
+	{
+		int length = n + windowLength - 1;
+		for (int blockBegin = 0; blockBegin < length; blockBegin += windowLength) {
+			int blockEnd = std::min(blockBegin + windowLength, length);
+			prefix[blockBegin] = src[blockBegin];
+			for (int i = blockBegin + 1; i < blockEnd; i++) prefix[i] = std::max(prefix[i - 1], src[i]);
+			suffix[blockEnd - 1] = src[blockEnd - 1];
+			for (int i = blockEnd - 2; i >= blockBegin; i--) suffix[i] = std::max(suffix[i + 1], src[i]);
+		}
+		for (int i = 0; i < n; i++) {
+			dst[i] = std::max(suffix[i], prefix[i + windowLength - 1]);
+		}
+	}
+
+	// Число столбцов, которые обрабатываются вместе при поиске максимумов по столбцам
+	const int MaxFilterColumnBlock = 128;
+}
+
+template<typename T>
+Matrix<T> Matrix<T>::maxFilter(int radiusY, int radiusX) const
 {
-	int k = std::pow(2, pow);
-	DoubleMatrix result(this->width / k, this->height / k);
-	Q_ASSERT(result.width != 0 && result.height != 0);
+	int windowWidth = 2 * radiusX + 1;
+	int windowHeight = 2 * radiusY + 1;
+	Matrix<T> rowMax(width, height);
 
-	for (int i = 0; i < result.height; i++) {
-		for (int j = 0; j < result.width; j++) {
-			result.matrix[i * result.width + j] = this->at(i * k, j * k);;
+	// Максимумы по строкам
+	ThreadPool::parallelRows(height, width, [&](int rowBegin, int rowEnd) {
+		int length = width + windowWidth - 1;
+		PoolVector<T> padded(length), prefix(length), suffix(length);
+		for (int i = rowBegin; i < rowEnd; i++) {
+			const T* src = &matrix[i * width];
+			for (int j = 0; j < radiusX; j++) {
+				int left = getBorderIndex(j - radiusX, width);
+				int right = getBorderIndex(width + j, width);
+				padded[j] = left < 0 ? 0 : src[left];
+				padded[radiusX + width + j] = right < 0 ? 0 : src[right];
+			}
+			std::copy(src, src + width, &padded[radiusX]);
+			slidingMax(padded.data(), &rowMax.matrix[i * width], width, windowWidth, prefix.data(), suffix.data());
 		}
-	}
+	});
+
+	// Максимумы по столбцам: блок столбцов обрабатывается целыми строками
+	Matrix<T> result(width, height);
+	int length = height + windowHeight - 1;
+	ThreadPool::global().parallelFor(0, width, std::max(1, ThreadPool::MinBandElements / std::max(length, 1)), [&](int colBegin, int colEnd) {
+		int blockSize = std::min(MaxFilterColumnBlock, colEnd - colBegin);
+		PoolVector<T> prefix(length * blockSize), suffix(length * blockSize);
+		PoolVector<T> zeros(blockSize, 0);
+		for (int blockBegin = colBegin; blockBegin < colEnd; blockBegin += blockSize) {
+			int blockWidth = std::min(blockSize, colEnd - blockBegin);
+			auto sourceRow = [&](int i) {
+				int index = getBorderIndex(i - radiusY, height);
+				return index < 0 ? zeros.data() : &rowMax.matrix[index * width + blockBegin];
+			};
+			for (int windowBegin = 0; windowBegin < length; windowBegin += windowHeight) {
+				int windowEnd = std::min(windowBegin + windowHeight, length);
+				const T* src = sourceRow(windowBegin);
+				std::copy(src, src + blockWidth, &prefix[windowBegin * blockSize]);
+				for (int i = windowBegin + 1; i < windowEnd; i++) {
+					src = sourceRow(i);
+					const T* previous = &prefix[(i - 1) * blockSize];
+					T* dst = &prefix[i * blockSize];
+					for (int j = 0; j < blockWidth; j++) dst[j] = std::max(previous[j], src[j]);
+				}
+				src = sourceRow(windowEnd - 1);
+				std::copy(src, src + blockWidth, &suffix[(windowEnd - 1) * blockSize]);
+				for (int i = windowEnd - 2; i >= windowBegin; i--) {
+					src = sourceRow(i);
+					const T* next = &suffix[(i + 1) * blockSize];
+					T* dst = &suffix[i * blockSize];
+					for (int j = 0; j < blockWidth; j++) dst[j] = std::max(next[j], src[j]);
+				}
+			}
+			for (int i = 0; i < height; i++) {
+				const T* first = &suffix[i * blockSize];
+				const T* last = &prefix[(i + windowHeight - 1) * blockSize];
+				T* dst = &result.matrix[i * width + blockBegin];
+				for (int j = 0; j < blockWidth; j++) dst[j] = std::max(first[j], last[j]);
+			}
+		}
+	});
 
 	return result;
 }
 
-void DoubleMatrix::printMatrix() const
+template<typename T>
+Matrix<T> Matrix<T>::downsample(int pow) const
+{
+	Matrix<T> result;
+	downsample(result, pow);
+	return result;
+}
+
+template<typename T>
+void Matrix<T>::downsample(Matrix<T>& result, int pow) const
+{
+	int k = std::pow(2, pow);
+	result.setSize(this->width / k, this->height / k);
+	Q_ASSERT(result.width != 0 && result.height != 0);
+
+	ThreadPool::parallelRows(result.height, result.width, [&](int rowBegin, int rowEnd) {
+		for (int i = rowBegin; i < rowEnd; i++) {
+			for (int j = 0; j < result.width; j++) {
+				result.matrix[i * result.width + j] = this->at(i * k, j * k);
+			}
+		}
+	});
+}
+
+template<typename T>
+void Matrix<T>::printMatrix() const
 {
 	for (int i = 0; i < height; i++) {
 		for (int j = 0; j < width; j++) {
@@ -400,19 +671,34 @@ void DoubleMatrix::printMatrix() const
 	}
 }
 
-void DoubleMatrix::setDefaultBoderType(BorderType type)
+void MatrixBase::setDefaultBoderType(BorderType type)
 {
 	DefaultBorderType = type;
 }
 
-DoubleMatrix DoubleMatrix::convolution(const DoubleMatrix& a, const DoubleMatrix& b)
+int MatrixBase::getBorderIndex(int i, int size)
+{
+	if (i > -1 && i < size) return i;
+
+	int newI = i;
+	if (DefaultBorderType == BorderType::Black) return -1;
+	else if (DefaultBorderType == BorderType::BorderPixel) newI = i < 0 ? 0 : size - 1;
+	else if (DefaultBorderType == BorderType::Reflect) newI = i < 0 ? -i - 1 : size - i % size - 1;
+	else if (DefaultBorderType == BorderType::Wrap) newI = i < 0 ? (size - 1) + i + size : i % size;
+
+	return newI % size;
+}
+
+template<typename T>
+Matrix<T> Matrix<T>::convolution(const Matrix<T>& a, const Matrix<T>& b)
 {
 	return a.convolution(b);
 }
 
-DoubleMatrix DoubleMatrix::createGaussian(int width, int height, double sigma)
+template<typename T>
+Matrix<T> Matrix<T>::createGaussian(int width, int height, double sigma)
 {
-	DoubleMatrix kernel(width, height);
+	Matrix<T> kernel(width, height);
 	int offsetH = height / 2;
 	int offsetW = width / 2;
 	double sum = 0.0;
@@ -420,34 +706,36 @@ DoubleMatrix DoubleMatrix::createGaussian(int width, int height, double sigma)
 	for (int i = -offsetH; i <= offsetH; i++) {
 		for (int j = -offsetW; j <= offsetW; j++) {
 			double val = exp(-(i * i + j * j) / (2 * sigma * sigma)) / (2 * M_PI * sigma * sigma);
-			kernel.set(i + offsetH, j + offsetW,  val);
-			kernel.matrix[(i + offsetH) * width + (j + offsetW)] =  val;
+			kernel.set(i + offsetH, j + offsetW,  static_cast<T>(val));
+			kernel.matrix[(i + offsetH) * width + (j + offsetW)] = static_cast<T>(val);
 			sum += val;
 		}
 	}
 
-	std::transform(begin(kernel.matrix), end(kernel.matrix), begin(kernel.matrix), [&sum](double x) {return x / sum;});
+	std::transform(begin(kernel.matrix), end(kernel.matrix), begin(kernel.matrix), [&sum](T x) {return static_cast<T>(x / sum);});
 
 	return kernel;
 }
 
-DoubleMatrix DoubleMatrix::createGaussian(double sigma)
+template<typename T>
+Matrix<T> Matrix<T>::createGaussian(double sigma)
 {
 	int size = getGaussianSize(sigma);
 	return createGaussian(size, size, sigma);
 
 }
 
-DoubleMatrix DoubleMatrix::createGaussianRow(int width, double sigma)
+template<typename T>
+Matrix<T> Matrix<T>::createGaussianRow(int width, double sigma)
 {
-	DoubleMatrix kernel(width, 1);
+	Matrix<T> kernel(width, 1);
 	int offsetW = width / 2;
 	double sum = 0.0;
 
 	for (int i = -offsetW; i <= offsetW; i++) {
 		double val = exp(-(i * i) / (2 * sigma * sigma)) / (std::sqrt(2 * M_PI) * sigma);
-		kernel.set(i + offsetW, val);
-		kernel.matrix[i + offsetW] = val;
+		kernel.set(i + offsetW, static_cast<T>(val));
+		kernel.matrix[i + offsetW] = static_cast<T>(val);
 		sum += val;
 	}
 
@@ -458,73 +746,52 @@ DoubleMatrix DoubleMatrix::createGaussianRow(int width, double sigma)
 	return kernel;
 }
 
-DoubleMatrix DoubleMatrix::createGaussianRow(double sigma)
+template<typename T>
+Matrix<T> Matrix<T>::createGaussianRow(double sigma)
 {
 	return createGaussianRow(getGaussianSize(sigma), sigma);
 }
 
-DoubleMatrix operator+(const DoubleMatrix& a, const DoubleMatrix& b)
+template<typename T>
+Matrix<T> Matrix<T>::gradientDirection() const
 {
-	return a.add(b);
+	Matrix<T> dx = this->dx();
+	Matrix<T> dy = this->dy();
+	return dx.transformElements(dy, [](T x, T y) {
+		T rad = std::atan2(-y, -x);
+		return static_cast<T>(rad + M_PI);
+	});
 }
 
-DoubleMatrix operator+(const DoubleMatrix& a, double b)
+template<typename T>
+void Matrix<T>::gradient(Matrix<T>& magnitude, Matrix<T>& direction, bool fastAtan) const
 {
-	return a.add(b);
+	Matrix<T> gX, gY, buffer;
+	gradient(magnitude, direction, gX, gY, buffer, fastAtan);
 }
 
-DoubleMatrix operator+(double a, const DoubleMatrix& b)
+template<typename T>
+void Matrix<T>::gradient(Matrix<T>& magnitude, Matrix<T>& direction, Matrix<T>& gX, Matrix<T>& gY, Matrix<T>& buffer, bool fastAtan) const
 {
-	return b.add(b);
-}
-
-DoubleMatrix operator-(const DoubleMatrix& a, const DoubleMatrix& b)
-{
-	return a.sub(b);
-}
-
-DoubleMatrix operator-(const DoubleMatrix& a, double b)
-{
-	return a.sub(b);
-}
-
-DoubleMatrix operator*(const DoubleMatrix& a, const DoubleMatrix& b)
-{
-	return a.mul(b);
-}
-
-DoubleMatrix operator*(const DoubleMatrix& a, double b)
-{
-	return a.mul(b);
-}
+	dx(gX, buffer);
+	dy(gY, buffer);
+	magnitude.setSize(width, height);
+	direction.setSize(width, height);
 
-DoubleMatrix operator*(double a, const DoubleMatrix& b)
-{
-	return b.mul(a);
-}
-
-DoubleMatrix operator/(const DoubleMatrix& a, const DoubleMatrix& b)
-{
-	return a.div(b);
-}
-
-DoubleMatrix operator/(const DoubleMatrix& a, double b)
-{
-	return a.div(b);
-}
-
-DoubleMatrix DoubleMatrix::gradientDirection() const
-{
-	DoubleMatrix dx = this->dx();
-	DoubleMatrix dy = this->dy();
-	DoubleMatrix result(width, height);
-	for (int i = 0; i < height; i++) {
-		for (int j = 0; j < width; j++) {
-			double rad = std::atan2(-dy.at(i,j), -dx.at(i, j));
-			rad = rad + M_PI;
-			result.set(i, j, rad);
+	ThreadPool::global().parallelFor(0, getSize(), ThreadPool::MinBandElements, [&](int begin, int end) {
+		if (fastAtan) {
+			SimdKernels::gradientPolar(&gX.matrix[begin], &gY.matrix[begin], &magnitude.matrix[begin], &direction.matrix[begin], end - begin);
+			return;
 		}
-	}
+		for (int i = begin; i < end; i++) {
+			T x = gX.matrix[i];
+			T y = gY.matrix[i];
+			magnitude.matrix[i] = std::sqrt(x * x + y * y);
+			T rad = std::atan2(-y, -x);
+			direction.matrix[i] = static_cast<T>(rad + M_PI);
+		}
+	});
+}
 
-	return result;
-}
\ No newline at end of file
+template class Matrix<double>;
+template class Matrix<float>;
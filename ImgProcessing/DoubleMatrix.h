@@ -1,7 +1,14 @@
 #pragma once
 #include <vector>
 #include <functional>
-class DoubleMatrix
+#include <algorithm>
+#include <atomic>
+#include <type_traits>
+#include <utility>
+#include "ThreadPool.h"
+#include "BufferPool.h"
+// Общие для матриц любого типа элементов настройки
+class MatrixBase
 {
 public:
 	// Тип заполнения границ изображения
@@ -18,126 +25,331 @@ public:
 		// Значение по умолчанию
 		Default = Reflect
 	};
-private:
+protected:
 	// Тип заполнения границы при вызове метода get
 	static BorderType DefaultBorderType;
+
+	// Индекс строки (столбца) i матрицы размера size с учетом типа заполнения границ (-1 - черный цвет)
+	static int getBorderIndex(int i, int size);
+public:
+	// Установка типа заполнения границ изображения
+	static void setDefaultBoderType(BorderType type);
+
+protected:
+	// Число выделений буферов матриц
+	static std::atomic<long long> allocationCount;
+public:
+	// Возвращает число выделений буферов матриц с момента запуска программы
+	static long long getAllocationCount() { return allocationCount; }
+};
+
+template<typename T> class Matrix;
+
+// Ленивое поэлементное выражение над матрицами (E - конкретный тип выражения).
+// Операторы + - * / строят дерево выражения, которое вычисляется за один проход при присваивании матрице
+template<typename E>
+class MatrixExpr
+{
+public:
+	const E& self() const { return static_cast<const E&>(*this); }
+	// Сумма элементов выражения без создания промежуточной матрицы
+	double sum() const
+	{
+		double result = 0.0;
+		int size = self().getSize();
+		for (int i = 0; i < size; i++) result += self().at(i);
+		return result;
+	}
+};
+
+// Способ хранения операнда в выражении (E - тип аргумента оператора, как в передаваемой ссылке E&&):
+// матрицы-переменные хранятся по ссылке, временные матрицы и вложенные выражения - по значению,
+// поэтому выражение, сохраненное в auto, не ссылается на временные объекты уже завершенного полного выражения
+template<typename E>
+struct MatrixExprOperand { using Type = typename std::decay<E>::type; };
+template<typename T>
+struct MatrixExprOperand<Matrix<T>&> { using Type = const Matrix<T>&; };
+template<typename T>
+struct MatrixExprOperand<const Matrix<T>&> { using Type = const Matrix<T>&; };
+
+// Операторы выражений принимают только матрицы и выражения
+template<typename E>
+using IsMatrixExpr = std::is_base_of<MatrixExpr<typename std::decay<E>::type>, typename std::decay<E>::type>;
+
+// Поэлементная операция над двумя выражениями одного размера (L и R - способы хранения операндов)
+template<typename L, typename R, typename Op>
+class MatrixBinaryExpr : public MatrixExpr<MatrixBinaryExpr<L, R, Op>>
+{
+private:
+	L left;
+	R right;
+public:
+	using ValueType = typename std::decay<L>::type::ValueType;
+
+	template<typename A, typename B>
+	MatrixBinaryExpr(A&& l, B&& r): left(std::forward<A>(l)), right(std::forward<B>(r)) {}
+	int getWidth() const { return left.getWidth(); }
+	int getHeight() const { return left.getHeight(); }
+	int getSize() const { return left.getSize(); }
+	ValueType at(int i) const { return Op()(left.at(i), right.at(i)); }
+};
+
+// Поэлементная операция выражения и числа (вычисляется в double, как методы add/sub/mul/div)
+template<typename E, typename Op>
+class MatrixScalarExpr : public MatrixExpr<MatrixScalarExpr<E, Op>>
+{
+private:
+	E expr;
+	double value;
+public:
+	using ValueType = typename std::decay<E>::type::ValueType;
+
+	template<typename A>
+	MatrixScalarExpr(A&& e, double val): expr(std::forward<A>(e)), value(val) {}
+	int getWidth() const { return expr.getWidth(); }
+	int getHeight() const { return expr.getHeight(); }
+	int getSize() const { return expr.getSize(); }
+	ValueType at(int i) const { return static_cast<ValueType>(Op()(expr.at(i), value)); }
+};
+
+// Матрица (изображение или ядро свертки) с элементами типа T (double или float)
+template<typename T>
+class Matrix : public MatrixBase, public MatrixExpr<Matrix<T>>
+{
+private:
+	template<typename U> friend class Matrix;
+
 	// Матрица вида [1, 0, -1] для вычисления производных
-	static DoubleMatrix row101;
+	static Matrix row101;
 	// Матрица вида [1, 2 1] для вычисления производных (Оператор Собеля)
-	static DoubleMatrix sobelRow;
+	static Matrix sobelRow;
 	// Основной вектор со значениями яркости избражения или ядра свертки
-	std::vector<double> matrix;
+	PoolVector<T> matrix;
 	// Высота матрицы
 	int height;
 	// Ширина матрицы
 	int width;
 
 	// Возвращает пиксель на позиции (i, j) изображения или черный цвет за границами изображения
-	double getWithBlackBorder(int i, int j) const;
+	T getWithBlackBorder(int i, int j) const;
 	// Возвращает пиксель на позиции (i, j) изображения или граничный пиксель за границами изображения
-	double getWithBorderPixel(int i, int j) const;
+	T getWithBorderPixel(int i, int j) const;
 	// Возвращает пиксель на позиции (i, j) изображения или отражение изображения за границей
-	double getWithReflectBorder(int i, int j) const;
-	// Возвращает пиксель на позиции (i, j) изображения или "завернутый" край изображения 
-	double getWithWrapBorder(int i, int j) const;
+	T getWithReflectBorder(int i, int j) const;
+	// Возвращает пиксель на позиции (i, j) изображения или "завернутый" край изображения
+	T getWithWrapBorder(int i, int j) const;
+
+	// Значение свертки в точке (i, j) с заполнением границ методом get (ядро vertical задается строкой и применяется по столбцу)
+	T convolutionAt(const Matrix& kernel, int i, int j, bool vertical) const;
+	// Свертка строки i по ядру-строке kernel, результат записывается в dst
+	void convolutionRowAt(const Matrix& kernel, int i, T* dst) const;
+
+	// Поэлементное преобразование f(x) с разбиением на полосы в общем пуле потоков
+	template<typename F>
+	Matrix transformElements(F f) const;
+	// Поэлементное преобразование f(x, y) двух матриц одного размера в общем пуле потоков
+	template<typename F>
+	Matrix transformElements(const Matrix& other, F f) const;
 
 	// Ошибка при сдвиге окна в детекторе Моравека
-	double moravecC(int x, int y, const std::vector<int>& windowSize, const std::vector<int>& d);
+	T moravecC(int x, int y, const std::vector<int>& windowSize, const std::vector<int>& d);
 
-	// Возвращает размер (ширину) ядра фильтра гаусса по правилу полуразмер=3*sigma 
+	// Возвращает размер (ширину) ядра фильтра гаусса по правилу полуразмер=3*sigma
 	static int getGaussianSize(double sigma);
-	// Оригинальный оператор Харриса 
-	static DoubleMatrix harrisF(DoubleMatrix& a, DoubleMatrix& b, DoubleMatrix& c, double coef = 0.04);
+	// Отклик Харриса (lambda min) для строк [rowBegin, rowEnd) по ядру окна window, заданному строкой
+	void harrisBand(const Matrix& window, int rowBegin, int rowEnd, Matrix& result) const;
+	// Оригинальный оператор Харриса
+	static Matrix harrisF(Matrix& a, Matrix& b, Matrix& c, double coef = 0.04);
 	// Оператор Харриса с использованием lambda min
-	static DoubleMatrix harrisE(DoubleMatrix& a, DoubleMatrix& b, DoubleMatrix& c);
+	static Matrix harrisE(Matrix& a, Matrix& b, Matrix& c);
 public:
-	DoubleMatrix();
-	DoubleMatrix(int w, int h);
-	DoubleMatrix(const DoubleMatrix& other);
-	DoubleMatrix(DoubleMatrix&& other) = default;
-	DoubleMatrix(std::vector<std::vector<double>> m);
-	DoubleMatrix(std::initializer_list<std::initializer_list<double>> arr);
+	using ValueType = T;
+
+	Matrix();
+	Matrix(int w, int h);
+	Matrix(const Matrix& other);
+	Matrix(Matrix&& other) = default;
+	Matrix(std::vector<std::vector<T>> m);
+	Matrix(std::initializer_list<std::initializer_list<T>> arr);
+	// Вычисляет выражение за один проход
+	template<typename E>
+	Matrix(const MatrixExpr<E>& expr);
 
 	int getWidth() const { return width; }
 	int getHeight() const { return height; }
 	int getSize() const { return height * width; }
+	// Размер буфера значений в байтах
+	size_t getByteSize() const { return matrix.size() * sizeof(T); }
+	// Значения матрицы, записанные подряд по строкам
+	const T* data() const { return matrix.data(); }
+	T* data() { return matrix.data(); }
+
+	Matrix& operator=(const Matrix& right);
+	Matrix& operator=(Matrix&& right) = default;
+	template<typename E>
+	Matrix& operator=(const MatrixExpr<E>& expr);
+	T& operator[](int i);
 
-	DoubleMatrix& operator=(const DoubleMatrix& right);
-	DoubleMatrix& operator=(DoubleMatrix&& right) = default;
-	double& operator[](int i);
-	friend DoubleMatrix operator+(const DoubleMatrix& a, const DoubleMatrix& b);
-	friend DoubleMatrix operator+(const DoubleMatrix& a, double b);
-	friend DoubleMatrix operator+(double a, const DoubleMatrix& b);
-	friend DoubleMatrix operator-(const DoubleMatrix& a, const DoubleMatrix& b);
-	friend DoubleMatrix operator-(const DoubleMatrix& a, double b);
-	friend DoubleMatrix operator*(const DoubleMatrix& a, const DoubleMatrix& b);
-	friend DoubleMatrix operator*(const DoubleMatrix& a, double b);
-	friend DoubleMatrix operator*(double a, const DoubleMatrix& b);
-	friend DoubleMatrix operator/(const DoubleMatrix& a, const DoubleMatrix& b);
-	friend DoubleMatrix operator/(const DoubleMatrix& a, double b);
-
-	DoubleMatrix& fillMatrix(double val);
-	void set(int i, int j, double val);
-	void set(int i, double val);
+	Matrix& fillMatrix(T val);
+	void set(int i, int j, T val);
+	void set(int i, T val);
 	// Возвращает пиксель на позиции (i, j) или заданый пиксель за границей изображения
-	double get(int i, int j) const;
+	T get(int i, int j) const;
 	// Возвращает пиксель на позиции (i, j)
-	double at(int i, int j) const { return matrix[i * width + j]; }
-	double at(int i) const { return matrix[i]; }
+	T at(int i, int j) const { return matrix[i * width + j]; }
+	T at(int i) const { return matrix[i]; }
+	// Изменяет размер матрицы; буфер сохраняется, если число элементов не меняется (значения не определены)
+	void setSize(int w, int h);
 
 	// Свертка по строке
-	DoubleMatrix convolutionRow(const DoubleMatrix& other) const;
+	Matrix convolutionRow(const Matrix& other) const;
 	// Свертка по столбцу (ядро задается в виде строки)
-	DoubleMatrix convolutionCol(const DoubleMatrix& other) const;
+	Matrix convolutionCol(const Matrix& other) const;
+	// Свертки по строке и по столбцу с записью в result (буфер result переиспользуется, result != this)
+	void convolutionRow(const Matrix& other, Matrix& result) const;
+	void convolutionCol(const Matrix& other, Matrix& result) const;
 	// Свертка по прямоугольному ядру
-	DoubleMatrix convolution(const DoubleMatrix& other) const;
+	Matrix convolution(const Matrix& other) const;
+	// Минимальный и максимальный элементы (считаются параллельно полосами), для пустой матрицы - нули
+	std::pair<T, T> minMax() const;
 	// Нормирование матрицы
-	DoubleMatrix& normalize(double newMin, double newMax);
+	Matrix& normalize(double newMin, double newMax);
+	// Нормирование при известных минимуме и максимуме элементов
+	Matrix& normalize(double newMin, double newMax, double minEl, double maxEl);
 	// Возвращает копию транспонированной матрицы
-	DoubleMatrix transpose();
-	// Возвращает результат применения оператора Собеля  
-	DoubleMatrix calcSobel() const;
+	Matrix transpose();
+	// Возвращает результат применения оператора Собеля
+	Matrix calcSobel() const;
 	// Возвращает результат применения фильтра Гаусса
-	DoubleMatrix gaussian(double sigma) const;
+	Matrix gaussian(double sigma) const;
+	// Фильтр Гаусса с записью в result, buffer - промежуточный результат свертки по строке
+	void gaussian(double sigma, Matrix& result, Matrix& buffer) const;
 	// Возвращает производную по X
-	DoubleMatrix dx() const;
+	Matrix dx() const;
 	// Возвращает производную по Y
-	DoubleMatrix dy() const;
-	DoubleMatrix add(double val) const;
-	DoubleMatrix add(const DoubleMatrix& mat) const;
-	DoubleMatrix sub(double val) const;
-	DoubleMatrix sub(const DoubleMatrix& mat) const;
-	DoubleMatrix mul(double val) const;
-	DoubleMatrix mul(const DoubleMatrix& mat) const;
-	DoubleMatrix div(const DoubleMatrix& mat) const;
-	DoubleMatrix div(double val) const;
+	Matrix dy() const;
+	// Производные с записью в result, buffer - промежуточный результат свертки по строке
+	void dx(Matrix& result, Matrix& buffer) const;
+	void dy(Matrix& result, Matrix& buffer) const;
+	Matrix add(double val) const;
+	Matrix add(const Matrix& mat) const;
+	Matrix sub(double val) const;
+	Matrix sub(const Matrix& mat) const;
+	Matrix mul(double val) const;
+	Matrix mul(const Matrix& mat) const;
+	Matrix div(const Matrix& mat) const;
+	Matrix div(double val) const;
 	double sum() const;
-	DoubleMatrix abs() const;
-	bool allClose(DoubleMatrix& other, double eps);
+	Matrix abs() const;
+	bool allClose(Matrix& other, double eps);
+	// Максимум по окну (2 * radiusY + 1) x (2 * radiusX + 1) вокруг каждого элемента с учетом границ,
+	// O(1) сравнений на элемент независимо от размера окна
+	Matrix maxFilter(int radiusY, int radiusX) const;
 	// Уменьшает размер изображения в два раза
-	DoubleMatrix downsample(int pow = 1);
+	Matrix downsample(int pow = 1) const;
+	void downsample(Matrix& result, int pow = 1) const;
 	void printMatrix() const;
+	// Возвращает копию матрицы с элементами другого типа
+	template<typename U>
+	Matrix<U> cast() const;
 
-	void sort(std::function<bool(double, double)> comp) { std::sort(begin(matrix), end(matrix), comp); }
+	void sort(std::function<bool(T, T)> comp) { std::sort(begin(matrix), end(matrix), comp); }
 
-	DoubleMatrix& norm1() { return normalize(0, 1); }
-	DoubleMatrix& norm255() { return normalize(0, 255); }
-	// Детектор углов Моравека
-	DoubleMatrix operatorMoravec(int windowSize) const;
+	Matrix& norm1() { return normalize(0, 1); }
+	Matrix& norm255() { return normalize(0, 255); }
+	// Детектор углов Моравека (суммы по окну считаются бегущими суммами, O(1) на пиксель).
+	// Порядок суммирования другой, поэтому с operatorMoravecDirect результат совпадает только с точностью до округления
+	Matrix operatorMoravec(int windowSize) const;
+	// Детектор углов Моравека с прямым суммированием окна для каждого сдвига, O(windowSize^2) на пиксель
+	Matrix operatorMoravecDirect(int windowSize) const;
 	// Детектор углов Харриса
-	DoubleMatrix operatorHarris(int windowSize) const;
+	Matrix operatorHarris(int windowSize) const;
+	// Детектор углов Харриса с записью отклика в result
+	void operatorHarris(int windowSize, Matrix& result) const;
 
-	DoubleMatrix gradientDirection() const;
+	Matrix gradientDirection() const;
+	// Модуль (как calcSobel) и направление (как gradientDirection) градиента за один проход, dx и dy вычисляются один раз.
+	// fastAtan - направление по приближению atan2 с ошибкой не больше SimdKernels::FastAtan2Error.
+	// Буферы magnitude и direction того же размера переиспользуются
+	void gradient(Matrix& magnitude, Matrix& direction, bool fastAtan = false) const;
+	// То же с производными в gX и gY и промежуточной сверткой в buffer (буферы переиспользуются)
+	void gradient(Matrix& magnitude, Matrix& direction, Matrix& gX, Matrix& gY, Matrix& buffer, bool fastAtan = false) const;
 
-	// Установка типа заполнения границ изображения
-	static void setDefaultBoderType(BorderType type);
 	// Копирует изображение с добавлением границ
-	static void copyWithBorder(const DoubleMatrix& src, DoubleMatrix* dest, int xOffset, int yOffset);
+	static void copyWithBorder(const Matrix& src, Matrix* dest, int xOffset, int yOffset);
 	// Свертка по прямоугольному ядру
-	static DoubleMatrix convolution(const DoubleMatrix& f, const DoubleMatrix& h);
-	static DoubleMatrix createGaussian(int width, int height, double sigma);
-	static DoubleMatrix createGaussian(double sigma);
+	static Matrix convolution(const Matrix& f, const Matrix& h);
+	static Matrix createGaussian(int width, int height, double sigma);
+	static Matrix createGaussian(double sigma);
 	// Создает ядро фильтра Гаусса в виде строки заданной ширины
-	static DoubleMatrix createGaussianRow(int width, double sigma);
-	static DoubleMatrix createGaussianRow(double sigma);
+	static Matrix createGaussianRow(int width, double sigma);
+	static Matrix createGaussianRow(double sigma);
 };
+
+// Типы узлов, которые строят операторы выражений
+template<typename L, typename R, template<typename> class Op>
+using MatrixBinaryExprOf = MatrixBinaryExpr<typename MatrixExprOperand<L>::Type, typename MatrixExprOperand<R>::Type,
+	Op<typename std::decay<L>::type::ValueType>>;
+template<typename E, template<typename> class Op>
+using MatrixScalarExprOf = MatrixScalarExpr<typename MatrixExprOperand<E>::Type, Op<double>>;
+
+template<typename L, typename R, typename = typename std::enable_if<IsMatrixExpr<L>::value && IsMatrixExpr<R>::value>::type>
+inline MatrixBinaryExprOf<L, R, std::plus> operator+(L&& a, R&& b) { return { std::forward<L>(a), std::forward<R>(b) }; }
+template<typename L, typename = typename std::enable_if<IsMatrixExpr<L>::value>::type>
+inline MatrixScalarExprOf<L, std::plus> operator+(L&& a, double b) { return { std::forward<L>(a), b }; }
+template<typename R, typename = typename std::enable_if<IsMatrixExpr<R>::value>::type>
+inline MatrixScalarExprOf<R, std::plus> operator+(double a, R&& b) { return { std::forward<R>(b), a }; }
+template<typename L, typename R, typename = typename std::enable_if<IsMatrixExpr<L>::value && IsMatrixExpr<R>::value>::type>
+inline MatrixBinaryExprOf<L, R, std::minus> operator-(L&& a, R&& b) { return { std::forward<L>(a), std::forward<R>(b) }; }
+template<typename L, typename = typename std::enable_if<IsMatrixExpr<L>::value>::type>
+inline MatrixScalarExprOf<L, std::minus> operator-(L&& a, double b) { return { std::forward<L>(a), b }; }
+template<typename L, typename R, typename = typename std::enable_if<IsMatrixExpr<L>::value && IsMatrixExpr<R>::value>::type>
+inline MatrixBinaryExprOf<L, R, std::multiplies> operator*(L&& a, R&& b) { return { std::forward<L>(a), std::forward<R>(b) }; }
+template<typename L, typename = typename std::enable_if<IsMatrixExpr<L>::value>::type>
+inline MatrixScalarExprOf<L, std::multiplies> operator*(L&& a, double b) { return { std::forward<L>(a), b }; }
+template<typename R, typename = typename std::enable_if<IsMatrixExpr<R>::value>::type>
+inline MatrixScalarExprOf<R, std::multiplies> operator*(double a, R&& b) { return { std::forward<R>(b), a }; }
+template<typename L, typename R, typename = typename std::enable_if<IsMatrixExpr<L>::value && IsMatrixExpr<R>::value>::type>
+inline MatrixBinaryExprOf<L, R, std::divides> operator/(L&& a, R&& b) { return { std::forward<L>(a), std::forward<R>(b) }; }
+template<typename L, typename = typename std::enable_if<IsMatrixExpr<L>::value>::type>
+inline MatrixScalarExprOf<L, std::divides> operator/(L&& a, double b) { return { std::forward<L>(a), b }; }
+
+template<typename T>
+template<typename E>
+inline Matrix<T>::Matrix(const MatrixExpr<E>& expr): width(0), height(0)
+{
+	*this = expr;
+}
+
+template<typename T>
+template<typename E>
+inline Matrix<T>& Matrix<T>::operator=(const MatrixExpr<E>& expr)
+{
+	static_assert(std::is_same<typename E::ValueType, T>::value, "Matrix expression element type mismatch");
+	const E& e = expr.self();
+	if (e.getSize() != getSize()) {
+		allocationCount++;
+		matrix.resize(e.getSize());
+	}
+	width = e.getWidth();
+	height = e.getHeight();
+	T* dst = matrix.data();
+	ThreadPool::global().parallelFor(0, getSize(), ThreadPool::MinBandElements, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			dst[i] = e.at(i);
+		}
+	});
+	return *this;
+}
+
+template<typename T>
+template<typename U>
+inline Matrix<U> Matrix<T>::cast() const
+{
+	Matrix<U> result(width, height);
+	std::transform(begin(matrix), end(matrix), begin(result.matrix), [](T x) { return static_cast<U>(x); });
+	return result;
+}
+
+using DoubleMatrix = Matrix<double>;
+using FloatMatrix = Matrix<float>;
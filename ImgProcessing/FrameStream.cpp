@@ -0,0 +1,38 @@
+#include "FrameStream.h"
+#include "LabImage.h"
+#include "KeyPointHelper.h"
+
+template<typename T>
+BasicFrameStream<T>::BasicFrameStream(const Settings& settings): settings(settings), extractor(1, 1, 1), frameCount(0) {}
+
+template<typename T>
+std::pair<std::vector<KeyPoint>, DescriptorSet> BasicFrameStream<T>::process(const QImage& frame)
+{
+	LabImage::toGrayMatrix(frame, image);
+	return processImage();
+}
+
+template<typename T>
+std::pair<std::vector<KeyPoint>, DescriptorSet> BasicFrameStream<T>::process(const Matrix<T>& frame)
+{
+	image = frame;
+	return processImage();
+}
+
+template<typename T>
+std::pair<std::vector<KeyPoint>, DescriptorSet> BasicFrameStream<T>::processImage()
+{
+	BasicPyramid<T>::createWithOverlap(image, settings.sigmaA, settings.sigma0, settings.octaveCount, settings.levelCount, settings.overlap, pyramid);
+	pyramid.createDoGPyramid(doG);
+	std::vector<KeyPoint> points = KeyPointHelper::findExtremePoints(pyramid, doG, harrisImages, settings.harrisThreshold, settings.harrisWindowSize);
+
+	// Градиенты предыдущего кадра сбрасываются, их буферы переходят к новому кадру
+	if (gradients) gradients->reset();
+	else gradients.reset(new BasicGradientPyramid<T>(pyramid));
+
+	frameCount++;
+	return extractor.computeScaleSet<float>(pyramid, *gradients, points);
+}
+
+template class BasicFrameStream<double>;
+template class BasicFrameStream<float>;
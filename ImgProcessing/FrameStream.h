@@ -0,0 +1,66 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include "DoubleMatrix.h"
+#include "KeyPoint.h"
+#include "Pyramid.h"
+#include "GradientPyramid.h"
+#include "DescriptorExtractor.h"
+#include "DescriptorSet.h"
+class QImage;
+// Обработка последовательности кадров одного размера конвейером --pyramid: пирамида с дополнительными изображениями,
+// DoG, экстремумы с отбором по оператору Харриса и дескрипторы computeScale.
+// Яркость кадра, пирамида, DoG, градиенты и отклики Харриса хранятся между кадрами и перезаписываются на месте,
+// поэтому начиная со второго кадра того же размера память под изображения конвейера не выделяется
+template<typename T>
+class BasicFrameStream
+{
+public:
+	// Параметры конвейера (значения --pyramid и --harris)
+	struct Settings
+	{
+		double sigmaA = 0.5;
+		double sigma0 = 1.6;
+		int octaveCount = 4;
+		int levelCount = 4;
+		int overlap = 2;
+		double harrisThreshold = 0.002;
+		double harrisWindowSize = 5;
+	};
+
+private:
+	Settings settings;
+	DescriptorExtractor extractor;
+	// Яркость текущего кадра
+	Matrix<T> image;
+	BasicPyramid<T> pyramid;
+	BasicPyramid<T> doG;
+	// Ленивая пирамида градиентов над pyramid, создается при обработке первого кадра
+	std::unique_ptr<BasicGradientPyramid<T>> gradients;
+	// Отклики Харриса по индексам изображений пирамиды
+	std::vector<Matrix<T>> harrisImages;
+	// Число обработанных кадров
+	int frameCount;
+
+	// Обработка кадра, записанного в image
+	std::pair<std::vector<KeyPoint>, DescriptorSet> processImage();
+
+public:
+	explicit BasicFrameStream(const Settings& settings);
+	BasicFrameStream(const BasicFrameStream&) = delete;
+	BasicFrameStream& operator=(const BasicFrameStream&) = delete;
+
+	// Обработка следующего кадра: точки в координатах кадра и их дескрипторы
+	std::pair<std::vector<KeyPoint>, DescriptorSet> process(const QImage& frame);
+	// Обработка кадра, уже преобразованного в яркость в диапазоне [0, 1]
+	std::pair<std::vector<KeyPoint>, DescriptorSet> process(const Matrix<T>& frame);
+
+	const Settings& getSettings() const { return settings; }
+	int getFrameCount() const { return frameCount; }
+	const Matrix<T>& getImage() const { return image; }
+	BasicPyramid<T>& getPyramid() { return pyramid; }
+	BasicPyramid<T>& getDoG() { return doG; }
+};
+
+using FrameStream = BasicFrameStream<double>;
+using FloatFrameStream = BasicFrameStream<float>;
@@ -0,0 +1,45 @@
+#include "GradientPyramid.h"
+
+template<typename T>
+BasicGradientPyramid<T>::BasicGradientPyramid(BasicPyramid<T>& pyramid, bool fastAtan):
+	pyramid(pyramid), levels(new Level[pyramid.get().size()]), levelCount(static_cast<int>(pyramid.get().size())), fastAtan(fastAtan) {}
+
+template<typename T>
+typename BasicGradientPyramid<T>::Level& BasicGradientPyramid<T>::materialize(int i)
+{
+	Level& level = levels[i];
+	std::call_once(level.computed, [&]() {
+		pyramid.getImage(i).gradient(level.magnitude, level.direction, level.gX, level.gY, level.buffer, fastAtan);
+		level.materialized = true;
+	});
+	return level;
+}
+
+template<typename T>
+void BasicGradientPyramid<T>::reset()
+{
+	int count = static_cast<int>(pyramid.get().size());
+	std::unique_ptr<Level[]> fresh(new Level[count]);
+	for (int i = 0; i < std::min(count, levelCount); i++) {
+		fresh[i].magnitude = std::move(levels[i].magnitude);
+		fresh[i].direction = std::move(levels[i].direction);
+		fresh[i].gX = std::move(levels[i].gX);
+		fresh[i].gY = std::move(levels[i].gY);
+		fresh[i].buffer = std::move(levels[i].buffer);
+	}
+	levels = std::move(fresh);
+	levelCount = count;
+}
+
+template<typename T>
+std::vector<int> BasicGradientPyramid<T>::getMaterializedLevels() const
+{
+	std::vector<int> result;
+	for (int i = 0; i < levelCount; i++) {
+		if (levels[i].materialized) result.push_back(i);
+	}
+	return result;
+}
+
+template class BasicGradientPyramid<double>;
+template class BasicGradientPyramid<float>;
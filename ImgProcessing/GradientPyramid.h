@@ -0,0 +1,55 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include "Pyramid.h"
+// Ленивая пирамида градиентов: модуль и направление градиента изображения пирамиды вычисляются
+// при первом обращении к нему и сохраняются. Обращения из разных потоков безопасны
+template<typename T>
+class BasicGradientPyramid
+{
+private:
+	struct Level
+	{
+		std::once_flag computed;
+		std::atomic<bool> materialized{ false };
+		Matrix<T> magnitude;
+		Matrix<T> direction;
+		// Производные и промежуточная свертка, переиспользуются после reset
+		Matrix<T> gX;
+		Matrix<T> gY;
+		Matrix<T> buffer;
+	};
+
+	BasicPyramid<T>& pyramid;
+	std::unique_ptr<Level[]> levels;
+	int levelCount;
+	// Направления по приближению atan2 (Matrix::gradient)
+	bool fastAtan;
+
+	// Вычисляет градиент изображения i, если он еще не вычислен
+	Level& materialize(int i);
+
+public:
+	explicit BasicGradientPyramid(BasicPyramid<T>& pyramid, bool fastAtan = false);
+	BasicGradientPyramid(const BasicGradientPyramid&) = delete;
+	BasicGradientPyramid& operator=(const BasicGradientPyramid&) = delete;
+
+	// Модуль градиента изображения с индексом i в пирамиде
+	const Matrix<T>& getMagnitude(int i) { return materialize(i).magnitude; }
+	// Направление градиента изображения с индексом i в пирамиде
+	const Matrix<T>& getDirection(int i) { return materialize(i).direction; }
+	// Индекс изображения октавы, ближайшего к заданной сигме (как BasicPyramid::getBySigma)
+	int getIndexBySigma(int octave, double sigma) { return pyramid.getIndexBySigma(octave, sigma); }
+
+	int getLevelCount() const { return levelCount; }
+	// Сбрасывает вычисленные градиенты после перестроения пирамиды (например, для следующего кадра).
+	// Буферы модулей, направлений и производных сохраняются и перезаписываются при следующем обращении
+	void reset();
+	// Индексы изображений, для которых градиент уже вычислен
+	std::vector<int> getMaterializedLevels() const;
+};
+
+using GradientPyramid = BasicGradientPyramid<double>;
+using FloatGradientPyramid = BasicGradientPyramid<float>;
@@ -0,0 +1,68 @@
+#include "ImageWriter.h"
+
+std::unique_ptr<ImageWriter> ImageWriter::globalWriter;
+std::once_flag ImageWriter::globalWriterFlag;
+
+ImageWriter::ImageWriter(): writing(false), stopping(false), failedCount(0)
+{
+	worker = std::thread(&ImageWriter::workerLoop, this);
+}
+
+ImageWriter::~ImageWriter()
+{
+	{
+		std::lock_guard<std::mutex> lock(tasksMutex);
+		stopping = true;
+	}
+	tasksCondition.notify_all();
+	worker.join();
+}
+
+void ImageWriter::workerLoop()
+{
+	while (true) {
+		Task task;
+		{
+			std::unique_lock<std::mutex> lock(tasksMutex);
+			tasksCondition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+			if (tasks.empty()) return;
+			task = std::move(tasks.front());
+			tasks.pop_front();
+			writing = true;
+		}
+		bool saved = task.image.save(task.fileName);
+		{
+			std::lock_guard<std::mutex> lock(tasksMutex);
+			writing = false;
+			if (!saved) failedCount++;
+		}
+		idleCondition.notify_all();
+	}
+}
+
+void ImageWriter::save(const QImage& image, const QString& fileName)
+{
+	{
+		std::lock_guard<std::mutex> lock(tasksMutex);
+		tasks.push_back({ image, fileName });
+	}
+	tasksCondition.notify_one();
+}
+
+void ImageWriter::wait()
+{
+	std::unique_lock<std::mutex> lock(tasksMutex);
+	idleCondition.wait(lock, [this]() { return tasks.empty() && !writing; });
+}
+
+int ImageWriter::getFailedCount()
+{
+	std::lock_guard<std::mutex> lock(tasksMutex);
+	return failedCount;
+}
+
+ImageWriter& ImageWriter::global()
+{
+	std::call_once(globalWriterFlag, []() { globalWriter.reset(new ImageWriter()); });
+	return *globalWriter;
+}
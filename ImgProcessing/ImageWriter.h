@@ -0,0 +1,52 @@
+#pragma once
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <QtGui>
+// Фоновая запись изображений в файлы одним потоком ввода-вывода:
+// кодирование и запись идут параллельно с вычислениями вызывающего потока
+class ImageWriter
+{
+private:
+	// Общий поток записи
+	static std::unique_ptr<ImageWriter> globalWriter;
+	static std::once_flag globalWriterFlag;
+
+	struct Task
+	{
+		QImage image;
+		QString fileName;
+	};
+
+	std::thread worker;
+	std::deque<Task> tasks;
+	std::mutex tasksMutex;
+	// Появление задачи или остановка
+	std::condition_variable tasksCondition;
+	// Очередь опустела и текущая запись завершена
+	std::condition_variable idleCondition;
+	bool writing;
+	bool stopping;
+	// Число неудачных записей с момента создания
+	int failedCount;
+
+	// Цикл потока записи
+	void workerLoop();
+public:
+	ImageWriter();
+	ImageWriter(const ImageWriter&) = delete;
+	ImageWriter& operator=(const ImageWriter&) = delete;
+	// Дописывает оставшиеся изображения и останавливает поток
+	~ImageWriter();
+
+	// Ставит изображение в очередь записи (QImage разделяет данные, копирования пикселей нет)
+	void save(const QImage& image, const QString& fileName);
+	// Ожидание записи всех поставленных в очередь изображений
+	void wait();
+	int getFailedCount();
+
+	// Общий поток записи (создается при первом обращении, в том числе одновременном из нескольких потоков)
+	static ImageWriter& global();
+};
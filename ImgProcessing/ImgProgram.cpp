@@ -1,13 +1,28 @@
 #include <iostream>
 #include <chrono>
+#include <mutex>
+#include <algorithm>
 #include "ImgProgram.h"
 #include "LabImage.h"
 #include "Pyramid.h"
 #include "KeyPointHelper.h"
 #include "DescriptorExtractor.h"
+#include "Benchmark.h"
+#include "ThreadPool.h"
+#include "KDForest.h"
+#include "KeyPointFile.h"
+#include "FrameStream.h"
+#include "ImageWriter.h"
 
 using chronoClock = std::chrono::high_resolution_clock;
 using chronoMs = std::chrono::milliseconds;
+using chronoFloatMs = std::chrono::duration<double, std::milli>;
+
+namespace
+{
+	// ,       
+	const char* BatchImageFilters = "*.png *.jpg *.jpeg *.bmp *.tif *.tiff *.pgm *.ppm";
+}
 
 
 void ImgProgram::processLab1Option(DoubleMatrix& source)
@@ -19,10 +34,10 @@ void ImgProgram::processLab1Option(DoubleMatrix& source)
 	DoubleMatrix sobel = source.calcSobel();
 	DoubleMatrix gauss = source.gaussian(sigma);
 
-	LabImage::saveImage(dx, "out-dx.jpg");
-	LabImage::saveImage(dy, "out-dy.jpg");
-	LabImage::saveImage(sobel, "out-sobel.jpg");
-	LabImage::saveImage(gauss, "out-gauss.jpg");
+	LabImage::saveImage(dx, getOutputFileName("out-dx.jpg"));
+	LabImage::saveImage(dy, getOutputFileName("out-dy.jpg"));
+	LabImage::saveImage(sobel, getOutputFileName("out-sobel.jpg"));
+	LabImage::saveImage(gauss, getOutputFileName("out-gauss.jpg"));
 }
 
 void ImgProgram::processPyramidOption(DoubleMatrix& source)
@@ -31,7 +46,7 @@ void ImgProgram::processPyramidOption(DoubleMatrix& source)
 		std::vector<double> pyramidVals = parseDoubleVector(parser.value(pyramidOption), ";");
 		if (pyramidVals.size() == 4) {
 			auto pyramid = Pyramid::createFrom(source, pyramidVals[0], pyramidVals[1], pyramidVals[2], pyramidVals[3]);
-			pyramid.saveImage(applicationDirPath + "\\pyramid");
+			pyramid.saveImage(getOutputFileName(applicationDirPath + "\\pyramid"));
 			if (parser.isSet(lOption)) {
 				std::vector<double> lVals = parseDoubleVector(parser.value(lOption), ";");
 				if (lVals.size() == 3) {
@@ -103,7 +118,7 @@ void ImgProgram::callCornerDetectorMethod(char method, DoubleMatrix& source, Dou
 	}
 	std::cout << " point count = " << points.size() << std::endl;
 	printValues({ "winSize", "pSize", "threshold" }, params);
-	QImage qimg = LabImage::getImageFromMatrix(DoubleMatrix(source).norm255());
+	QImage qimg = LabImage::toGrayImage(source).convertToFormat(QImage::Format_RGB32);
 	LabImage result(qimg);
 
 	result.drawKeyPoints(points, pointsColor);
@@ -165,7 +180,7 @@ void ImgProgram::processDescriptorOption(DoubleMatrix& source1, DoubleMatrix sou
 		threshold = parseDoubleOrDefault(value(thresholdOption), threshold);
 	}
 
-	auto matches = DescriptorExtractor::findMatches(ds, ds2, threshold);
+	auto matches = matchDescriptors(ds, ds2, threshold);
 	QImage mainCopy = LabImage::getImageFromMatrix(source1.norm255());
 	QImage secondCopy = LabImage::getImageFromMatrix(source2.norm255());
 
@@ -202,7 +217,8 @@ void ImgProgram::processLab6Option(DoubleMatrix& source1, DoubleMatrix& source2)
 			auto result2 = extractor.computeScale(pyramid2, extreme2);
 			auto kp1 = result1.first;
 			auto kp2 = result2.first;
-			auto matches = DescriptorExtractor::findMatches(result1.second, result2.second, getThreshold(0.8));
+			auto matches = matchDescriptors(result1.second, result2.second, getThreshold(0.8));
+			processKeyPointFileOptions(result1.first, result1.second);
 			
 			QImage copy1 = LabImage::getImageFromMatrix(source1.norm255());
 			QImage copy2 = LabImage::getImageFromMatrix(source2.norm255());
@@ -215,10 +231,10 @@ void ImgProgram::processLab6Option(DoubleMatrix& source1, DoubleMatrix& source2)
 			resultImg.save(applicationDirPath + "\\match-" + sourceFilesInfo[0].baseName() + "-" + sourceFilesInfo[1].baseName() + ".png");
 
 			if (isSet(savePyramidsOption)) {
-				doG1.saveImage(applicationDirPath + "\\DoG1");
-				doG2.saveImage(applicationDirPath + "\\DoG2");
-				pyramid1.saveImage(applicationDirPath + "\\pyramid1");
-				pyramid2.saveImage(applicationDirPath + "\\pyramid2");
+				doG1.saveImage(getOutputFileName(applicationDirPath + "\\DoG1"));
+				doG2.saveImage(getOutputFileName(applicationDirPath + "\\DoG2"));
+				pyramid1.saveImage(getOutputFileName(applicationDirPath + "\\pyramid1"));
+				pyramid2.saveImage(getOutputFileName(applicationDirPath + "\\pyramid2"));
 			}
 		}
 		else {
@@ -227,6 +243,83 @@ void ImgProgram::processLab6Option(DoubleMatrix& source1, DoubleMatrix& source2)
 	}
 }
 
+void ImgProgram::processKeyPointFileOptions(const std::vector<KeyPoint>& points, const std::vector<Descriptor>& descriptors)
+{
+	if (isSet(saveKpdOption)) {
+		QString fileName = getOutputFileName(value(saveKpdOption));
+		if (!KeyPointFile::save(fileName, points, descriptors)) {
+			std::cout << "Can't save keypoints to " << fileName.toStdString() << std::endl;
+		}
+	}
+	if (isSet(galleryOption)) {
+		//       
+		std::vector<KeyPoint> galleryPoints;
+		std::vector<std::pair<int, int>> matches;
+		QString fileName = value(galleryOption);
+		bool loaded;
+		if (isSet(checksOption)) {
+			// KD-     
+			std::vector<Descriptor> galleryDescriptors;
+			loaded = KeyPointFile::load(fileName, galleryPoints, galleryDescriptors);
+			if (loaded) matches = matchDescriptors(descriptors, galleryDescriptors, getThreshold(0.8));
+		}
+		else {
+			//        ,     
+			DoubleDescriptorSet gallery;
+			loaded = KeyPointFile::load(fileName, galleryPoints, gallery);
+			if (loaded) matches = DescriptorExtractor::findMatches(DoubleDescriptorSet(descriptors), gallery, getThreshold(0.8));
+		}
+		if (!loaded) {
+			std::cout << "Can't load keypoints from " << fileName.toStdString() << std::endl;
+			return;
+		}
+		std::cout << "Gallery " << fileName.toStdString() << ": " << galleryPoints.size() << " points, "
+			<< matches.size() << " matches" << std::endl;
+	}
+}
+
+void ImgProgram::processThreadsOption()
+{
+	if (!isSet(threadsOption)) return;
+	ThreadPool::setGlobalThreadCount(parseIntOrDefault(value(threadsOption), 0));
+	if (isSet(showInfoOption)) {
+		std::cout << "Threads: " << ThreadPool::getGlobalThreadCount() << std::endl;
+	}
+}
+
+void ImgProgram::processBenchmarkOption(DoubleMatrix& source)
+{
+	if (!isSet(benchmarkOption)) return;
+	Benchmark::run(value(benchmarkOption), source);
+}
+
+std::vector<std::pair<int, int>> ImgProgram::matchDescriptors(const std::vector<Descriptor>& a, const std::vector<Descriptor>& b, double threshold)
+{
+	if (!isSet(checksOption)) return DescriptorExtractor::findMatches(a, b, threshold);
+	KDForest forest(b);
+	return forest.match(a, threshold, parseIntOrDefault(value(checksOption), KDForest::DefaultChecks));
+}
+
+void ImgProgram::waitImageWriter()
+{
+	ImageWriter::global().wait();
+	int failedCount = ImageWriter::global().getFailedCount();
+	if (failedCount > 0) {
+		std::cout << "Images not saved: " << failedCount << std::endl;
+	}
+}
+
+QString ImgProgram::getOutputFileName(const QString& fileName)
+{
+	if (!batchJob) return fileName;
+	QStringList baseNames;
+	for (const QFileInfo& fileInfo : sourceFilesInfo) {
+		baseNames.append(fileInfo.baseName());
+	}
+	int nameStart = std::max(fileName.lastIndexOf('/'), fileName.lastIndexOf('\\')) + 1;
+	return fileName.left(nameStart) + baseNames.join("-") + "-" + fileName.mid(nameStart);
+}
+
 double ImgProgram::getThreshold(double dflt)
 {
 	if (isSet(thresholdOption)) return parseDoubleOrDefault(value(thresholdOption), dflt);
@@ -275,7 +368,18 @@ ImgProgram::ImgProgram(QCommandLineParser& parser) :
 	anmsOption("anms", "ANMS filter ", "anmsVal"),
 	descriptorOption("descriptor", "Simple Descriptor 'gridSize;cellCount;binCount", "descriptorVal"),
 	thresholdOption("t", "Threshold for some methods", "thresholdVal"),
-	savePyramidsOption("save-pyramid", "Save images from Gauss pyramid and DoG")
+	savePyramidsOption("save-pyramid", "Save images from Gauss pyramid and DoG"),
+	benchmarkOption("benchmark", "Run benchmark on the source image 'simd' | 'float' | 'threads' | 'moravec' | 'expr' | 'pool' | 'matcher' | 'anms' | 'pyramid' | 'gradient' | 'export'", "benchmarkName"),
+	threadsOption("threads", "Number of threads for image processing (default = 0 - number of CPU cores)", "threadCount", "0"),
+	checksOption("checks", "Match descriptors with KD-forest, comparing at most 'checks' descriptors per point (default - brute force)", "checksVal"),
+	saveKpdOption("save-kpd", "Save keypoints and descriptors of the first image (--pyramid mode) to a .kpd file", "kpdFile"),
+	galleryOption("gallery", "Match descriptors of the first image (--pyramid mode) with keypoints loaded from a .kpd file", "kpdFile"),
+	batchOption("batch", "Process every image of a directory, a file name pattern ('dir/*.png') or a manifest file (one 'image' or 'first;second' per line). "
+		"Output file names get the job's image names as a prefix, --benchmark is not supported", "batchSource"),
+	jobsOption("jobs", "Number of images processed at the same time in --batch mode (default = 1)", "jobCount", "1"),
+	streamOption("stream", "Process a sequence of frames (directory, file name pattern or manifest as in --batch) with the --pyramid pipeline, reusing buffers between frames", "streamSource"),
+	fpsOption("fps", "Target throughput in frames per second for --stream mode", "fpsVal"),
+	batchJob(false)
 {
 	parser.addHelpOption();
 	parser.addPositionalArgument("source", "Source Image(images)");
@@ -292,6 +396,15 @@ ImgProgram::ImgProgram(QCommandLineParser& parser) :
 	parser.addOption(descriptorOption);
 	parser.addOption(thresholdOption);
 	parser.addOption(savePyramidsOption);
+	parser.addOption(benchmarkOption);
+	parser.addOption(threadsOption);
+	parser.addOption(checksOption);
+	parser.addOption(saveKpdOption);
+	parser.addOption(galleryOption);
+	parser.addOption(batchOption);
+	parser.addOption(jobsOption);
+	parser.addOption(streamOption);
+	parser.addOption(fpsOption);
 }
 
 void ImgProgram::processParser(const QCoreApplication& app)
@@ -299,16 +412,193 @@ void ImgProgram::processParser(const QCoreApplication& app)
 	parser.process(app);
 	posArgs = parser.positionalArguments();
 
-	QStringList sourceFiles = posArgs[0].split(";");
-	for (QString& fileName : sourceFiles) {
+	if (!posArgs.isEmpty()) {
+		setSourceFiles(posArgs[0].split(";"));
+	}
+	applicationDirPath = app.applicationDirPath();
+}
+
+void ImgProgram::setSourceFiles(const QStringList& files)
+{
+	sourceFilesNames.clear();
+	sourceFilesInfo.clear();
+	for (const QString& fileName : files) {
 		sourceFilesNames.append(fileName);
 		sourceFilesInfo.append(QFileInfo(fileName));
 	}
-	applicationDirPath = app.applicationDirPath();
+}
+
+QList<QStringList> ImgProgram::collectBatchJobs(const QString& spec)
+{
+	QList<QStringList> jobs;
+	QStringList imageFilters = QString(BatchImageFilters).split(" ");
+	QFileInfo specInfo(spec);
+	if (specInfo.isDir()) {
+		// :   -  
+		for (const QFileInfo& fileInfo : QDir(spec).entryInfoList(imageFilters, QDir::Files, QDir::Name)) {
+			jobs.append(QStringList(fileInfo.absoluteFilePath()));
+		}
+	}
+	else if (specInfo.isFile() && !QDir::match(imageFilters, specInfo.fileName())) {
+		//  :  -    'first;second',    , # - 
+		QFile manifest(spec);
+		if (!manifest.open(QIODevice::ReadOnly | QIODevice::Text)) return jobs;
+		QTextStream stream(&manifest);
+		while (!stream.atEnd()) {
+			QString line = stream.readLine().trimmed();
+			if (line.isEmpty() || line.startsWith("#")) continue;
+			QStringList files;
+			for (const QString& fileName : line.split(";")) {
+				files.append(QFileInfo(specInfo.absoluteDir(), fileName.trimmed()).absoluteFilePath());
+			}
+			jobs.append(files);
+		}
+	}
+	else {
+		//    ('images/*.png')
+		QDir dir = specInfo.absoluteDir();
+		for (const QFileInfo& fileInfo : dir.entryInfoList(QStringList(specInfo.fileName()), QDir::Files, QDir::Name)) {
+			jobs.append(QStringList(fileInfo.absoluteFilePath()));
+		}
+	}
+	return jobs;
+}
+
+void ImgProgram::processBatchOption()
+{
+	if (isSet(benchmarkOption)) {
+		//     ,     
+		std::cout << "--benchmark can't be used with --batch" << std::endl;
+		return;
+	}
+	QList<QStringList> jobs = collectBatchJobs(value(batchOption));
+	int jobCount = jobs.size();
+	if (jobCount == 0) {
+		std::cout << "--batch: no images found for " << value(batchOption).toStdString() << std::endl;
+		return;
+	}
+
+	//       ,      -   
+	int workerCount = std::max(1, std::min(parseIntOrDefault(value(jobsOption), 1), jobCount));
+	//       (   --threads)
+	ThreadPool::global();
+	ThreadPool workers(workerCount);
+	std::vector<long long> times(jobCount);
+	std::mutex outputMutex;
+	auto startTime = chronoClock::now();
+	workers.parallelFor(0, jobCount, 1, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			//         ( )
+			ImgProgram job(*this);
+			job.batchJob = true;
+			job.setSourceFiles(jobs[i]);
+			auto jobStartTime = chronoClock::now();
+			job.processSources();
+			times[i] = std::chrono::duration_cast<chronoMs>(chronoClock::now() - jobStartTime).count();
+			std::lock_guard<std::mutex> lock(outputMutex);
+			std::cout << "[" << i + 1 << "/" << jobCount << "] " << jobs[i].join(";").toStdString() << ": " << times[i] << "ms" << std::endl;
+		}
+	});
+	waitImageWriter();
+	auto totalTime = std::chrono::duration_cast<chronoMs>(chronoClock::now() - startTime).count();
+
+	long long sum = 0;
+	for (long long time : times) sum += time;
+	std::cout << " --- Batch complete: " << jobCount << " jobs, " << workerCount << " workers, total " << totalTime << "ms"
+		<< ", mean " << sum / jobCount << "ms, max " << *std::max_element(times.begin(), times.end()) << "ms ---" << std::endl;
+}
+
+void ImgProgram::processStreamOption()
+{
+	QList<QStringList> frames = collectBatchJobs(value(streamOption));
+	int frameCount = frames.size();
+	if (frameCount == 0) {
+		std::cout << "--stream: no images found for " << value(streamOption).toStdString() << std::endl;
+		return;
+	}
+
+	FrameStream::Settings settings;
+	if (isSet(pyramidOption)) {
+		std::vector<double> pyramidVals = parseDoubleVector(value(pyramidOption), ";");
+		if (pyramidVals.size() != 4) {
+			std::cout << "--pyramid arguments is incorrect: " << value(pyramidOption).toStdString() << std::endl;
+			return;
+		}
+		settings.sigmaA = pyramidVals[0];
+		settings.sigma0 = pyramidVals[1];
+		settings.octaveCount = pyramidVals[2];
+		settings.levelCount = pyramidVals[3];
+	}
+	if (isSet(harrisDetectorOption)) {
+		std::vector<double> harrisVals = parseDoubleVector(value(harrisDetectorOption), ";");
+		if (harrisVals.size() >= 2) {
+			settings.harrisThreshold = harrisVals[0];
+			settings.harrisWindowSize = harrisVals[1];
+		}
+	}
+	double targetFps = parseDoubleOrDefault(value(fpsOption), 0);
+	//   ,      
+	double frameBudget = targetFps > 0 ? 1000.0 / targetFps : 0;
+
+	//   ,     
+	FrameStream stream(settings);
+	double decodeTime = 0;
+	double processTime = 0;
+	int lateFrames = 0;
+	auto startTime = chronoClock::now();
+	for (int i = 0; i < frameCount; i++) {
+		auto frameStartTime = chronoClock::now();
+		QImage frame(frames[i][0]);
+		if (frame.isNull()) {
+			std::cout << "[" << i + 1 << "/" << frameCount << "] " << frames[i][0].toStdString() << ": can't read image" << std::endl;
+			continue;
+		}
+		auto decodeEndTime = chronoClock::now();
+		auto result = stream.process(frame);
+		auto frameEndTime = chronoClock::now();
+
+		double frameDecodeTime = chronoFloatMs(decodeEndTime - frameStartTime).count();
+		double frameProcessTime = chronoFloatMs(frameEndTime - decodeEndTime).count();
+		decodeTime += frameDecodeTime;
+		processTime += frameProcessTime;
+		if (frameBudget > 0 && frameDecodeTime + frameProcessTime > frameBudget) lateFrames++;
+		std::cout << "[" << i + 1 << "/" << frameCount << "] " << frames[i][0].toStdString() << ": " << result.first.size() << " points, decode "
+			<< frameDecodeTime << "ms, process " << frameProcessTime << "ms" << std::endl;
+	}
+	double totalTime = chronoFloatMs(chronoClock::now() - startTime).count();
+
+	int processed = stream.getFrameCount();
+	if (processed == 0) return;
+	double fps = processed * 1000.0 / totalTime;
+	std::cout << " --- Stream complete: " << processed << " frames, total " << totalTime << "ms, mean decode " << decodeTime / processed
+		<< "ms, mean process " << processTime / processed << "ms, " << fps << " fps";
+	if (targetFps > 0) {
+		std::cout << ", target " << targetFps << " fps " << (fps >= targetFps ? "reached" : "missed")
+			<< " (" << lateFrames << " frames over " << frameBudget << "ms)";
+	}
+	std::cout << " ---" << std::endl;
 }
 
 void ImgProgram::processOptions()
 {
+	processThreadsOption();
+	if (isSet(streamOption)) {
+		processStreamOption();
+		return;
+	}
+	if (isSet(batchOption)) {
+		processBatchOption();
+		return;
+	}
+	processSources();
+}
+
+void ImgProgram::processSources()
+{
+	if (sourceFilesInfo.isEmpty()) {
+		std::cout << "Source image is not set" << std::endl;
+		return;
+	}
 	for (QFileInfo& fileInfo : sourceFilesInfo) {
 		if (!fileInfo.exists()) {
 			std::cout << "File " << fileInfo.fileName().toStdString() << " - file doesn't exist" << std::endl;
@@ -316,10 +606,15 @@ void ImgProgram::processOptions()
 		}
 	}
 
+	//  ,   [0, 1]
 	QImage qFirstImage(sourceFilesInfo[0].absoluteFilePath());
+	if (qFirstImage.isNull()) {
+		std::cout << "File " << sourceFilesInfo[0].fileName().toStdString() << " - can't read image" << std::endl;
+		return;
+	}
 	LabImage labFirstImage(qFirstImage);
-	IntMatrix intFirstImg = IntMatrix::fromImage(labFirstImage.getGrayScale());
-	DoubleMatrix doubleFirstImg = intFirstImg.toDoubleMatrix();
+	DoubleMatrix doubleFirstImg;
+	LabImage::toGrayMatrix(qFirstImage, doubleFirstImg);
 	if (isSet(showInfoOption)) {
 		std::cout << sourceFilesInfo[0].fileName().toStdString() << " ";
 		labFirstImage.printInfo();
@@ -329,19 +624,19 @@ void ImgProgram::processOptions()
 	DoubleMatrix doubleSecondImg;
 	if (sourceFilesInfo.size() > 1) {
 		QImage img(sourceFilesInfo[1].absoluteFilePath());
+		if (img.isNull()) {
+			std::cout << "File " << sourceFilesInfo[1].fileName().toStdString() << " - can't read image" << std::endl;
+			return;
+		}
 		qSecondImage = img.copy();
 		LabImage labSecondImage(img);
-		doubleSecondImg = labSecondImage.getDoubleMatrix();
+		LabImage::toGrayMatrix(img, doubleSecondImg);
 		if (isSet(showInfoOption)) {
 			std::cout << sourceFilesInfo[1].fileName().toStdString() << " ";
 			labSecondImage.printInfo();
 		}
-
-		doubleSecondImg.norm1();
 	}
 
-	doubleFirstImg.norm1();
-
 	auto startTime = chronoClock::now();
 
 	processLab1Option(doubleFirstImg);
@@ -349,6 +644,10 @@ void ImgProgram::processOptions()
 	processMoravecAndHarrisOption(doubleFirstImg);
 	processDescriptorOption(doubleFirstImg, doubleSecondImg);
 	processLab6Option(doubleFirstImg, doubleSecondImg);
+	processBenchmarkOption(doubleFirstImg);
+	//   --save-pyramid   ,    .
+	//  --batch   :  ,   processBatchOption
+	if (!batchJob) waitImageWriter();
 
 	auto endTime = chronoClock::now();
 	auto deltaTime = std::chrono::duration_cast<chronoMs>(endTime - startTime);
@@ -3,6 +3,7 @@
 #include <QtGui>
 #include <vector>
 #include "DoubleMatrix.h"
+#include "Descriptor.h"
 class ImgProgram
 {
 private:
@@ -19,11 +20,22 @@ private:
 	QCommandLineOption descriptorOption;
 	QCommandLineOption thresholdOption;
 	QCommandLineOption savePyramidsOption;
+	QCommandLineOption benchmarkOption;
+	QCommandLineOption threadsOption;
+	QCommandLineOption checksOption;
+	QCommandLineOption saveKpdOption;
+	QCommandLineOption galleryOption;
+	QCommandLineOption batchOption;
+	QCommandLineOption jobsOption;
+	QCommandLineOption streamOption;
+	QCommandLineOption fpsOption;
 
 	QStringList posArgs;
 	QString applicationDirPath;
 	QStringList sourceFilesNames;
 	QList<QFileInfo> sourceFilesInfo;
+	// Задание пакетной обработки: имена выходных файлов получают префикс из имен исходных изображений
+	bool batchJob;
 
 	bool isSet(const QCommandLineOption& option) { return parser.isSet(option); }
 	QString value(const QCommandLineOption& option) { return parser.value(option); }
@@ -35,6 +47,26 @@ private:
 	void processDescriptorOption(DoubleMatrix& source1, DoubleMatrix source2);
 
 	void processLab6Option(DoubleMatrix& source1, DoubleMatrix& source2);
+	void processBenchmarkOption(DoubleMatrix& source);
+	void processThreadsOption();
+	// Пакетная обработка: конвейер запускается для каждого изображения (пары) из --batch в пуле из --jobs потоков
+	void processBatchOption();
+	// Задания пакетной обработки: каталог, шаблон имени файла или файл со списком
+	static QList<QStringList> collectBatchJobs(const QString& spec);
+	// Потоковая обработка последовательности кадров из --stream (FrameStream) с отчетом о пропускной способности
+	void processStreamOption();
+	void setSourceFiles(const QStringList& files);
+	// Обработка текущего изображения (пары изображений)
+	void processSources();
+	// Сохранение точек и дескрипторов в файл .kpd и сопоставление с загруженной галереей
+	void processKeyPointFileOptions(const std::vector<KeyPoint>& points, const std::vector<Descriptor>& descriptors);
+
+	std::vector<std::pair<int, int>> matchDescriptors(const std::vector<Descriptor>& a, const std::vector<Descriptor>& b, double threshold);
+
+	// Ожидание фоновой записи изображений (ImageWriter) и вывод числа неудачных записей
+	void waitImageWriter();
+	// Имя выходного файла (каталога) с префиксом задания в режиме --batch
+	QString getOutputFileName(const QString& fileName);
 
 	double getThreshold(double dflt = 0.6);
 
@@ -1,5 +1,6 @@
 #include "IntMatrix.h"
 #include <iostream>
+#include <algorithm>
 
 IntMatrix::IntMatrix(int w, int h)
 { 
@@ -19,19 +20,18 @@ DoubleMatrix IntMatrix::toDoubleMatrix()
 	return result;
 }
 
-QImage IntMatrix::toImage()
+QImage IntMatrix::toImage() const
 {
 	int h = height;
 	int w = width;
 	QImage resultImage(w, h, QImage::Format::Format_RGB32);
 
 	for (int i = 0; i < h; i++) {
-		uchar* scan = resultImage.scanLine(i);
-		int offset = 4;
+		QRgb* scan = reinterpret_cast<QRgb*>(resultImage.scanLine(i));
+		const int* row = matrix.data() + i * w;
 		for (int j = 0; j < w; j++) {
-			QRgb* pixel = reinterpret_cast<QRgb*>(scan + j * offset);
-			int pixelColor = get(i, j);
-			*pixel = QColor(pixelColor, pixelColor, pixelColor).rgba();
+			int pixelColor = std::min(std::max(row[j], 0), 255);
+			scan[j] = qRgb(pixelColor, pixelColor, pixelColor);
 		}
 	}
 
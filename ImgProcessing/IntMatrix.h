@@ -22,7 +22,9 @@ public:
 	int getHeight() const { return height; }
 
 	DoubleMatrix toDoubleMatrix();
-	QImage toImage();
+	const int* data() const { return matrix.data(); }
+	// Изображение RGB32, значения ограничиваются [0, 255]
+	QImage toImage() const;
 	void saveImage(const QString& fileName);
 	void fillMatrix(int val);
 	int get(int i, int j) const;
@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <numeric>
+#include <queue>
+#include <cmath>
+#include <limits>
+#include "KDForest.h"
+#include "ThreadPool.h"
+#include "SimdKernels.h"
+
+namespace
+{
+	// Число точек, по которым оценивается разброс значений в узле
+	const int VarianceSampleSize = 128;
+	// Число самых изменчивых измерений, из которых случайно выбирается измерение разбиения
+	const int RandomDimCount = 5;
+
+	// Линейный конгруэнтный генератор, чтобы построение леса не зависело от реализации <random>
+	unsigned nextRandom(unsigned& seed)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		return seed >> 8;
+	}
+}
+
+KDForest::KDForest(const std::vector<Descriptor>& descriptors, int treeCount, int leafSize):
+	pointCount(static_cast<int>(descriptors.size())),
+	dims(descriptors.empty() ? 0 : descriptors[0].getSize()),
+	leafSize(std::max(1, leafSize))
+{
+	data.resize(pointCount * dims);
+	for (int i = 0; i < pointCount; i++) {
+		for (int d = 0; d < dims; d++) {
+			data[i * dims + d] = descriptors[i][d];
+		}
+	}
+
+	std::vector<double> mean(dims);
+	std::vector<double> variance(dims);
+	unsigned seed = 12345;
+	trees.resize(std::max(1, treeCount));
+	for (Tree& tree : trees) {
+		tree.indices.resize(pointCount);
+		std::iota(begin(tree.indices), end(tree.indices), 0);
+		// Перемешивание, чтобы выборка для оценки разброса была случайной
+		for (int i = pointCount - 1; i > 0; i--) {
+			std::swap(tree.indices[i], tree.indices[nextRandom(seed) % (i + 1)]);
+		}
+		if (pointCount > 0) buildNode(tree, 0, pointCount, mean, variance, seed);
+	}
+}
+
+int KDForest::buildNode(Tree& tree, int begin, int end, std::vector<double>& mean, std::vector<double>& variance, unsigned& seed)
+{
+	int nodeIndex = static_cast<int>(tree.nodes.size());
+	tree.nodes.push_back({ -1, 0, -1, -1, begin, end });
+	if (end - begin <= leafSize) return nodeIndex;
+
+	// Разброс значений по измерениям на выборке точек узла
+	int sampleCount = std::min(end - begin, VarianceSampleSize);
+	std::fill(mean.begin(), mean.end(), 0.0);
+	std::fill(variance.begin(), variance.end(), 0.0);
+	for (int i = begin; i < begin + sampleCount; i++) {
+		const double* point = &data[tree.indices[i] * dims];
+		for (int d = 0; d < dims; d++) mean[d] += point[d];
+	}
+	for (int d = 0; d < dims; d++) mean[d] /= sampleCount;
+	for (int i = begin; i < begin + sampleCount; i++) {
+		const double* point = &data[tree.indices[i] * dims];
+		for (int d = 0; d < dims; d++) variance[d] += (point[d] - mean[d]) * (point[d] - mean[d]);
+	}
+
+	// Случайное измерение из самых изменчивых
+	std::vector<int> order(dims);
+	std::iota(order.begin(), order.end(), 0);
+	int topCount = std::min(RandomDimCount, dims);
+	std::partial_sort(order.begin(), order.begin() + topCount, order.end(),
+		[&](int a, int b) { return variance[a] > variance[b]; });
+	int dim = order[nextRandom(seed) % topCount];
+	double value = mean[dim];
+
+	// Разбиение по среднему, при вырожденном разбиении - по медиане
+	auto middle = std::partition(tree.indices.begin() + begin, tree.indices.begin() + end,
+		[&](int index) { return data[index * dims + dim] < value; });
+	int split = static_cast<int>(middle - tree.indices.begin());
+	if (split == begin || split == end) {
+		split = (begin + end) / 2;
+		std::nth_element(tree.indices.begin() + begin, tree.indices.begin() + split, tree.indices.begin() + end,
+			[&](int a, int b) { return data[a * dims + dim] < data[b * dims + dim]; });
+		value = data[tree.indices[split] * dims + dim];
+	}
+
+	int left = buildNode(tree, begin, split, mean, variance, seed);
+	int right = buildNode(tree, split, end, mean, variance, seed);
+	Node& node = tree.nodes[nodeIndex];
+	node.dim = dim;
+	node.value = value;
+	node.left = left;
+	node.right = right;
+	return nodeIndex;
+}
+
+double KDForest::squaredDistance(const double* a, const double* b) const
+{
+	return SimdKernels::squaredDistance(a, b, dims);
+}
+
+void KDForest::findTwoNearest(const double* query, int maxChecks, std::vector<int>& visited, int stamp, Neighbor& first, Neighbor& second) const
+{
+	const double maxDistance = std::numeric_limits<double>::max();
+	first = { -1, maxDistance };
+	second = { -1, maxDistance };
+
+	// Ячейки для просмотра: нижняя граница расстояния, дерево, узел
+	struct Branch
+	{
+		double bound;
+		int tree;
+		int node;
+		bool operator<(const Branch& other) const { return bound > other.bound; }
+	};
+	std::priority_queue<Branch> branches;
+	for (int t = 0; t < static_cast<int>(trees.size()); t++) {
+		branches.push({ 0.0, t, 0 });
+	}
+
+	int checks = 0;
+	while (!branches.empty()) {
+		Branch branch = branches.top();
+		branches.pop();
+		// Оставшиеся ячейки не ближе второго соседа - результат точный
+		if (branch.bound >= second.distance) break;
+		if (checks >= maxChecks && second.index >= 0) break;
+
+		const Tree& tree = trees[branch.tree];
+		const Node* node = &tree.nodes[branch.node];
+		while (node->dim >= 0) {
+			double diff = query[node->dim] - node->value;
+			int nearChild = diff < 0 ? node->left : node->right;
+			int farChild = diff < 0 ? node->right : node->left;
+			branches.push({ std::max(branch.bound, diff * diff), branch.tree, farChild });
+			node = &tree.nodes[nearChild];
+		}
+
+		for (int i = node->begin; i < node->end; i++) {
+			int index = tree.indices[i];
+			if (visited[index] == stamp) continue;
+			visited[index] = stamp;
+			checks++;
+			double distance = squaredDistance(query, index);
+			if (distance < first.distance) {
+				second = first;
+				first = { index, distance };
+			}
+			else if (distance < second.distance) {
+				second = { index, distance };
+			}
+		}
+	}
+}
+
+void KDForest::findTwoNearest(const Descriptor& query, int maxChecks, Neighbor& first, Neighbor& second) const
+{
+	std::vector<double> point(dims);
+	for (int d = 0; d < dims; d++) point[d] = query[d];
+	std::vector<int> visited(pointCount, 0);
+	findTwoNearest(point.data(), maxChecks, visited, 1, first, second);
+}
+
+std::vector<std::pair<int, int>> KDForest::match(const std::vector<Descriptor>& queries, double threshold, int maxChecks) const
+{
+	int queryCount = static_cast<int>(queries.size());
+	// Индекс найденного соседа для каждого запроса или -1
+	std::vector<int> matched(queryCount, -1);
+
+	ThreadPool::global().parallelFor(0, queryCount, 16, [&](int queryBegin, int queryEnd) {
+		std::vector<double> point(dims);
+		std::vector<int> visited(pointCount, -1);
+		for (int q = queryBegin; q < queryEnd; q++) {
+			for (int d = 0; d < dims; d++) point[d] = queries[q][d];
+			Neighbor first, second;
+			findTwoNearest(point.data(), maxChecks, visited, q, first, second);
+			if (second.index < 0) continue;
+			// NNDR по евклидовым расстояниям
+			if (std::sqrt(first.distance) / std::sqrt(second.distance) < threshold) {
+				matched[q] = first.index;
+			}
+		}
+	});
+
+	std::vector<std::pair<int, int>> result;
+	for (int q = 0; q < queryCount; q++) {
+		if (matched[q] >= 0) result.push_back(std::make_pair(q, matched[q]));
+	}
+	return result;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include "Descriptor.h"
+// Рандомизированный лес KD-деревьев для приближенного поиска ближайших дескрипторов.
+// Каждое дерево делит точки по случайному измерению из самых изменчивых, поиск идет по всем деревьям
+// одновременно в порядке удаленности ячеек (best bin first) и останавливается после maxChecks сравнений
+class KDForest
+{
+public:
+	// Найденный сосед: индекс дескриптора и квадрат евклидова расстояния
+	struct Neighbor
+	{
+		int index;
+		double distance;
+	};
+
+private:
+	struct Node
+	{
+		// Измерение разбиения, -1 для листа
+		int dim;
+		double value;
+		int left;
+		int right;
+		// Диапазон индексов точек листа в indices
+		int begin;
+		int end;
+	};
+
+	struct Tree
+	{
+		std::vector<Node> nodes;
+		std::vector<int> indices;
+	};
+
+	// Значения дескрипторов, записанные подряд
+	std::vector<double> data;
+	int pointCount;
+	int dims;
+	int leafSize;
+	std::vector<Tree> trees;
+
+	int buildNode(Tree& tree, int begin, int end, std::vector<double>& mean, std::vector<double>& variance, unsigned& seed);
+	double squaredDistance(const double* a, int index) const { return squaredDistance(a, &data[index * dims]); }
+	double squaredDistance(const double* a, const double* b) const;
+	// Поиск двух ближайших соседей; visited/stamp - метки уже проверенных точек (по одной на поток)
+	void findTwoNearest(const double* query, int maxChecks, std::vector<int>& visited, int stamp, Neighbor& first, Neighbor& second) const;
+
+public:
+	// Точность по умолчанию: число сравнений с дескрипторами на один запрос
+	static constexpr int DefaultChecks = 256;
+
+	KDForest(const std::vector<Descriptor>& descriptors, int treeCount = 4, int leafSize = 8);
+
+	int getPointCount() const { return pointCount; }
+	// Два ближайших соседа запроса (index = -1, если точек меньше двух).
+	// maxChecks - число сравнений с дескрипторами, больше - точнее и медленнее (при maxChecks >= числа точек поиск точный)
+	void findTwoNearest(const Descriptor& query, int maxChecks, Neighbor& first, Neighbor& second) const;
+	// Сопоставление дескрипторов queries с индексом по NNDR (как DescriptorExtractor::findMatches)
+	std::vector<std::pair<int, int>> match(const std::vector<Descriptor>& queries, double threshold, int maxChecks = DefaultChecks) const;
+};
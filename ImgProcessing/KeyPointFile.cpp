@@ -0,0 +1,171 @@
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <QtCore/qfile.h>
+#include "KeyPointFile.h"
+
+namespace
+{
+	struct KpdHeader
+	{
+		char signature[4];
+		int32_t version;
+		// BasicDescriptorSet::getValueType
+		int32_t valueType;
+		int32_t count;
+		int32_t dims;
+		// Число корзин в гистограмме (0 - неизвестно)
+		int32_t binCount;
+		// Смещение блока дескрипторов от начала файла
+		int64_t descriptorOffset;
+	};
+
+	struct KeyPointRecord
+	{
+		int32_t x;
+		int32_t y;
+		double sigma;
+		double f;
+		double angle;
+	};
+
+	const char KpdSignature[4] = { 'K', 'P', 'D', 0 };
+	const int32_t KpdVersion = 1;
+
+	// Файл, отображенный в память; отображение снимается при удалении
+	struct MappedFile
+	{
+		QFile file;
+		uchar* data;
+
+		explicit MappedFile(const QString& fileName): file(fileName), data(nullptr) {}
+		~MappedFile()
+		{
+			if (data) file.unmap(data);
+		}
+	};
+
+	int64_t getDescriptorOffset(int count, int alignment)
+	{
+		int64_t end = sizeof(KpdHeader) + static_cast<int64_t>(count) * sizeof(KeyPointRecord);
+		return (end + alignment - 1) / alignment * alignment;
+	}
+
+	// Отображение файла в память и разбор заголовка и записей точек; binCount - число корзин из заголовка
+	template<typename T>
+	bool loadMapped(const QString& fileName, std::vector<KeyPoint>& points, BasicDescriptorSet<T>& descriptors, int& binCount)
+	{
+		auto mapped = std::make_shared<MappedFile>(fileName);
+		if (!mapped->file.open(QIODevice::ReadOnly)) return false;
+		qint64 size = mapped->file.size();
+		if (size < static_cast<qint64>(sizeof(KpdHeader))) return false;
+		// Закрытые копии страниц: запись в набор не меняет файл
+		mapped->data = mapped->file.map(0, size, QFileDevice::MapPrivateOption);
+		if (!mapped->data) return false;
+
+		KpdHeader header;
+		std::memcpy(&header, mapped->data, sizeof(header));
+		if (std::memcmp(header.signature, KpdSignature, sizeof(KpdSignature)) != 0 || header.version != KpdVersion
+			|| header.valueType != BasicDescriptorSet<T>::getValueType() || header.count < 0 || header.dims < 0) {
+			return false;
+		}
+		// Каждый блок сравнивается с остатком отображения отдельно, без сумм и произведений значений из заголовка,
+		// которые могут переполниться: записи точек после заголовка, затем дескрипторы после descriptorOffset
+		qint64 recordSpace = size - static_cast<qint64>(sizeof(KpdHeader));
+		if (header.count > recordSpace / static_cast<qint64>(sizeof(KeyPointRecord))
+			|| header.descriptorOffset != getDescriptorOffset(header.count, BasicDescriptorSet<T>::Alignment)
+			|| header.descriptorOffset > size) {
+			return false;
+		}
+		qint64 descriptorSpace = size - header.descriptorOffset;
+		if (header.dims > 0 && (header.count > descriptorSpace / static_cast<qint64>(sizeof(T)) / header.dims
+			|| static_cast<qint64>(header.count) * header.dims > std::numeric_limits<int>::max())) {
+			return false;
+		}
+
+		const uchar* recordData = mapped->data + sizeof(KpdHeader);
+		points.resize(header.count);
+		for (int i = 0; i < header.count; i++) {
+			KeyPointRecord record;
+			std::memcpy(&record, recordData + static_cast<size_t>(i) * sizeof(KeyPointRecord), sizeof(record));
+			points[i] = KeyPoint(record.x, record.y, record.f, record.angle, record.sigma);
+		}
+
+		T* values = reinterpret_cast<T*>(mapped->data + header.descriptorOffset);
+		descriptors = BasicDescriptorSet<T>(header.count, header.dims, values, mapped);
+		binCount = header.binCount;
+		return true;
+	}
+}
+
+const char* KeyPointFile::Extension = ".kpd";
+
+template<typename T>
+bool KeyPointFile::save(const QString& fileName, const std::vector<KeyPoint>& points, const BasicDescriptorSet<T>& descriptors, int binCount)
+{
+	int count = descriptors.getCount();
+	if (static_cast<int>(points.size()) != count) return false;
+
+	KpdHeader header;
+	std::memcpy(header.signature, KpdSignature, sizeof(KpdSignature));
+	header.version = KpdVersion;
+	header.valueType = BasicDescriptorSet<T>::getValueType();
+	header.count = count;
+	header.dims = descriptors.getDims();
+	header.binCount = binCount;
+	header.descriptorOffset = getDescriptorOffset(count, BasicDescriptorSet<T>::Alignment);
+
+	std::vector<KeyPointRecord> records(count);
+	for (int i = 0; i < count; i++) {
+		records[i] = { points[i].x, points[i].y, points[i].sigma, points[i].f, points[i].angle };
+	}
+	qint64 recordBytes = static_cast<qint64>(count) * sizeof(KeyPointRecord);
+	std::vector<char> padding(header.descriptorOffset - sizeof(KpdHeader) - recordBytes, 0);
+	qint64 descriptorBytes = static_cast<qint64>(count) * header.dims * sizeof(T);
+
+	QFile file(fileName);
+	if (!file.open(QIODevice::WriteOnly)) return false;
+	if (file.write(reinterpret_cast<const char*>(&header), sizeof(header)) != sizeof(header)) return false;
+	if (recordBytes > 0 && file.write(reinterpret_cast<const char*>(records.data()), recordBytes) != recordBytes) return false;
+	if (!padding.empty() && file.write(padding.data(), padding.size()) != static_cast<qint64>(padding.size())) return false;
+	return descriptorBytes == 0 || file.write(reinterpret_cast<const char*>(descriptors.data()), descriptorBytes) == descriptorBytes;
+}
+
+bool KeyPointFile::save(const QString& fileName, const std::vector<KeyPoint>& points, const std::vector<Descriptor>& descriptors)
+{
+	int binCount = descriptors.empty() ? 0 : descriptors[0].getBinCount();
+	return save(fileName, points, DoubleDescriptorSet(descriptors), binCount);
+}
+
+template<typename T>
+bool KeyPointFile::load(const QString& fileName, std::vector<KeyPoint>& points, BasicDescriptorSet<T>& descriptors)
+{
+	int binCount;
+	return loadMapped(fileName, points, descriptors, binCount);
+}
+
+bool KeyPointFile::load(const QString& fileName, std::vector<KeyPoint>& points, std::vector<Descriptor>& descriptors)
+{
+	DoubleDescriptorSet set;
+	int binCount;
+	if (!loadMapped(fileName, points, set, binCount)) return false;
+
+	int dims = set.getDims();
+	if (binCount <= 0 || dims % binCount != 0) binCount = dims;
+	descriptors.clear();
+	descriptors.reserve(set.getCount());
+	for (int i = 0; i < set.getCount(); i++) {
+		Descriptor descriptor(binCount > 0 ? dims / binCount : 0, binCount);
+		const double* values = set.row(i);
+		for (int d = 0; d < dims; d++) descriptor[d] = values[d];
+		descriptors.push_back(std::move(descriptor));
+	}
+	return true;
+}
+
+template bool KeyPointFile::save(const QString& fileName, const std::vector<KeyPoint>& points, const DescriptorSet& descriptors, int binCount);
+template bool KeyPointFile::save(const QString& fileName, const std::vector<KeyPoint>& points, const ByteDescriptorSet& descriptors, int binCount);
+template bool KeyPointFile::save(const QString& fileName, const std::vector<KeyPoint>& points, const DoubleDescriptorSet& descriptors, int binCount);
+template bool KeyPointFile::load(const QString& fileName, std::vector<KeyPoint>& points, DescriptorSet& descriptors);
+template bool KeyPointFile::load(const QString& fileName, std::vector<KeyPoint>& points, ByteDescriptorSet& descriptors);
+template bool KeyPointFile::load(const QString& fileName, std::vector<KeyPoint>& points, DoubleDescriptorSet& descriptors);
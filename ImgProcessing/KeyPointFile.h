@@ -0,0 +1,29 @@
+#pragma once
+#include <vector>
+#include "KeyPoint.h"
+#include "Descriptor.h"
+#include "DescriptorSet.h"
+class QString;
+// Файл .kpd с ключевыми точками и их дескрипторами.
+// Формат: заголовок (сигнатура, версия, тип значений, число точек, длина дескриптора, число корзин, смещение блока),
+// записи точек (x, y, sigma, f, angle), затем блок дескрипторов count x dims по строкам с началом,
+// выровненным по BasicDescriptorSet::Alignment. При загрузке блок отображается в память без копирования
+class KeyPointFile
+{
+public:
+	// Расширение файлов
+	static const char* Extension;
+
+	// Сохранение точек и набора дескрипторов (points.size() == descriptors.getCount())
+	template<typename T>
+	static bool save(const QString& fileName, const std::vector<KeyPoint>& points, const BasicDescriptorSet<T>& descriptors, int binCount = 0);
+	// Сохранение результата DescriptorExtractor::computeScale без преобразования значений (тип double)
+	static bool save(const QString& fileName, const std::vector<KeyPoint>& points, const std::vector<Descriptor>& descriptors);
+
+	// Загрузка точек и дескрипторов: значения остаются в отображенном в память файле, пока существует набор.
+	// Возвращает false, если файл поврежден или тип значений отличается от T
+	template<typename T>
+	static bool load(const QString& fileName, std::vector<KeyPoint>& points, BasicDescriptorSet<T>& descriptors);
+	// Загрузка файла, сохраненного из std::vector<Descriptor>, с восстановлением числа гистограмм и корзин
+	static bool load(const QString& fileName, std::vector<KeyPoint>& points, std::vector<Descriptor>& descriptors);
+};
@@ -1,43 +1,157 @@
 #include <algorithm>
+#include <numeric>
+#include <limits>
+#include <cmath>
 #include <unordered_set>
 #include <unordered_map>
 #include <QtCore/qdebug.h>
 #include "KeyPointHelper.h"
 
-std::vector<KeyPoint> KeyPointHelper::anms(std::vector<KeyPoint>& points, int pointsCount, double minR, double maxR)
+namespace
 {
-	double r = minR;
-	double step = 1;
-	while (points.size() > pointsCount&& r < maxR)
+	//           
+	class PointGrid
 	{
-		auto toRemove = std::remove_if(begin(points), end(points),
-			[&](KeyPoint& pointA) {
-				for (auto& pointB : points) {
-					if (KeyPoint::distance(pointA, pointB) < r && pointA.f < pointB.f) {
-						return true;
+	private:
+		const std::vector<KeyPoint>& points;
+		double cellSize;
+		int minX, minY;
+		int cols, rows;
+		//  ,    
+		std::vector<std::vector<int>> cells;
+
+		int cellX(int x) const { return std::min(cols - 1, static_cast<int>((x - minX) / cellSize)); }
+		int cellY(int y) const { return std::min(rows - 1, static_cast<int>((y - minY) / cellSize)); }
+	public:
+		//    ,        
+		explicit PointGrid(const std::vector<KeyPoint>& points): points(points), cellSize(1), minX(0), minY(0), cols(1), rows(1)
+		{
+			if (points.empty()) return;
+			int maxX = points[0].x, maxY = points[0].y;
+			minX = points[0].x;
+			minY = points[0].y;
+			for (const KeyPoint& point : points) {
+				minX = std::min(minX, point.x);
+				minY = std::min(minY, point.y);
+				maxX = std::max(maxX, point.x);
+				maxY = std::max(maxY, point.y);
+			}
+			double area = static_cast<double>(maxX - minX + 1) * (maxY - minY + 1);
+			cellSize = std::max(1.0, 2 * std::sqrt(area / points.size()));
+			cols = static_cast<int>((maxX - minX) / cellSize) + 1;
+			rows = static_cast<int>((maxY - minY) / cellSize) + 1;
+			cells.resize(cols * rows);
+		}
+
+		void insert(int index)
+		{
+			cells[cellY(points[index].y) * cols + cellX(points[index].x)].push_back(index);
+		}
+
+		//   point      maxDistance,   accept(index, distance) .
+		//     -1, distance -   
+		template<typename Accept>
+		int nearest(const KeyPoint& point, double maxDistance, Accept accept, double& distance) const
+		{
+			int found = -1;
+			distance = maxDistance;
+			int cx = cellX(point.x), cy = cellY(point.y);
+			int maxRing = std::max(std::max(cx, cols - 1 - cx), std::max(cy, rows - 1 - cy));
+			//     :   ring   (ring - 1) * cellSize
+			for (int ring = 0; ring <= maxRing && (ring - 1) * cellSize < distance; ring++) {
+				for (int y = std::max(0, cy - ring); y <= std::min(rows - 1, cy + ring); y++) {
+					bool edgeRow = y == cy - ring || y == cy + ring;
+					int step = edgeRow ? 1 : 2 * ring;
+					for (int x = cx - ring; x <= cx + ring; x += step) {
+						if (x < 0 || x >= cols) continue;
+						for (int index : cells[y * cols + x]) {
+							double d = KeyPoint::distance(point, points[index]);
+							if (d < distance && accept(index, d)) {
+								distance = d;
+								found = index;
+							}
+						}
 					}
 				}
-				return false;
-			});
-		points.erase(toRemove, end(points));
-		r += step;
+			}
+			return found;
+		}
+	};
+
+	//      
+	std::vector<int> sortByResponse(const std::vector<KeyPoint>& points)
+	{
+		std::vector<int> order(points.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return points[a].f > points[b].f; });
+		return order;
+	}
+}
+
+std::vector<KeyPoint> KeyPointHelper::anms(std::vector<KeyPoint>& points, int pointsCount, double minR, double maxR)
+{
+	//  :     ,          
+	std::vector<double> radii;
+	for (double r = minR; r < maxR; r += 1) radii.push_back(r);
+	int passCount = static_cast<int>(radii.size());
+	if (static_cast<int>(points.size()) <= pointsCount || passCount == 0) return points;
+
+	//  ,     (passCount -  ).
+	//  p    q    k  radii[k] > d(p, q),  q      ,
+	//             
+	std::vector<int> removedAt(points.size(), passCount);
+	std::vector<int> order = sortByResponse(points);
+	PointGrid grid(points);
+	for (size_t groupBegin = 0; groupBegin < order.size();) {
+		//        
+		size_t groupEnd = groupBegin;
+		while (groupEnd < order.size() && points[order[groupEnd]].f == points[order[groupBegin]].f) groupEnd++;
+		for (size_t i = groupBegin; i < groupEnd; i++) {
+			double distance;
+			int index = order[i];
+			int stronger = grid.nearest(points[index], radii.back(), [&](int other, double d) {
+				return std::upper_bound(radii.begin(), radii.end(), d) - radii.begin() <= removedAt[other];
+			}, distance);
+			if (stronger >= 0) removedAt[index] = static_cast<int>(std::upper_bound(radii.begin(), radii.end(), distance) - radii.begin());
+		}
+		for (size_t i = groupBegin; i < groupEnd; i++) grid.insert(order[i]);
+		groupBegin = groupEnd;
+	}
+
+	//  ,    pointsCount
+	std::vector<int> removedCount(passCount + 1, 0);
+	for (int pass : removedAt) removedCount[pass]++;
+	size_t remaining = points.size();
+	int lastPass = -1;
+	while (lastPass + 1 < passCount && remaining > static_cast<size_t>(pointsCount)) {
+		lastPass++;
+		remaining -= removedCount[lastPass];
 	}
 
+	std::vector<KeyPoint> result;
+	result.reserve(remaining);
+	for (size_t i = 0; i < points.size(); i++) {
+		if (removedAt[i] > lastPass) result.push_back(points[i]);
+	}
+	points = result;
+
 	return points;
 }
 
 std::vector<KeyPoint> KeyPointHelper::brownAnms(std::vector<KeyPoint>& points, int pointCount)
 {
+	//    -  (float)         ,
+	//     .      ,   
+	//   ,  ,        ,     
 	std::vector<std::pair<float, int>> minDists;
+	minDists.reserve(points.size());
 	constexpr float maxFloat = std::numeric_limits<float>::max();
-	minDists.push_back({ maxFloat, 0 });
-	for (int i = 1; i < points.size(); i++) {
-		float minDist = maxFloat;
-		for (int j = 0; j < i; j++) {
-			float curDist = KeyPoint::distance(points[j], points[i]);
-			minDist = std::min(curDist, minDist);
-		}
-		minDists.push_back({ minDist, i });
+	PointGrid grid(points);
+	for (int i = 0; i < static_cast<int>(points.size()); i++) {
+		double distance;
+		int nearest = grid.nearest(points[i], std::numeric_limits<double>::max(), [](int, double) { return true; }, distance);
+		minDists.push_back({ nearest >= 0 ? static_cast<float>(distance) : maxFloat, i });
+		grid.insert(i);
 	}
 
 	std::sort(begin(minDists), end(minDists),
@@ -45,36 +159,45 @@ std::vector<KeyPoint> KeyPointHelper::brownAnms(std::vector<KeyPoint>& points, i
 			return a.first > b.first;
 		});
 	std::vector<KeyPoint> result;
-	for (int i = 0; i < pointCount; i++) result.push_back(points[minDists[i].second]);
+	int count = std::min(pointCount, static_cast<int>(minDists.size()));
+	for (int i = 0; i < count; i++) result.push_back(points[minDists[i].second]);
 
 	return result;
 }
 
-std::vector<KeyPoint> KeyPointHelper::getLocalMax(const DoubleMatrix& img, const int windowSize, double threshold)
+template<typename T>
+std::vector<KeyPoint> KeyPointHelper::getLocalMax(const Matrix<T>& img, const int windowSize, double threshold)
 {
 	return getLocalMax(img, { windowSize, windowSize }, threshold);
 }
 
-std::vector<KeyPoint> KeyPointHelper::getLocalMax(const DoubleMatrix& img, const std::vector<int>& windowSize, double threshold)
+template<typename T>
+std::vector<KeyPoint> KeyPointHelper::getLocalMax(const Matrix<T>& img, const std::vector<int>& windowSize, double threshold)
 {
 	int offsetY = windowSize[0] / 2;
 	int offsetX = windowSize[1] / 2;
 	std::vector<KeyPoint> localMaxPoints;
 	int height = img.getHeight();
 	int width = img.getWidth();
+	//  - ,    .      ,
+	//        
+	Matrix<T> windowMax = img.maxFilter(offsetY, offsetX);
 	for (int y = 0; y < height; y++) {
 		for (int x = 0; x < width; x++) {
+			T localMax = img.at(y, x);
+			if (!(localMax > threshold) || localMax < windowMax.at(y, x)) continue;
+
 			bool isLocalMax = true;
-			double localMax = img.get(y, x);
+			bool inside = y >= offsetY && y + offsetY < height && x >= offsetX && x + offsetX < width;
 			for (int u = -offsetY; u <= offsetY && isLocalMax; u++) {
 				for (int v = -offsetX; v <= offsetX && isLocalMax; v++) {
 					if (u != 0 || v != 0) {
-						isLocalMax = localMax > img.get(y + u, x + v);
+						isLocalMax = localMax > (inside ? img.at(y + u, x + v) : img.get(y + u, x + v));
 					}
 				}
 			}
 
-			if (isLocalMax && localMax > threshold) {
+			if (isLocalMax) {
 				localMaxPoints.push_back(KeyPoint(x, y, localMax));
 			}
 		}
@@ -83,44 +206,54 @@ std::vector<KeyPoint> KeyPointHelper::getLocalMax(const DoubleMatrix& img, const
 	return localMaxPoints;
 }
 
-std::vector<KeyPoint> KeyPointHelper::getKeyPoints(const DoubleMatrix& img, double threshold)
+template<typename T>
+std::vector<KeyPoint> KeyPointHelper::getKeyPoints(const Matrix<T>& img, double threshold)
 {
 	std::vector<KeyPoint> output;
 	int height = img.getHeight();
 	int width = img.getWidth();
 	for (int y = 0; y < height; y++) {
 		for (int x = 0; x < width; x++) {
-			double p = img.at(y, x);
+			T p = img.at(y, x);
 			if (p > threshold) output.push_back(KeyPoint(x, y, p));
 		}
 	}
 	return output;
 }
 
-std::vector<KeyPoint> KeyPointHelper::findExtremePoints(Pyramid& pyramid, Pyramid& doG, double harrisThreshold, double harrisWindowSize)
+template<typename T>
+std::vector<KeyPoint> KeyPointHelper::findExtremePoints(BasicPyramid<T>& pyramid, BasicPyramid<T>& doG, double harrisThreshold, double harrisWindowSize)
+{
+	std::vector<Matrix<T>> harrisImages;
+	return findExtremePoints(pyramid, doG, harrisImages, harrisThreshold, harrisWindowSize);
+}
+
+template<typename T>
+std::vector<KeyPoint> KeyPointHelper::findExtremePoints(BasicPyramid<T>& pyramid, BasicPyramid<T>& doG, std::vector<Matrix<T>>& harrisImages,
+	double harrisThreshold, double harrisWindowSize)
 {
 	std::vector<KeyPoint> pointsDoG = doG.findExtremePoints(3, 0.03);
 	std::vector<KeyPoint> result;
 	
-	//   
-	std::unordered_set<double> sigmas;
-
-	for(KeyPoint& point : pointsDoG)
-	{
-		sigmas.insert(point.sigma);
+	//      
+	std::unordered_map<double, int> sigmaRows;
+	for (KeyPoint& point : pointsDoG) {
+		if (sigmaRows.count(point.sigma)) continue;
+		BasicPyramidRow<T>& row = pyramid.getBySigma(point.sigma);
+		sigmaRows[point.sigma] = static_cast<int>(&row - pyramid.get().data());
 	}
 
-	//     
-	std::unordered_map<double, DoubleMatrix> harrisImages;
-	for (double s : sigmas) {
-		PyramidRow& row = pyramid.getBySigma(s);
-		DoubleMatrix harrisImage = row.image.operatorHarris(harrisWindowSize);
-		harrisImages.insert({s, harrisImage});
+	//     ,    
+	harrisImages.resize(pyramid.get().size());
+	std::unordered_set<int> rows;
+	for (auto& sigmaRow : sigmaRows) {
+		int i = sigmaRow.second;
+		if (rows.insert(i).second) pyramid.getImage(i).operatorHarris(harrisWindowSize, harrisImages[i]);
 	}
 
 	//    
 	for (KeyPoint& point : pointsDoG) {
-		DoubleMatrix& img = harrisImages[point.sigma];
+		Matrix<T>& img = harrisImages[sigmaRows[point.sigma]];
 		if (img.at(point.y, point.x) > harrisThreshold) {
 			result.push_back(point);
 		}
@@ -130,3 +263,16 @@ std::vector<KeyPoint> KeyPointHelper::findExtremePoints(Pyramid& pyramid, Pyrami
 
 	return result;
 }
+
+template std::vector<KeyPoint> KeyPointHelper::getLocalMax(const DoubleMatrix& img, const int windowSize, double threshold);
+template std::vector<KeyPoint> KeyPointHelper::getLocalMax(const FloatMatrix& img, const int windowSize, double threshold);
+template std::vector<KeyPoint> KeyPointHelper::getLocalMax(const DoubleMatrix& img, const std::vector<int>& windowSize, double threshold);
+template std::vector<KeyPoint> KeyPointHelper::getLocalMax(const FloatMatrix& img, const std::vector<int>& windowSize, double threshold);
+template std::vector<KeyPoint> KeyPointHelper::getKeyPoints(const DoubleMatrix& img, double threshold);
+template std::vector<KeyPoint> KeyPointHelper::getKeyPoints(const FloatMatrix& img, double threshold);
+template std::vector<KeyPoint> KeyPointHelper::findExtremePoints(Pyramid& pyramid, Pyramid& doG, double harrisThreshold, double harrisWindowSize);
+template std::vector<KeyPoint> KeyPointHelper::findExtremePoints(FloatPyramid& pyramid, FloatPyramid& doG, double harrisThreshold, double harrisWindowSize);
+template std::vector<KeyPoint> KeyPointHelper::findExtremePoints(Pyramid& pyramid, Pyramid& doG, std::vector<DoubleMatrix>& harrisImages,
+	double harrisThreshold, double harrisWindowSize);
+template std::vector<KeyPoint> KeyPointHelper::findExtremePoints(FloatPyramid& pyramid, FloatPyramid& doG, std::vector<FloatMatrix>& harrisImages,
+	double harrisThreshold, double harrisWindowSize);
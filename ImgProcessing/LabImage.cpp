@@ -1,5 +1,9 @@
 #include "LabImage.h"
 #include <iostream>
+#include <mutex>
+#include <limits>
+#include "SimdKernels.h"
+#include "ThreadPool.h"
 
 LabImage::LabImage(QImage& source): sourceImage(source)
 {
@@ -85,39 +89,113 @@ QImage LabImage::getGrayScale(QImage& source)
 }
 
 QImage LabImage::getImageFromMatrix(const IntMatrix& matrix)
+{
+	return matrix.toImage();
+}
+
+template<typename T>
+void LabImage::toGrayMatrix(const QImage& source, Matrix<T>& result)
+{
+	// Пустое (не загруженное) изображение дает пустую матрицу
+	if (source.isNull()) {
+		result.setSize(0, 0);
+		return;
+	}
+	QImage::Format format = source.format();
+	if (format != QImage::Format_RGB32 && format != QImage::Format_ARGB32 && format != QImage::Format_Grayscale8) {
+		QImage converted = source.convertToFormat(QImage::Format_ARGB32);
+		if (converted.isNull() || converted.format() != QImage::Format_ARGB32) {
+			result.setSize(0, 0);
+			return;
+		}
+		toGrayMatrix(converted, result);
+		return;
+	}
+
+	int h = source.height();
+	int w = source.width();
+	result.setSize(w, h);
+	if (w == 0 || h == 0) return;
+	T* values = result.data();
+
+	// Grayscale8: яркость пикселя (v, v, v) по той же формуле, что и для цветных изображений
+	T grayLuma[256];
+	if (format == QImage::Format_Grayscale8) {
+		uint32_t grayPixels[256];
+		for (int v = 0; v < 256; v++) grayPixels[v] = qRgb(v, v, v);
+		SimdKernels::luma(grayPixels, grayLuma, 256);
+	}
+
+	// Яркость строк, минимум и максимум находятся в той же полосе строк, пока она в кэше
+	T minEl = std::numeric_limits<T>::max();
+	T maxEl = std::numeric_limits<T>::lowest();
+	std::mutex minMaxMutex;
+	ThreadPool::parallelRows(h, w, [&](int rowBegin, int rowEnd) {
+		T bandMin = std::numeric_limits<T>::max();
+		T bandMax = std::numeric_limits<T>::lowest();
+		for (int i = rowBegin; i < rowEnd; i++) {
+			T* dst = values + i * w;
+			if (format == QImage::Format_Grayscale8) {
+				const uchar* sourceScan = source.constScanLine(i);
+				for (int j = 0; j < w; j++) dst[j] = grayLuma[sourceScan[j]];
+			}
+			else {
+				SimdKernels::luma(reinterpret_cast<const uint32_t*>(source.constScanLine(i)), dst, w);
+			}
+			auto rowMinMax = std::minmax_element(dst, dst + w);
+			bandMin = std::min(bandMin, *rowMinMax.first);
+			bandMax = std::max(bandMax, *rowMinMax.second);
+		}
+		std::lock_guard<std::mutex> lock(minMaxMutex);
+		minEl = std::min(minEl, bandMin);
+		maxEl = std::max(maxEl, bandMax);
+	});
+
+	result.normalize(0, 1, minEl, maxEl);
+}
+
+template<typename T>
+QImage LabImage::getImageFromMatrix(const Matrix<T>& matrix)
 {
 	int h = matrix.getHeight();
 	int w = matrix.getWidth();
 	QImage resultImage(w, h, QImage::Format::Format_RGB32);
+	const T* values = matrix.data();
+	// Строки берутся от bits(): scanLine в потоках пула не должен отсоединять данные изображения
+	uchar* bits = resultImage.bits();
+	int bytesPerLine = resultImage.bytesPerLine();
 
-	for (int i = 0; i < h; i++) {
-		uchar* scan = resultImage.scanLine(i);
-		int offset = 4;
-		for (int j = 0; j < w; j++) {
-			QRgb* pixel = reinterpret_cast<QRgb*>(scan + j * offset);
-			int pixelColor = matrix.get(i, j);
-			*pixel = QColor(pixelColor, pixelColor, pixelColor).rgba();
+	ThreadPool::parallelRows(h, w, [&](int rowBegin, int rowEnd) {
+		for (int i = rowBegin; i < rowEnd; i++) {
+			QRgb* scan = reinterpret_cast<QRgb*>(bits + i * bytesPerLine);
+			const T* row = values + i * w;
+			for (int j = 0; j < w; j++) {
+				int pixelColor = std::min(std::max(static_cast<int>(row[j]), 0), 255);
+				scan[j] = qRgb(pixelColor, pixelColor, pixelColor);
+			}
 		}
-	}
+	});
 
 	return resultImage;
 }
 
-QImage LabImage::getImageFromMatrix(const DoubleMatrix& matrix)
+template<typename T>
+QImage LabImage::toGrayImage(const Matrix<T>& matrix)
 {
 	int h = matrix.getHeight();
 	int w = matrix.getWidth();
-	QImage resultImage(w, h, QImage::Format::Format_RGB32);
+	QImage resultImage(w, h, QImage::Format_Grayscale8);
+	if (w == 0 || h == 0) return resultImage;
+	std::pair<T, T> minMax = matrix.minMax();
+	const T* values = matrix.data();
+	uchar* bits = resultImage.bits();
+	int bytesPerLine = resultImage.bytesPerLine();
 
-	for (int i = 0; i < h; i++) {
-		uchar* scan = resultImage.scanLine(i);
-		int offset = 4;
-		for (int j = 0; j < w; j++) {
-			QRgb* pixel = reinterpret_cast<QRgb*>(scan + j * offset);
-			int pixelColor = matrix.get(i, j);
-			*pixel = QColor(pixelColor, pixelColor, pixelColor).rgba();
+	ThreadPool::parallelRows(h, w, [&](int rowBegin, int rowEnd) {
+		for (int i = rowBegin; i < rowEnd; i++) {
+			SimdKernels::normalizeToBytes(values + i * w, bits + i * bytesPerLine, w, minMax.first, minMax.second);
 		}
-	}
+	});
 
 	return resultImage;
 }
@@ -127,10 +205,10 @@ void LabImage::saveImage(IntMatrix& matrix, const QString& fileName)
 	getImageFromMatrix(matrix).save(fileName);
 }
 
-void LabImage::saveImage(DoubleMatrix& matrix, const QString& fileName)
+template<typename T>
+void LabImage::saveImage(const Matrix<T>& matrix, const QString& fileName)
 {
-	DoubleMatrix m = DoubleMatrix(matrix);
-	getImageFromMatrix(m.norm255()).save(fileName);
+	toGrayImage(matrix).save(fileName);
 }
 
 void LabImage::drawKeyPoints(QImage& img1, const std::vector<KeyPoint>& points, QColor color, int radius)
@@ -229,3 +307,12 @@ std::vector<QColor> LabImage::getRandomColors(int count)
 	}
 	return colors;
 }
+
+template void LabImage::toGrayMatrix(const QImage& source, DoubleMatrix& result);
+template void LabImage::toGrayMatrix(const QImage& source, FloatMatrix& result);
+template QImage LabImage::getImageFromMatrix(const DoubleMatrix& matrix);
+template QImage LabImage::getImageFromMatrix(const FloatMatrix& matrix);
+template QImage LabImage::toGrayImage(const DoubleMatrix& matrix);
+template QImage LabImage::toGrayImage(const FloatMatrix& matrix);
+template void LabImage::saveImage(const DoubleMatrix& matrix, const QString& fileName);
+template void LabImage::saveImage(const FloatMatrix& matrix, const QString& fileName);
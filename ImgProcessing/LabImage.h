@@ -26,12 +26,24 @@ public:
 	static IntMatrix createIntMatrixFromImage(QImage& source, char channel);
 	// Возвращает копию изображения в оттенках серого
 	static QImage getGrayScale(QImage& source);
-	// Создает изображение из заданной матрицы 
+	// Яркость изображения (как getGrayScale и IntMatrix::fromImage), нормированная в [0, 1], без промежуточных копий:
+	// строки RGB32, ARGB32 и Grayscale8 преобразуются векторными ядрами в общем пуле потоков, остальные форматы
+	// предварительно приводятся к ARGB32. Буфер result переиспользуется, если размер изображения не изменился
+	template<typename T>
+	static void toGrayMatrix(const QImage& source, Matrix<T>& result);
+	// Создает изображение RGB32 из заданной матрицы со значениями в [0, 255] (дробная часть отбрасывается)
 	static QImage getImageFromMatrix(const IntMatrix& matrix);
-	static QImage getImageFromMatrix(const DoubleMatrix& matrix);
+	template<typename T>
+	static QImage getImageFromMatrix(const Matrix<T>& matrix);
+	// Изображение Grayscale8 из матрицы, нормированной в [0, 255] как norm255, без копирования матрицы:
+	// минимум и максимум и упаковка строк в байты считаются параллельно векторным ядром
+	template<typename T>
+	static QImage toGrayImage(const Matrix<T>& matrix);
 	// Сохраняет изображение из заданной матрицы
 	static void saveImage(IntMatrix& matrix, const QString& fileName);
-	static void saveImage(DoubleMatrix& matrix, const QString& fileName);
+	// Сохраняет матрицу, нормированную в [0, 255], в оттенках серого (матрица не изменяется)
+	template<typename T>
+	static void saveImage(const Matrix<T>& matrix, const QString& fileName);
 
 	static void drawKeyPoints(QImage& img1, const std::vector<KeyPoint>& points, QColor color, int radius = 2);
 	static void drawKeyPoints(QImage& img1, const std::vector<KeyPoint>& points, std::vector<QColor>& colors, int radius = 2);
@@ -1,39 +1,63 @@
 #include "Pyramid.h"
 #include <iostream>
+#include <mutex>
+#include <condition_variable>
+#include "ThreadPool.h"
 
 #include "LabImage.h"
+#include "ImageWriter.h"
 
-std::vector<double> Pyramid::getNeighbors3d(int x, int y, int iOctave, int iLevel, int winSize)
+template<typename T>
+bool BasicPyramid<T>::isExtremum3d(const Matrix<T>& prev, const Matrix<T>& cur, const Matrix<T>& next, int x, int y, int offset)
 {
-	std::vector<double> neighbors;
-	PyramidRow& prev = get(iOctave, iLevel - 1);
-	PyramidRow& cur = get(iOctave, iLevel);
-	PyramidRow& next = get(iOctave, iLevel + 1);
-	int offset = winSize / 2;
-	for (int u = -offset; u <= offset; u++) {
-		for (int v = -offset; v <= offset; v++) {
-			neighbors.push_back(prev.image.get(u + y, v + x));
-			if (u != 0 || v != 0) {
-				neighbors.push_back(cur.image.get(u + y, v + x));
+	int width = cur.getWidth();
+	int height = cur.getHeight();
+	// Для окна внутри изображения значения читаются напрямую из строк, без обработки границ
+	bool inside = y >= offset && y + offset < height && x >= offset && x + offset < width;
+	T value = cur.at(y, x);
+	// Первый сосед определяет, проверяется максимум или минимум
+	T first = inside ? prev.at(y - offset, x - offset) : prev.get(y - offset, x - offset);
+	bool isMax = value > first;
+	if (!isMax && !(value < first)) return false;
+
+	const Matrix<T>* images[3] = { &prev, &cur, &next };
+	for (const Matrix<T>* image : images) {
+		for (int u = -offset; u <= offset; u++) {
+			const T* row = inside ? image->data() + (y + u) * width + x : nullptr;
+			for (int v = -offset; v <= offset; v++) {
+				if (image == &cur && u == 0 && v == 0) continue;
+				T neighbor = inside ? row[v] : image->get(y + u, x + v);
+				if (isMax ? !(value > neighbor) : !(value < neighbor)) return false;
 			}
-			neighbors.push_back(next.image.get(u + y, v + x));
 		}
 	}
 
-	return neighbors;
+	return true;
+}
+
+template<typename T>
+void BasicPyramid<T>::setRowInfo(BasicPyramidRow<T>& row, int octave, int level, double sigmaLocal, double sigmaEffective)
+{
+	row.octave = octave;
+	row.level = level;
+	row.sigmaLocal = sigmaLocal;
+	row.sigmaEffective = sigmaEffective;
 }
 
-std::vector<PyramidRow>& Pyramid::get()
+template<typename T>
+std::vector<BasicPyramidRow<T>>& BasicPyramid<T>::get()
 {
 	return pyramid;
 }
 
-PyramidRow& Pyramid::get(int i)
+template<typename T>
+BasicPyramidRow<T>& BasicPyramid<T>::get(int i)
 {
 	return (*this)[i];
 }
 
-PyramidRow& Pyramid::getBySigma(double sigma)
+template<typename T>
+BasicPyramidRow<T>& BasicPyramid<T>::getBySigma(double sigma)
 {
 	// Общее число изображений в пирамиде
 	int imageCount = levelCount * octaveCount;
@@ -42,62 +66,66 @@ PyramidRow& Pyramid::getBySigma(double sigma)
 	sigmaIndex = std::round(sigmaIndex);
 	sigmaIndex = sigmaIndex < 0 ? 0 : sigmaIndex >= imageCount ? imageCount - 1 : sigmaIndex;
 	// Найденная строка
-	PyramidRow& r = pyramid[rowsBySigma[(int)sigmaIndex]];
+	BasicPyramidRow<T>& r = pyramid[rowsBySigma[(int)sigmaIndex]];
 	//qDebug() << "getFromSigma: sigma:" << sigma << "index:" << sigmaIndex << "(" << r.octave << "," << r.level << ")=" << r.sigmaEffective;
 	return  pyramid[rowsBySigma[(int)sigmaIndex]];
 }
 
-PyramidRow& Pyramid::getBySigma(int octave, double sigma)
+template<typename T>
+int BasicPyramid<T>::getIndexBySigma(int octave, double sigma)
 {
 	auto closest = std::min_element(begin(pyramid), end(pyramid),
-		[&](PyramidRow& row, PyramidRow& min)
+		[&](BasicPyramidRow<T>& row, BasicPyramidRow<T>& min)
 		{ 
 			return row.octave == octave && abs(sigma - row.sigmaEffective) < abs(sigma - min.sigmaEffective);
 		});
-	return *closest;
+	return static_cast<int>(closest - begin(pyramid));
 }
 
-DoubleMatrix& Pyramid::getImage(int i)
+template<typename T>
+Matrix<T>& BasicPyramid<T>::getImage(int i)
 {
 	return pyramid[i].image;
 }
 
-void Pyramid::saveImage(const QString& dir, int nameFormat)
+template<typename T>
+void BasicPyramid<T>::saveImage(const QString& dir, int nameFormat)
 {
 	QDir saveDir(dir);
 	if (!saveDir.exists()) QDir().mkdir(dir);
 
 	if (nameFormat == 0) {
-		for (PyramidRow& row : pyramid) {
+		for (BasicPyramidRow<T>& row : pyramid) {
 			QString fileName = "\\oct["
 				+ QString::number(row.octave) + ","
 				+ QString::number(row.level) + "] "
 				+ QString::number(row.sigmaLocal) + " "
 				+ QString::number(row.sigmaEffective)
 				+ ".jpg";
-			LabImage::saveImage(row.image, dir + fileName);
+			ImageWriter::global().save(LabImage::toGrayImage(row.image), dir + fileName);
 		}
 	}
 	else if (nameFormat == 1) {
-		for (PyramidRow& row : pyramid) {
+		for (BasicPyramidRow<T>& row : pyramid) {
 			QString fileName = "\\oct["
 				+ QString::number(row.octave) + ","
 				+ QString::number(row.level) + "]"
 				+ ".jpg";
-			LabImage::saveImage(row.image, dir + fileName);
+			ImageWriter::global().save(LabImage::toGrayImage(row.image), dir + fileName);
 		}
 	}
 	
 }
 
-double Pyramid::getPixel(int x, int y, double sigma)
+template<typename T>
+double BasicPyramid<T>::getPixel(int x, int y, double sigma)
 {
 	int imageCount = levelCount * octaveCount;
 	double imageIndex = (std::log(sigma / sigma0) / std::log(sigmaStep));
 	imageIndex = std::round(imageIndex + imageIndex / levelCount);
 	imageIndex = imageIndex < 0 ? 0 : imageIndex >= imageCount? imageCount - 1 : imageIndex;
 
-	PyramidRow foundRow = pyramid[(int)imageIndex];
+	BasicPyramidRow<T> foundRow = pyramid[(int)imageIndex];
 	int newY = (y / std::pow(2, foundRow.octave));
 	int newX = (x / std::pow(2, foundRow.octave));
 	std::cout << "Octave: " << foundRow.octave << " Level: " << foundRow.level;
@@ -105,183 +133,293 @@ double Pyramid::getPixel(int x, int y, double sigma)
 	return foundRow.image.at(newY, newX);
 }
 
-Pyramid Pyramid::createDoGPyramid()
+template<typename T>
+BasicPyramid<T> BasicPyramid<T>::createDoGPyramid()
+{
+	BasicPyramid<T> result;
+	createDoGPyramid(result);
+	return result;
+}
+
+template<typename T>
+void BasicPyramid<T>::createDoGPyramid(BasicPyramid<T>& result)
 {
-	Pyramid result;
 	result.octaveCount = octaveCount;
 	result.levelCount = levelCount - 1;
+	result.overlapCount = overlapCount;
 	result.sigma0 = sigma0;
 	result.sigmaStep = sigmaStep;
+	result.rowsBySigma.clear();
+	result.pyramid.resize(octaveCount * result.levelCount);
 
 	for (int i = 0; i < octaveCount; i++) {
 		for (int j = 1; j < levelCount; j++) {
-			PyramidRow first = get(i, j - 1);
-			PyramidRow second = get(i, j);
-			DoubleMatrix diff = second.image.sub(first.image);
-			result.pyramid.push_back({i, j - 1, first.sigmaLocal, first.sigmaEffective, diff});
+			const BasicPyramidRow<T>& first = get(i, j - 1);
+			const BasicPyramidRow<T>& second = get(i, j);
+			BasicPyramidRow<T>& diff = result.get(i, j - 1);
+			setRowInfo(diff, i, j - 1, first.sigmaLocal, first.sigmaEffective);
+			// Выражение вычисляется в существующий буфер того же размера
+			diff.image = second.image - first.image;
 		}
 	}
-
-	return result;
 }
 
-Pyramid Pyramid::createHarrisPyramid(int windowSize)
+template<typename T>
+BasicPyramid<T> BasicPyramid<T>::createHarrisPyramid(int windowSize)
 {
-	Pyramid harris;
+	BasicPyramid<T> harris;
 	harris.octaveCount = octaveCount;
 	harris.levelCount = levelCount;
 	harris.overlapCount = overlapCount;
 	harris.sigma0 = sigma0;
 	harris.sigmaStep = sigmaStep;
-	for (PyramidRow& row : pyramid) {
+	for (BasicPyramidRow<T>& row : pyramid) {
 		harris.pyramid.push_back({row.octave, row.level, row.sigmaLocal, row.sigmaEffective, row.image.operatorHarris(windowSize)});
 	}
 	return harris;
 }
 
-Pyramid Pyramid::createGradientPyramid()
+template<typename T>
+BasicPyramid<T> BasicPyramid<T>::createGradientPyramid()
 {
-	Pyramid gradients;
+	BasicPyramid<T> gradients;
 	gradients.octaveCount = octaveCount;
 	gradients.levelCount = levelCount;
 	gradients.overlapCount = overlapCount;
 	gradients.sigma0 = sigma0;
 	gradients.sigmaStep = sigmaStep;
 
-	for (PyramidRow& row : pyramid) {
+	for (BasicPyramidRow<T>& row : pyramid) {
 		gradients.pyramid.push_back({ row.octave, row.level, row.sigmaLocal, row.sigmaEffective, row.image.calcSobel() });
 	}
 
 	return gradients;
 }
 
-Pyramid Pyramid::createDirectionsPyramid()
+template<typename T>
+BasicPyramid<T> BasicPyramid<T>::createDirectionsPyramid()
 {
-	Pyramid directions;
+	BasicPyramid<T> directions;
 	directions.octaveCount = octaveCount;
 	directions.levelCount = levelCount;
 	directions.overlapCount = overlapCount;
 	directions.sigma0 = sigma0;
 	directions.sigmaStep = sigmaStep;
 
-	for (PyramidRow& row : pyramid) {
+	for (BasicPyramidRow<T>& row : pyramid) {
 		directions.pyramid.push_back({ row.octave, row.level, row.sigmaLocal, row.sigmaEffective, row.image.gradientDirection() });
 	}
 
 	return directions;
 }
 
-std::vector<KeyPoint> Pyramid::findExtremePoints(int winSize, double threshold)
+template<typename T>
+void BasicPyramid<T>::createGradientPyramids(BasicPyramid<T>& magnitudes, BasicPyramid<T>& directions, bool fastAtan)
 {
-	std::vector<KeyPoint> points;
+	for (BasicPyramid<T>* result : { &magnitudes, &directions }) {
+		result->pyramid.clear();
+		result->rowsBySigma.clear();
+		result->octaveCount = octaveCount;
+		result->levelCount = levelCount;
+		result->overlapCount = overlapCount;
+		result->sigma0 = sigma0;
+		result->sigmaStep = sigmaStep;
+	}
+
+	for (BasicPyramidRow<T>& row : pyramid) {
+		Matrix<T> magnitude, direction;
+		row.image.gradient(magnitude, direction, fastAtan);
+		magnitudes.pyramid.push_back({ row.octave, row.level, row.sigmaLocal, row.sigmaEffective, std::move(magnitude) });
+		directions.pyramid.push_back({ row.octave, row.level, row.sigmaLocal, row.sigmaEffective, std::move(direction) });
+	}
+}
 
+template<typename T>
+std::vector<KeyPoint> BasicPyramid<T>::findExtremePoints(int winSize, double threshold)
+{
+	int offset = winSize / 2;
+	// Строки всех проверяемых изображений нумеруются подряд, чтобы делить работу между потоками по строкам
+	std::vector<int> levelRows;
+	std::vector<std::pair<int, int>> levels;
+	int rowCount = 0;
 	for (int iOct = 0; iOct < octaveCount; iOct++) {
 		for (int iLevel = 1; iLevel < levelCount - 1; iLevel++) {
-			PyramidRow& prev = get(iOct, iLevel - 1);
-			PyramidRow& cur = get(iOct, iLevel);
-			PyramidRow& next = get(iOct, iLevel + 1);
+			levels.push_back({ iOct, iLevel });
+			levelRows.push_back(rowCount);
+			rowCount += get(iOct, iLevel).image.getHeight();
+		}
+	}
 
+	// Точки каждой полосы строк, после обработки собираются в порядке полос
+	std::vector<std::pair<int, std::vector<KeyPoint>>> bandPoints;
+	std::mutex bandMutex;
+	ThreadPool::global().parallelFor(0, rowCount, 16, [&](int rowBegin, int rowEnd) {
+		std::vector<KeyPoint> found;
+		for (int row = rowBegin; row < rowEnd; row++) {
+			int index = static_cast<int>(std::upper_bound(levelRows.begin(), levelRows.end(), row) - levelRows.begin()) - 1;
+			int iOct = levels[index].first;
+			int iLevel = levels[index].second;
+			const Matrix<T>& prev = get(iOct, iLevel - 1).image;
+			const BasicPyramidRow<T>& cur = get(iOct, iLevel);
+			const Matrix<T>& next = get(iOct, iLevel + 1).image;
+			int y = row - levelRows[index];
 			int width = cur.image.getWidth();
-			int height = cur.image.getHeight();
-			for (int y = 0; y < height; y++) {
-				for (int x = 0; x < width; x++) {
-					double extremum = cur.image.at(y, x);
-					std::vector<double> neighbors = getNeighbors3d(x, y, iOct, iLevel, winSize);
-					auto minmax_el = std::minmax_element(begin(neighbors), end(neighbors));
-					double minEl = *minmax_el.first;
-					double maxEl = *minmax_el.second;
-					if ((extremum < minEl || extremum > maxEl) && abs(extremum) > threshold ) {
-						KeyPoint pt(x, y, extremum);
-						pt.sigma = cur.sigmaEffective;
-						points.push_back(pt);
-						//qDebug() << "oct[" << iOct << "," << iLevel << "] p=" << extremum << " s=" << pt.sigma;
-					}
+			for (int x = 0; x < width; x++) {
+				T extremum = cur.image.at(y, x);
+				if (!(std::abs(extremum) > threshold)) continue;
+				if (isExtremum3d(prev, cur.image, next, x, y, offset)) {
+					KeyPoint pt(x, y, extremum);
+					pt.sigma = cur.sigmaEffective;
+					found.push_back(pt);
 				}
 			}
 		}
+		std::lock_guard<std::mutex> lock(bandMutex);
+		bandPoints.push_back({ rowBegin, std::move(found) });
+	});
+
+	std::sort(bandPoints.begin(), bandPoints.end(),
+		[](const std::pair<int, std::vector<KeyPoint>>& a, const std::pair<int, std::vector<KeyPoint>>& b) { return a.first < b.first; });
+	std::vector<KeyPoint> points;
+	for (auto& band : bandPoints) {
+		points.insert(points.end(), band.second.begin(), band.second.end());
 	}
 
 	return points;
 }
 
-Pyramid Pyramid::createFrom(const DoubleMatrix& image, double sigmaA, double sigma0, int octaveCount, int levelCount)
+template<typename T>
+BasicPyramid<T> BasicPyramid<T>::createFrom(const Matrix<T>& image, double sigmaA, double sigma0, int octaveCount, int levelCount)
 {
 	double firstSigma = std::sqrt((sigma0 * sigma0) - (sigmaA * sigmaA));
 	double sigma = abs(firstSigma) < 0.0001 ? 1 : firstSigma;
 	double levelStep = std::pow(2, 1.0 / (levelCount - 1));
 
-	Pyramid result;
+	BasicPyramid<T> result;
 	result.octaveCount = octaveCount;
 	result.levelCount = levelCount;
 	result.sigma0 = sigma0;
 	result.sigmaStep = levelStep;
 	double summarySigma = sigma0;
 
-	DoubleMatrix f(image);
-	f = f.gaussian(sigma);
+	// Изображения переносятся в строки пирамиды без копирования, следующее размытие читает предыдущую строку
+	result.pyramid.reserve(octaveCount * levelCount);
+	Matrix<T> f = image.gaussian(sigma);
 	for (int iOctave = 0; iOctave < octaveCount; iOctave++) {
 		sigma = sigma0;
-		result.pyramid.push_back({ iOctave, 0, sigma, summarySigma, f});
+		result.pyramid.push_back({ iOctave, 0, sigma, summarySigma, std::move(f) });
 		for (int iLevel = 1; iLevel < levelCount; iLevel++) {
 			double newSigma = sigma * levelStep;
 			double sigmaTo = std::sqrt(newSigma * newSigma - sigma * sigma);
-			f = f.gaussian(sigmaTo);
+			f = result.pyramid.back().image.gaussian(sigmaTo);
 			sigma = newSigma;
 			summarySigma *= levelStep;
-			result.pyramid.push_back({iOctave, iLevel, sigma, summarySigma,  f});
-
+			result.pyramid.push_back({ iOctave, iLevel, sigma, summarySigma, std::move(f) });
 		}
-		f = f.downsample();
+		if (iOctave + 1 < octaveCount) f = result.pyramid.back().image.downsample();
 	}
 
 	return result;
 }
 
-Pyramid Pyramid::createWithOverlap(const DoubleMatrix& image, double sigmaA, double sigma0, int octaveCount, int levelCount, int overlap)
+template<typename T>
+BasicPyramid<T> BasicPyramid<T>::createWithOverlap(const Matrix<T>& image, double sigmaA, double sigma0, int octaveCount, int levelCount, int overlap)
+{
+	BasicPyramid<T> result;
+	createWithOverlap(image, sigmaA, sigma0, octaveCount, levelCount, overlap, result);
+	return result;
+}
+
+template<typename T>
+void BasicPyramid<T>::createWithOverlap(const Matrix<T>& image, double sigmaA, double sigma0, int octaveCount, int levelCount, int overlap, BasicPyramid<T>& result)
 {
 	double firstSigma = std::sqrt((sigma0 * sigma0) - (sigmaA * sigmaA));
 	double sigma = abs(firstSigma) < 0.0001 ? 1 : firstSigma;
 	double levelStep = std::pow(2, 1.0 / (levelCount - 1));
 
-	Pyramid result;
 	result.octaveCount = octaveCount;
 	result.levelCount = levelCount + overlap;
 	result.overlapCount = overlap;
 	result.sigma0 = sigma0;
 	result.sigmaStep = levelStep;
 	double summarySigma = sigma0;
-	DoubleMatrix curImg(image);
-	curImg = curImg.gaussian(sigma);
+	result.pyramid.resize(octaveCount * result.levelCount);
+	result.buffers.resize(octaveCount);
+	result.rowsBySigma.clear();
+
+	// Конвейер из двух этапов. Первый строит цепочку основных изображений: следующая октава начинается
+	// с прореживания последнего основного изображения предыдущей. Дополнительные изображения для построения DoG
+	// зависят только от основных изображений своей октавы, поэтому второй этап строит их для октавы k,
+	// пока первый уже строит октаву k + 1. Каждое изображение размывается в буфер своей октавы
+	std::mutex readyMutex;
+	std::condition_variable readyCondition;
+	// Число октав, основные изображения которых готовы
+	int readyOctaves = 0;
+
+	auto buildMainLevels = [&]() {
+		result.rowsBySigma.push_back(0);
+		image.gaussian(sigma, result.pyramid[0].image, result.buffers[0]);
+		for (int iOctave = 0; iOctave < octaveCount; iOctave++) {
+			sigma = sigma0;
+			int first = iOctave * result.levelCount;
+			setRowInfo(result.pyramid[first], iOctave, 0, sigma, summarySigma);
+			for (int iLevel = 1; iLevel < levelCount; iLevel++) {
+				double newSigma = sigma * levelStep;
+				double sigmaTo = std::sqrt(newSigma * newSigma - sigma * sigma);
+				result.pyramid[first + iLevel - 1].image.gaussian(sigmaTo, result.pyramid[first + iLevel].image, result.buffers[iOctave]);
+				sigma = newSigma;
+				summarySigma *= levelStep;
+				setRowInfo(result.pyramid[first + iLevel], iOctave, iLevel, sigma, summarySigma);
+				result.rowsBySigma.push_back(first + iLevel);
+			}
+			{
+				std::lock_guard<std::mutex> lock(readyMutex);
+				readyOctaves = iOctave + 1;
+			}
+			readyCondition.notify_one();
+			if (iOctave + 1 < octaveCount) result.pyramid[first + levelCount - 1].image.downsample(result.pyramid[first + result.levelCount].image);
+		}
+	};
 
-	result.rowsBySigma.push_back(0);
-	for (int iOctave = 0; iOctave < octaveCount; iOctave++) {
-		sigma = sigma0;
-		
-		// Основные изображения октавы
-		result.pyramid.push_back({ iOctave, 0, sigma, summarySigma, curImg }); 
-		for (int iLevel = 1; iLevel < levelCount; iLevel++) {
-			double newSigma = sigma * levelStep;
-			double sigmaTo = std::sqrt(newSigma * newSigma - sigma * sigma);
-			curImg = curImg.gaussian(sigmaTo);
-			sigma = newSigma;
-			summarySigma *= levelStep;
-			result.pyramid.push_back({ iOctave, iLevel, sigma, summarySigma,  curImg });
-			result.rowsBySigma.push_back(iOctave * result.levelCount + iLevel);
+	auto buildOverlapLevels = [&]() {
+		for (int iOctave = 0; iOctave < octaveCount; iOctave++) {
+			{
+				std::unique_lock<std::mutex> lock(readyMutex);
+				readyCondition.wait(lock, [&]() { return readyOctaves > iOctave; });
+			}
+			int last = iOctave * result.levelCount + levelCount - 1;
+			double overlapSigma = result.pyramid[last].sigmaLocal;
+			double overlapSumSigma = result.pyramid[last].sigmaEffective;
+			for (int i = 0; i < overlap; i++) {
+				double newSigma = overlapSigma * levelStep;
+				double sigmaTo = std::sqrt(newSigma * newSigma - overlapSigma * overlapSigma);
+				result.pyramid[last + i].image.gaussian(sigmaTo, result.pyramid[last + i + 1].image, result.buffers[iOctave]);
+				overlapSigma = newSigma;
+				overlapSumSigma *= levelStep;
+				setRowInfo(result.pyramid[last + i + 1], iOctave, levelCount + i, overlapSigma, overlapSumSigma);
+			}
 		}
-		// Дополнительные изображения для построения DoG
-		DoubleMatrix overlapImg(curImg);
-		double overlapSigma = sigma;
-		double overlapSumSigma = summarySigma;
-		for (int i = 0; i < overlap; i++) {
-			double newSigma = overlapSigma * levelStep;
-			double sigmaTo = std::sqrt(newSigma * newSigma - overlapSigma * overlapSigma);
-			overlapImg = overlapImg.gaussian(sigmaTo);
-			overlapSigma = newSigma;
-			overlapSumSigma *= levelStep;
-			result.pyramid.push_back({iOctave, levelCount + i, overlapSigma, overlapSumSigma, overlapImg});
+	};
+
+	// Этапы занимают полосы по порядку, цепочка никогда не ждет второй этап, поэтому при любом числе потоков
+	// (в том числе одном) ожидание готовности октавы завершается. Внутренние свертки распараллеливаются по строкам
+	ThreadPool::global().parallelFor(0, overlap > 0 ? 2 : 1, 1, [&](int stageBegin, int stageEnd) {
+		for (int stage = stageBegin; stage < stageEnd; stage++) {
+			if (stage == 0) buildMainLevels();
+			else buildOverlapLevels();
 		}
-		curImg = curImg.downsample();
-	}
+	});
+}
 
-	return result;
+template<typename T>
+size_t BasicPyramid<T>::getByteSize() const
+{
+	size_t size = 0;
+	for (const BasicPyramidRow<T>& row : pyramid) {
+		size += row.image.getByteSize();
+	}
+	return size;
 }
+
+template class BasicPyramid<double>;
+template class BasicPyramid<float>;
@@ -3,15 +3,18 @@
 #include "DoubleMatrix.h"
 #include "KeyPoint.h"
 
-struct PyramidRow {
+template<typename T>
+struct BasicPyramidRow {
 	int octave;
 	int level;
 	double sigmaLocal;
 	double sigmaEffective;
-	DoubleMatrix image;
+	Matrix<T> image;
 };
 
-class Pyramid
+// Пирамида изображений с элементами типа T (double или float)
+template<typename T>
+class BasicPyramid
 {
 private:
 	// Число октав
@@ -25,44 +28,68 @@ private:
 	// Начальное значние сигмы в пирамиде
 	double sigma0;
 	// Список изображений
-	std::vector<PyramidRow> pyramid;
+	std::vector<BasicPyramidRow<T>> pyramid;
 	// Индексы изображений по увеличению значения sigmaEffective, для поиска изображений по сигме
 	std::vector<int> rowsBySigma;
+	// Промежуточные буферы свертки по строке (по одному на октаву) для построения пирамиды на месте
+	std::vector<Matrix<T>> buffers;
 
-	// Возвращает список соседних точек в окрестности из трех соседних изображений
-	std::vector<double> getNeighbors3d(int x, int y, int iOctave, int iLevel, int winSize);
+	// Проверяет, что точка cur(y, x) строго больше или строго меньше всех соседей в окне (2 * offset + 1)^2
+	// на трех соседних изображениях. Сравнение прекращается на первом соседе, нарушающем условие
+	static bool isExtremum3d(const Matrix<T>& prev, const Matrix<T>& cur, const Matrix<T>& next, int x, int y, int offset);
+	// Заполняет параметры строки пирамиды, изображение строки не меняется
+	static void setRowInfo(BasicPyramidRow<T>& row, int octave, int level, double sigmaLocal, double sigmaEffective);
 
 public:
-	std::vector<PyramidRow>& get();
-	PyramidRow& get(int i);
-	PyramidRow& get(int octave, int level) { return pyramid[octave * levelCount + level]; }
+	using Row = BasicPyramidRow<T>;
+
+	std::vector<Row>& get();
+	Row& get(int i);
+	Row& get(int octave, int level) { return pyramid[octave * levelCount + level]; }
 	// Возвращает изображение ближайшее к заданной сигме
-	PyramidRow& getBySigma(double sigma);
+	Row& getBySigma(double sigma);
 	// Возвращает из заданной октавы изображение ближайшее к заданной сигме
-	PyramidRow& getBySigma(int octave, double sigma);
-	DoubleMatrix& getImage(int i);
-	DoubleMatrix& getImage(int octave, int level) { return get(octave, level).image; }
+	Row& getBySigma(int octave, double sigma) { return pyramid[getIndexBySigma(octave, sigma)]; }
+	// Индекс изображения заданной октавы, ближайшего к заданной сигме
+	int getIndexBySigma(int octave, double sigma);
+	Matrix<T>& getImage(int i);
+	Matrix<T>& getImage(int octave, int level) { return get(octave, level).image; }
 	int getOctaveCount() { return octaveCount; }
 	int getLevelCount() { return levelCount; }
 	int getOverlapCount() { return overlapCount; }
 	double getSigmaStep() { return sigmaStep; }
 	double getSigma0() { return sigma0; }
 
-	PyramidRow& operator[](int i) { return pyramid[i]; }
+	Row& operator[](int i) { return pyramid[i]; }
 
+	// Сохранение изображений пирамиды в каталог dir: изображения упаковываются в байты в вызывающем потоке,
+	// кодирование и запись выполняет ImageWriter::global() в фоне (дождаться записи - ImageWriter::global().wait())
 	void saveImage(const QString& dir, int format = 0);
 	double getPixel(int x, int y, double sigma);
 
-	Pyramid createDoGPyramid();
-	Pyramid createHarrisPyramid(int windowSize = 5);
-	Pyramid createGradientPyramid();
-	Pyramid createDirectionsPyramid();
+	// Суммарный размер изображений пирамиды в байтах
+	size_t getByteSize() const;
+
+	BasicPyramid createDoGPyramid();
+	// Строит DoG в result, изображения result того же размера перезаписываются без выделения памяти
+	void createDoGPyramid(BasicPyramid& result);
+	BasicPyramid createHarrisPyramid(int windowSize = 5);
+	BasicPyramid createGradientPyramid();
+	BasicPyramid createDirectionsPyramid();
+	// Пирамиды модулей и направлений градиента за один проход по каждому изображению (Matrix::gradient)
+	void createGradientPyramids(BasicPyramid& magnitudes, BasicPyramid& directions, bool fastAtan = false);
 	// Возвращает список экстремумов, которые больше заданного порога в DoG
 	std::vector<KeyPoint> findExtremePoints(int winSize, double threshold = 0.03);
 	// Создает пирамиду из заданного изображения
-	static Pyramid createFrom(const DoubleMatrix& image, double sigmaA, double sigma0, int octaveCount, int levelCount);
+	static BasicPyramid createFrom(const Matrix<T>& image, double sigmaA, double sigma0, int octaveCount, int levelCount);
 	// Создает пирамиду из заданного изображения с дополнительными, невходящими в октаву (для DoG)
-	static Pyramid createWithOverlap(const DoubleMatrix& image, double sigmaA, double sigma0, int octaveCount, int levelCount, int overlap = 1);
+	static BasicPyramid createWithOverlap(const Matrix<T>& image, double sigmaA, double sigma0, int octaveCount, int levelCount, int overlap = 1);
+	// То же, что createWithOverlap, но пирамида строится в result: при тех же размерах изображения и параметрах
+	// изображения и буферы result перезаписываются на месте (для последовательности кадров одного размера)
+	static void createWithOverlap(const Matrix<T>& image, double sigmaA, double sigma0, int octaveCount, int levelCount, int overlap, BasicPyramid& result);
 };
 
-
+using PyramidRow = BasicPyramidRow<double>;
+using Pyramid = BasicPyramid<double>;
+using FloatPyramidRow = BasicPyramidRow<float>;
+using FloatPyramid = BasicPyramid<float>;
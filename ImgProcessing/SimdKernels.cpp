@@ -0,0 +1,1275 @@
+#include "SimdKernels.h"
+#include <cmath>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(SIMD_X86) && !defined(_MSC_VER)
+#define SIMD_TARGET_SSE2 __attribute__((target("sse2")))
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2,fma")))
+// Без FMA: компилятор не может объединить умножение и сложение, результат совпадает со скалярным
+#define SIMD_TARGET_AVX2_NOFMA __attribute__((target("avx2")))
+#else
+#define SIMD_TARGET_SSE2
+#define SIMD_TARGET_AVX2
+#define SIMD_TARGET_AVX2_NOFMA
+#endif
+
+SimdKernels::Level SimdKernels::currentLevel = SimdKernels::detectLevel();
+
+SimdKernels::Level SimdKernels::detectLevel()
+{
+#if defined(SIMD_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+	__cpuid(info, 1);
+	bool sse2 = (info[3] & (1 << 26)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	bool fma = (info[2] & (1 << 12)) != 0;
+	bool avx2 = false;
+	if (maxLeaf >= 7) {
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+	// ОС должна сохранять регистры YMM при переключении контекста
+	bool ymmEnabled = osxsave && (_xgetbv(0) & 6) == 6;
+	if (avx && avx2 && fma && ymmEnabled) return Level::AVX2;
+	if (sse2) return Level::SSE2;
+	return Level::Scalar;
+#elif defined(SIMD_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return Level::AVX2;
+	if (__builtin_cpu_supports("sse2")) return Level::SSE2;
+	return Level::Scalar;
+#else
+	return Level::Scalar;
+#endif
+}
+
+SimdKernels::Level SimdKernels::getSupportedLevel()
+{
+	static Level supported = detectLevel();
+	return supported;
+}
+
+void SimdKernels::setLevel(Level level)
+{
+	Level supported = getSupportedLevel();
+	currentLevel = static_cast<int>(level) <= static_cast<int>(supported) ? level : supported;
+}
+
+const char* SimdKernels::getLevelName(Level level)
+{
+	if (level == Level::AVX2) return "AVX2";
+	else if (level == Level::SSE2) return "SSE2";
+	else return "Scalar";
+}
+
+namespace
+{
+	template<typename T>
+	void convolveRowScalar(const T* src, T* dst, int begin, int end, const T* kernel, int kernelSize)
+	{
+		int offset = kernelSize / 2;
+		for (int j = begin; j < end; j++) {
+			const T* s = src + j + offset;
+			T sum = 0;
+			for (int t = 0; t < kernelSize; t++) {
+				sum += s[-t] * kernel[t];
+			}
+			dst[j] = sum;
+		}
+	}
+
+	template<typename T>
+	void convolveColScalar(const T* const* rows, T* dst, int begin, int end, const T* kernel, int kernelSize)
+	{
+		for (int j = begin; j < end; j++) {
+			T sum = 0;
+			for (int t = 0; t < kernelSize; t++) {
+				sum += rows[t][j] * kernel[t];
+			}
+			dst[j] = sum;
+		}
+	}
+
+	// Сложение частичных сумм в фиксированном порядке: (p[k] + p[k + 4]), затем попарно
+	template<typename T>
+	T reducePartialSums(const T* partial)
+	{
+		T c0 = partial[0] + partial[4];
+		T c1 = partial[1] + partial[5];
+		T c2 = partial[2] + partial[6];
+		T c3 = partial[3] + partial[7];
+		return (c0 + c1) + (c2 + c3);
+	}
+
+	template<typename T, typename Op>
+	double distanceScalar(const T* a, const T* b, int n, Op op)
+	{
+		T partial[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+		int i = 0;
+		for (; i + 8 <= n; i += 8) {
+			for (int k = 0; k < 8; k++) partial[k] += op(a[i + k] - b[i + k]);
+		}
+		T sum = reducePartialSums(partial);
+		for (; i < n; i++) sum += op(a[i] - b[i]);
+		return sum;
+	}
+
+	long long squaredDistanceScalar(const uint8_t* a, const uint8_t* b, int n)
+	{
+		long long sum = 0;
+		for (int i = 0; i < n; i++) {
+			int d = a[i] - b[i];
+			sum += d * d;
+		}
+		return sum;
+	}
+
+	long long absDistanceScalar(const uint8_t* a, const uint8_t* b, int n)
+	{
+		long long sum = 0;
+		for (int i = 0; i < n; i++) {
+			sum += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+		}
+		return sum;
+	}
+
+	const double Pi = 3.14159265358979323846;
+
+	// Коэффициенты приближения atan(z) = z * (1 + a2 z^2 + ... + a16 z^16) на [0, 1] с ошибкой 2e-8
+	// (Абрамовиц, Стиган, 4.4.49)
+	const double AtanCoefficients[8] = {
+		-0.3333314528, 0.1999355085, -0.1420889944, 0.1065626393,
+		-0.0752896400, 0.0429096138, -0.0161657367, 0.0028662257
+	};
+
+	// Приближение atan2(y, x), знаки нулей учитываются как в std::atan2
+	double fastAtan2(double y, double x)
+	{
+		double ax = std::abs(x);
+		double ay = std::abs(y);
+		double maxValue = std::max(ax, ay);
+		double z = maxValue > 0 ? std::min(ax, ay) / maxValue : 0.0;
+		double z2 = z * z;
+		double p = AtanCoefficients[7];
+		for (int k = 6; k >= 0; k--) p = p * z2 + AtanCoefficients[k];
+		double a = z * (1 + p * z2);
+		if (ay > ax) a = Pi / 2 - a;
+		if (std::signbit(x)) a = Pi - a;
+		if (std::signbit(y)) a = -a;
+		return a;
+	}
+
+	template<typename T>
+	void gradientPolarScalar(const T* dx, const T* dy, T* magnitude, T* direction, int n)
+	{
+		for (int i = 0; i < n; i++) {
+			magnitude[i] = std::sqrt(dx[i] * dx[i] + dy[i] * dy[i]);
+			double phi = fastAtan2(-dy[i], -dx[i]) + Pi;
+			direction[i] = static_cast<T>(std::min(std::max(phi, 0.0), 2 * Pi));
+		}
+	}
+
+	template<typename T>
+	void lumaScalar(const uint32_t* pixels, T* dst, int n)
+	{
+		for (int i = 0; i < n; i++) {
+			int r = (pixels[i] >> 16) & 0xff;
+			int g = (pixels[i] >> 8) & 0xff;
+			int b = pixels[i] & 0xff;
+			dst[i] = static_cast<T>(static_cast<int>(SimdKernels::LumaRed * r + SimdKernels::LumaGreen * g + SimdKernels::LumaBlue * b));
+		}
+	}
+
+	template<typename T>
+	void normalizeScalar(T* values, int n, double minValue, double maxValue, double newMin, double newMax)
+	{
+		for (int i = 0; i < n; i++) {
+			values[i] = static_cast<T>((values[i] - minValue) * (newMax - newMin) / (maxValue - minValue) + newMin);
+		}
+	}
+
+	template<typename T>
+	void normalizeToBytesScalar(const T* values, uint8_t* dst, int n, double minValue, double maxValue)
+	{
+		for (int i = 0; i < n; i++) {
+			T value = static_cast<T>((values[i] - minValue) * 255.0 / (maxValue - minValue));
+			// Сравнения в порядке maxpd/minpd: NaN превращается в 0
+			value = value > 0 ? value : 0;
+			value = value < 255 ? value : 255;
+			dst[i] = static_cast<uint8_t>(static_cast<int>(value));
+		}
+	}
+
+	struct SquareValue
+	{
+		template<typename T>
+		T operator()(T x) const { return x * x; }
+	};
+
+	struct AbsValue
+	{
+		template<typename T>
+		T operator()(T x) const { return x < 0 ? -x : x; }
+	};
+}
+
+void SimdKernels::convolveRow(const double* src, double* dst, int begin, int end, const double* kernel, int kernelSize)
+{
+	if (currentLevel == Level::AVX2) convolveRowAVX2(src, dst, begin, end, kernel, kernelSize);
+	else if (currentLevel == Level::SSE2) convolveRowSSE2(src, dst, begin, end, kernel, kernelSize);
+	else convolveRowScalar(src, dst, begin, end, kernel, kernelSize);
+}
+
+void SimdKernels::convolveCol(const double* const* rows, double* dst, int width, const double* kernel, int kernelSize)
+{
+	if (currentLevel == Level::AVX2) convolveColAVX2(rows, dst, width, kernel, kernelSize);
+	else if (currentLevel == Level::SSE2) convolveColSSE2(rows, dst, width, kernel, kernelSize);
+	else convolveColScalar(rows, dst, 0, width, kernel, kernelSize);
+}
+
+void SimdKernels::convolveRow(const float* src, float* dst, int begin, int end, const float* kernel, int kernelSize)
+{
+	if (currentLevel == Level::AVX2) convolveRowAVX2(src, dst, begin, end, kernel, kernelSize);
+	else if (currentLevel == Level::SSE2) convolveRowSSE2(src, dst, begin, end, kernel, kernelSize);
+	else convolveRowScalar(src, dst, begin, end, kernel, kernelSize);
+}
+
+void SimdKernels::convolveCol(const float* const* rows, float* dst, int width, const float* kernel, int kernelSize)
+{
+	if (currentLevel == Level::AVX2) convolveColAVX2(rows, dst, width, kernel, kernelSize);
+	else if (currentLevel == Level::SSE2) convolveColSSE2(rows, dst, width, kernel, kernelSize);
+	else convolveColScalar(rows, dst, 0, width, kernel, kernelSize);
+}
+
+double SimdKernels::squaredDistance(const double* a, const double* b, int n)
+{
+	if (currentLevel == Level::AVX2) return squaredDistanceAVX2(a, b, n);
+	else if (currentLevel == Level::SSE2) return squaredDistanceSSE2(a, b, n);
+	else return distanceScalar(a, b, n, SquareValue());
+}
+
+double SimdKernels::absDistance(const double* a, const double* b, int n)
+{
+	if (currentLevel == Level::AVX2) return absDistanceAVX2(a, b, n);
+	else if (currentLevel == Level::SSE2) return absDistanceSSE2(a, b, n);
+	else return distanceScalar(a, b, n, AbsValue());
+}
+
+double SimdKernels::squaredDistance(const float* a, const float* b, int n)
+{
+	if (currentLevel == Level::AVX2) return squaredDistanceAVX2(a, b, n);
+	else if (currentLevel == Level::SSE2) return squaredDistanceSSE2(a, b, n);
+	else return distanceScalar(a, b, n, SquareValue());
+}
+
+double SimdKernels::absDistance(const float* a, const float* b, int n)
+{
+	if (currentLevel == Level::AVX2) return absDistanceAVX2(a, b, n);
+	else if (currentLevel == Level::SSE2) return absDistanceSSE2(a, b, n);
+	else return distanceScalar(a, b, n, AbsValue());
+}
+
+long long SimdKernels::squaredDistance(const uint8_t* a, const uint8_t* b, int n)
+{
+	if (currentLevel == Level::AVX2) return squaredDistanceAVX2(a, b, n);
+	else if (currentLevel == Level::SSE2) return squaredDistanceSSE2(a, b, n);
+	else return squaredDistanceScalar(a, b, n);
+}
+
+long long SimdKernels::absDistance(const uint8_t* a, const uint8_t* b, int n)
+{
+	if (currentLevel == Level::AVX2) return absDistanceAVX2(a, b, n);
+	else if (currentLevel == Level::SSE2) return absDistanceSSE2(a, b, n);
+	else return absDistanceScalar(a, b, n);
+}
+
+void SimdKernels::gradientPolar(const double* dx, const double* dy, double* magnitude, double* direction, int n)
+{
+	if (currentLevel == Level::AVX2) gradientPolarAVX2(dx, dy, magnitude, direction, n);
+	else gradientPolarScalar(dx, dy, magnitude, direction, n);
+}
+
+void SimdKernels::gradientPolar(const float* dx, const float* dy, float* magnitude, float* direction, int n)
+{
+	if (currentLevel == Level::AVX2) gradientPolarAVX2(dx, dy, magnitude, direction, n);
+	else gradientPolarScalar(dx, dy, magnitude, direction, n);
+}
+
+void SimdKernels::luma(const uint32_t* pixels, double* dst, int n)
+{
+	if (currentLevel == Level::AVX2) lumaAVX2(pixels, dst, n);
+	else if (currentLevel == Level::SSE2) lumaSSE2(pixels, dst, n);
+	else lumaScalar(pixels, dst, n);
+}
+
+void SimdKernels::luma(const uint32_t* pixels, float* dst, int n)
+{
+	if (currentLevel == Level::AVX2) lumaAVX2(pixels, dst, n);
+	else if (currentLevel == Level::SSE2) lumaSSE2(pixels, dst, n);
+	else lumaScalar(pixels, dst, n);
+}
+
+void SimdKernels::normalize(double* values, int n, double minValue, double maxValue, double newMin, double newMax)
+{
+	if (currentLevel == Level::AVX2) normalizeAVX2(values, n, minValue, maxValue, newMin, newMax);
+	else if (currentLevel == Level::SSE2) normalizeSSE2(values, n, minValue, maxValue, newMin, newMax);
+	else normalizeScalar(values, n, minValue, maxValue, newMin, newMax);
+}
+
+void SimdKernels::normalize(float* values, int n, double minValue, double maxValue, double newMin, double newMax)
+{
+	if (currentLevel == Level::AVX2) normalizeAVX2(values, n, minValue, maxValue, newMin, newMax);
+	else if (currentLevel == Level::SSE2) normalizeSSE2(values, n, minValue, maxValue, newMin, newMax);
+	else normalizeScalar(values, n, minValue, maxValue, newMin, newMax);
+}
+
+void SimdKernels::normalizeToBytes(const double* values, uint8_t* dst, int n, double minValue, double maxValue)
+{
+	if (currentLevel == Level::AVX2) normalizeToBytesAVX2(values, dst, n, minValue, maxValue);
+	else if (currentLevel == Level::SSE2) normalizeToBytesSSE2(values, dst, n, minValue, maxValue);
+	else normalizeToBytesScalar(values, dst, n, minValue, maxValue);
+}
+
+void SimdKernels::normalizeToBytes(const float* values, uint8_t* dst, int n, double minValue, double maxValue)
+{
+	if (currentLevel == Level::AVX2) normalizeToBytesAVX2(values, dst, n, minValue, maxValue);
+	else if (currentLevel == Level::SSE2) normalizeToBytesSSE2(values, dst, n, minValue, maxValue);
+	else normalizeToBytesScalar(values, dst, n, minValue, maxValue);
+}
+
+#ifdef SIMD_X86
+
+SIMD_TARGET_SSE2
+void SimdKernels::convolveRowSSE2(const double* src, double* dst, int begin, int end, const double* kernel, int kernelSize)
+{
+	int offset = kernelSize / 2;
+	int j = begin;
+	for (; j + 2 <= end; j += 2) {
+		const double* s = src + j + offset;
+		__m128d sum = _mm_setzero_pd();
+		for (int t = 0; t < kernelSize; t++) {
+			sum = _mm_add_pd(sum, _mm_mul_pd(_mm_loadu_pd(s - t), _mm_set1_pd(kernel[t])));
+		}
+		_mm_storeu_pd(dst + j, sum);
+	}
+	convolveRowScalar(src, dst, j, end, kernel, kernelSize);
+}
+
+SIMD_TARGET_SSE2
+void SimdKernels::convolveColSSE2(const double* const* rows, double* dst, int width, const double* kernel, int kernelSize)
+{
+	int j = 0;
+	// Блоками по 8 столбцов: сумма держится в регистрах на протяжении всего ядра
+	for (; j + 8 <= width; j += 8) {
+		__m128d sum0 = _mm_setzero_pd();
+		__m128d sum1 = _mm_setzero_pd();
+		__m128d sum2 = _mm_setzero_pd();
+		__m128d sum3 = _mm_setzero_pd();
+		for (int t = 0; t < kernelSize; t++) {
+			const double* row = rows[t] + j;
+			__m128d k = _mm_set1_pd(kernel[t]);
+			sum0 = _mm_add_pd(sum0, _mm_mul_pd(_mm_loadu_pd(row), k));
+			sum1 = _mm_add_pd(sum1, _mm_mul_pd(_mm_loadu_pd(row + 2), k));
+			sum2 = _mm_add_pd(sum2, _mm_mul_pd(_mm_loadu_pd(row + 4), k));
+			sum3 = _mm_add_pd(sum3, _mm_mul_pd(_mm_loadu_pd(row + 6), k));
+		}
+		_mm_storeu_pd(dst + j, sum0);
+		_mm_storeu_pd(dst + j + 2, sum1);
+		_mm_storeu_pd(dst + j + 4, sum2);
+		_mm_storeu_pd(dst + j + 6, sum3);
+	}
+	convolveColScalar(rows, dst, j, width, kernel, kernelSize);
+}
+
+SIMD_TARGET_AVX2
+void SimdKernels::convolveRowAVX2(const double* src, double* dst, int begin, int end, const double* kernel, int kernelSize)
+{
+	int offset = kernelSize / 2;
+	int j = begin;
+	for (; j + 8 <= end; j += 8) {
+		const double* s = src + j + offset;
+		__m256d sum0 = _mm256_setzero_pd();
+		__m256d sum1 = _mm256_setzero_pd();
+		for (int t = 0; t < kernelSize; t++) {
+			__m256d k = _mm256_set1_pd(kernel[t]);
+			sum0 = _mm256_fmadd_pd(_mm256_loadu_pd(s - t), k, sum0);
+			sum1 = _mm256_fmadd_pd(_mm256_loadu_pd(s - t + 4), k, sum1);
+		}
+		_mm256_storeu_pd(dst + j, sum0);
+		_mm256_storeu_pd(dst + j + 4, sum1);
+	}
+	for (; j + 4 <= end; j += 4) {
+		const double* s = src + j + offset;
+		__m256d sum = _mm256_setzero_pd();
+		for (int t = 0; t < kernelSize; t++) {
+			sum = _mm256_fmadd_pd(_mm256_loadu_pd(s - t), _mm256_set1_pd(kernel[t]), sum);
+		}
+		_mm256_storeu_pd(dst + j, sum);
+	}
+	convolveRowScalar(src, dst, j, end, kernel, kernelSize);
+}
+
+SIMD_TARGET_AVX2
+void SimdKernels::convolveColAVX2(const double* const* rows, double* dst, int width, const double* kernel, int kernelSize)
+{
+	int j = 0;
+	// Блоками по 16 столбцов: сумма держится в регистрах на протяжении всего ядра
+	for (; j + 16 <= width; j += 16) {
+		__m256d sum0 = _mm256_setzero_pd();
+		__m256d sum1 = _mm256_setzero_pd();
+		__m256d sum2 = _mm256_setzero_pd();
+		__m256d sum3 = _mm256_setzero_pd();
+		for (int t = 0; t < kernelSize; t++) {
+			const double* row = rows[t] + j;
+			__m256d k = _mm256_set1_pd(kernel[t]);
+			sum0 = _mm256_fmadd_pd(_mm256_loadu_pd(row), k, sum0);
+			sum1 = _mm256_fmadd_pd(_mm256_loadu_pd(row + 4), k, sum1);
+			sum2 = _mm256_fmadd_pd(_mm256_loadu_pd(row + 8), k, sum2);
+			sum3 = _mm256_fmadd_pd(_mm256_loadu_pd(row + 12), k, sum3);
+		}
+		_mm256_storeu_pd(dst + j, sum0);
+		_mm256_storeu_pd(dst + j + 4, sum1);
+		_mm256_storeu_pd(dst + j + 8, sum2);
+		_mm256_storeu_pd(dst + j + 12, sum3);
+	}
+	for (; j + 4 <= width; j += 4) {
+		__m256d sum = _mm256_setzero_pd();
+		for (int t = 0; t < kernelSize; t++) {
+			sum = _mm256_fmadd_pd(_mm256_loadu_pd(rows[t] + j), _mm256_set1_pd(kernel[t]), sum);
+		}
+		_mm256_storeu_pd(dst + j, sum);
+	}
+	convolveColScalar(rows, dst, j, width, kernel, kernelSize);
+}
+
+SIMD_TARGET_SSE2
+void SimdKernels::convolveRowSSE2(const float* src, float* dst, int begin, int end, const float* kernel, int kernelSize)
+{
+	int offset = kernelSize / 2;
+	int j = begin;
+	for (; j + 4 <= end; j += 4) {
+		const float* s = src + j + offset;
+		__m128 sum = _mm_setzero_ps();
+		for (int t = 0; t < kernelSize; t++) {
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(s - t), _mm_set1_ps(kernel[t])));
+		}
+		_mm_storeu_ps(dst + j, sum);
+	}
+	convolveRowScalar(src, dst, j, end, kernel, kernelSize);
+}
+
+SIMD_TARGET_SSE2
+void SimdKernels::convolveColSSE2(const float* const* rows, float* dst, int width, const float* kernel, int kernelSize)
+{
+	int j = 0;
+	for (; j + 16 <= width; j += 16) {
+		__m128 sum0 = _mm_setzero_ps();
+		__m128 sum1 = _mm_setzero_ps();
+		__m128 sum2 = _mm_setzero_ps();
+		__m128 sum3 = _mm_setzero_ps();
+		for (int t = 0; t < kernelSize; t++) {
+			const float* row = rows[t] + j;
+			__m128 k = _mm_set1_ps(kernel[t]);
+			sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(row), k));
+			sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(row + 4), k));
+			sum2 = _mm_add_ps(sum2, _mm_mul_ps(_mm_loadu_ps(row + 8), k));
+			sum3 = _mm_add_ps(sum3, _mm_mul_ps(_mm_loadu_ps(row + 12), k));
+		}
+		_mm_storeu_ps(dst + j, sum0);
+		_mm_storeu_ps(dst + j + 4, sum1);
+		_mm_storeu_ps(dst + j + 8, sum2);
+		_mm_storeu_ps(dst + j + 12, sum3);
+	}
+	convolveColScalar(rows, dst, j, width, kernel, kernelSize);
+}
+
+SIMD_TARGET_AVX2
+void SimdKernels::convolveRowAVX2(const float* src, float* dst, int begin, int end, const float* kernel, int kernelSize)
+{
+	int offset = kernelSize / 2;
+	int j = begin;
+	for (; j + 16 <= end; j += 16) {
+		const float* s = src + j + offset;
+		__m256 sum0 = _mm256_setzero_ps();
+		__m256 sum1 = _mm256_setzero_ps();
+		for (int t = 0; t < kernelSize; t++) {
+			__m256 k = _mm256_set1_ps(kernel[t]);
+			sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(s - t), k, sum0);
+			sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(s - t + 8), k, sum1);
+		}
+		_mm256_storeu_ps(dst + j, sum0);
+		_mm256_storeu_ps(dst + j + 8, sum1);
+	}
+	for (; j + 8 <= end; j += 8) {
+		const float* s = src + j + offset;
+		__m256 sum = _mm256_setzero_ps();
+		for (int t = 0; t < kernelSize; t++) {
+			sum = _mm256_fmadd_ps(_mm256_loadu_ps(s - t), _mm256_set1_ps(kernel[t]), sum);
+		}
+		_mm256_storeu_ps(dst + j, sum);
+	}
+	convolveRowScalar(src, dst, j, end, kernel, kernelSize);
+}
+
+SIMD_TARGET_AVX2
+void SimdKernels::convolveColAVX2(const float* const* rows, float* dst, int width, const float* kernel, int kernelSize)
+{
+	int j = 0;
+	for (; j + 32 <= width; j += 32) {
+		__m256 sum0 = _mm256_setzero_ps();
+		__m256 sum1 = _mm256_setzero_ps();
+		__m256 sum2 = _mm256_setzero_ps();
+		__m256 sum3 = _mm256_setzero_ps();
+		for (int t = 0; t < kernelSize; t++) {
+			const float* row = rows[t] + j;
+			__m256 k = _mm256_set1_ps(kernel[t]);
+			sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(row), k, sum0);
+			sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(row + 8), k, sum1);
+			sum2 = _mm256_fmadd_ps(_mm256_loadu_ps(row + 16), k, sum2);
+			sum3 = _mm256_fmadd_ps(_mm256_loadu_ps(row + 24), k, sum3);
+		}
+		_mm256_storeu_ps(dst + j, sum0);
+		_mm256_storeu_ps(dst + j + 8, sum1);
+		_mm256_storeu_ps(dst + j + 16, sum2);
+		_mm256_storeu_ps(dst + j + 24, sum3);
+	}
+	for (; j + 8 <= width; j += 8) {
+		__m256 sum = _mm256_setzero_ps();
+		for (int t = 0; t < kernelSize; t++) {
+			sum = _mm256_fmadd_ps(_mm256_loadu_ps(rows[t] + j), _mm256_set1_ps(kernel[t]), sum);
+		}
+		_mm256_storeu_ps(dst + j, sum);
+	}
+	convolveColScalar(rows, dst, j, width, kernel, kernelSize);
+}
+
+SIMD_TARGET_SSE2
+double SimdKernels::squaredDistanceSSE2(const double* a, const double* b, int n)
+{
+	__m128d sum0 = _mm_setzero_pd();
+	__m128d sum1 = _mm_setzero_pd();
+	__m128d sum2 = _mm_setzero_pd();
+	__m128d sum3 = _mm_setzero_pd();
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128d d0 = _mm_sub_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i));
+		__m128d d1 = _mm_sub_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2));
+		__m128d d2 = _mm_sub_pd(_mm_loadu_pd(a + i + 4), _mm_loadu_pd(b + i + 4));
+		__m128d d3 = _mm_sub_pd(_mm_loadu_pd(a + i + 6), _mm_loadu_pd(b + i + 6));
+		sum0 = _mm_add_pd(sum0, _mm_mul_pd(d0, d0));
+		sum1 = _mm_add_pd(sum1, _mm_mul_pd(d1, d1));
+		sum2 = _mm_add_pd(sum2, _mm_mul_pd(d2, d2));
+		sum3 = _mm_add_pd(sum3, _mm_mul_pd(d3, d3));
+	}
+	double partial[8];
+	_mm_storeu_pd(partial, sum0);
+	_mm_storeu_pd(partial + 2, sum1);
+	_mm_storeu_pd(partial + 4, sum2);
+	_mm_storeu_pd(partial + 6, sum3);
+	double sum = reducePartialSums(partial);
+	for (; i < n; i++) sum += SquareValue()(a[i] - b[i]);
+	return sum;
+}
+
+SIMD_TARGET_SSE2
+double SimdKernels::absDistanceSSE2(const double* a, const double* b, int n)
+{
+	const __m128d signMask = _mm_set1_pd(-0.0);
+	__m128d sum0 = _mm_setzero_pd();
+	__m128d sum1 = _mm_setzero_pd();
+	__m128d sum2 = _mm_setzero_pd();
+	__m128d sum3 = _mm_setzero_pd();
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		sum0 = _mm_add_pd(sum0, _mm_andnot_pd(signMask, _mm_sub_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i))));
+		sum1 = _mm_add_pd(sum1, _mm_andnot_pd(signMask, _mm_sub_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2))));
+		sum2 = _mm_add_pd(sum2, _mm_andnot_pd(signMask, _mm_sub_pd(_mm_loadu_pd(a + i + 4), _mm_loadu_pd(b + i + 4))));
+		sum3 = _mm_add_pd(sum3, _mm_andnot_pd(signMask, _mm_sub_pd(_mm_loadu_pd(a + i + 6), _mm_loadu_pd(b + i + 6))));
+	}
+	double partial[8];
+	_mm_storeu_pd(partial, sum0);
+	_mm_storeu_pd(partial + 2, sum1);
+	_mm_storeu_pd(partial + 4, sum2);
+	_mm_storeu_pd(partial + 6, sum3);
+	double sum = reducePartialSums(partial);
+	for (; i < n; i++) sum += AbsValue()(a[i] - b[i]);
+	return sum;
+}
+
+// FMA не используется, чтобы результат совпадал со скалярной реализацией
+SIMD_TARGET_AVX2_NOFMA
+double SimdKernels::squaredDistanceAVX2(const double* a, const double* b, int n)
+{
+	__m256d sum0 = _mm256_setzero_pd();
+	__m256d sum1 = _mm256_setzero_pd();
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+		__m256d d1 = _mm256_sub_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4));
+		sum0 = _mm256_add_pd(sum0, _mm256_mul_pd(d0, d0));
+		sum1 = _mm256_add_pd(sum1, _mm256_mul_pd(d1, d1));
+	}
+	double partial[8];
+	_mm256_storeu_pd(partial, sum0);
+	_mm256_storeu_pd(partial + 4, sum1);
+	double sum = reducePartialSums(partial);
+	for (; i < n; i++) sum += SquareValue()(a[i] - b[i]);
+	return sum;
+}
+
+SIMD_TARGET_AVX2_NOFMA
+double SimdKernels::absDistanceAVX2(const double* a, const double* b, int n)
+{
+	const __m256d signMask = _mm256_set1_pd(-0.0);
+	__m256d sum0 = _mm256_setzero_pd();
+	__m256d sum1 = _mm256_setzero_pd();
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		sum0 = _mm256_add_pd(sum0, _mm256_andnot_pd(signMask, _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i))));
+		sum1 = _mm256_add_pd(sum1, _mm256_andnot_pd(signMask, _mm256_sub_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4))));
+	}
+	double partial[8];
+	_mm256_storeu_pd(partial, sum0);
+	_mm256_storeu_pd(partial + 4, sum1);
+	double sum = reducePartialSums(partial);
+	for (; i < n; i++) sum += AbsValue()(a[i] - b[i]);
+	return sum;
+}
+
+SIMD_TARGET_SSE2
+double SimdKernels::squaredDistanceSSE2(const float* a, const float* b, int n)
+{
+	__m128 sum0 = _mm_setzero_ps();
+	__m128 sum1 = _mm_setzero_ps();
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128 d0 = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+		__m128 d1 = _mm_sub_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4));
+		sum0 = _mm_add_ps(sum0, _mm_mul_ps(d0, d0));
+		sum1 = _mm_add_ps(sum1, _mm_mul_ps(d1, d1));
+	}
+	float partial[8];
+	_mm_storeu_ps(partial, sum0);
+	_mm_storeu_ps(partial + 4, sum1);
+	float sum = reducePartialSums(partial);
+	for (; i < n; i++) sum += SquareValue()(a[i] - b[i]);
+	return sum;
+}
+
+SIMD_TARGET_SSE2
+double SimdKernels::absDistanceSSE2(const float* a, const float* b, int n)
+{
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	__m128 sum0 = _mm_setzero_ps();
+	__m128 sum1 = _mm_setzero_ps();
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		sum0 = _mm_add_ps(sum0, _mm_andnot_ps(signMask, _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i))));
+		sum1 = _mm_add_ps(sum1, _mm_andnot_ps(signMask, _mm_sub_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4))));
+	}
+	float partial[8];
+	_mm_storeu_ps(partial, sum0);
+	_mm_storeu_ps(partial + 4, sum1);
+	float sum = reducePartialSums(partial);
+	for (; i < n; i++) sum += AbsValue()(a[i] - b[i]);
+	return sum;
+}
+
+SIMD_TARGET_AVX2_NOFMA
+double SimdKernels::squaredDistanceAVX2(const float* a, const float* b, int n)
+{
+	__m256 sum = _mm256_setzero_ps();
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(d, d));
+	}
+	float partial[8];
+	_mm256_storeu_ps(partial, sum);
+	float total = reducePartialSums(partial);
+	for (; i < n; i++) total += SquareValue()(a[i] - b[i]);
+	return total;
+}
+
+SIMD_TARGET_AVX2_NOFMA
+double SimdKernels::absDistanceAVX2(const float* a, const float* b, int n)
+{
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+	__m256 sum = _mm256_setzero_ps();
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		sum = _mm256_add_ps(sum, _mm256_andnot_ps(signMask, _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i))));
+	}
+	float partial[8];
+	_mm256_storeu_ps(partial, sum);
+	float total = reducePartialSums(partial);
+	for (; i < n; i++) total += AbsValue()(a[i] - b[i]);
+	return total;
+}
+
+// Разности расширяются до 16 бит, madd складывает попарные произведения в 32-битные суммы
+SIMD_TARGET_SSE2
+long long SimdKernels::squaredDistanceSSE2(const uint8_t* a, const uint8_t* b, int n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i sum = _mm_setzero_si128();
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+		__m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+		__m128i d0 = _mm_sub_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+		__m128i d1 = _mm_sub_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+		sum = _mm_add_epi32(sum, _mm_madd_epi16(d0, d0));
+		sum = _mm_add_epi32(sum, _mm_madd_epi16(d1, d1));
+	}
+	int32_t partial[4];
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(partial), sum);
+	long long total = static_cast<long long>(partial[0]) + partial[1] + partial[2] + partial[3];
+	return total + squaredDistanceScalar(a + i, b + i, n - i);
+}
+
+// sad_epu8 сразу дает суммы модулей разностей восьми байт
+SIMD_TARGET_SSE2
+long long SimdKernels::absDistanceSSE2(const uint8_t* a, const uint8_t* b, int n)
+{
+	__m128i sum = _mm_setzero_si128();
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+		__m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+		sum = _mm_add_epi64(sum, _mm_sad_epu8(va, vb));
+	}
+	long long partial[2];
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(partial), sum);
+	return partial[0] + partial[1] + absDistanceScalar(a + i, b + i, n - i);
+}
+
+SIMD_TARGET_AVX2
+long long SimdKernels::squaredDistanceAVX2(const uint8_t* a, const uint8_t* b, int n)
+{
+	__m256i sum = _mm256_setzero_si256();
+	int i = 0;
+	for (; i + 32 <= n; i += 32) {
+		__m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+		__m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i + 16));
+		__m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+		__m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i + 16));
+		__m256i d0 = _mm256_sub_epi16(_mm256_cvtepu8_epi16(a0), _mm256_cvtepu8_epi16(b0));
+		__m256i d1 = _mm256_sub_epi16(_mm256_cvtepu8_epi16(a1), _mm256_cvtepu8_epi16(b1));
+		sum = _mm256_add_epi32(sum, _mm256_madd_epi16(d0, d0));
+		sum = _mm256_add_epi32(sum, _mm256_madd_epi16(d1, d1));
+	}
+	int32_t partial[8];
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(partial), sum);
+	long long total = 0;
+	for (int k = 0; k < 8; k++) total += partial[k];
+	return total + squaredDistanceScalar(a + i, b + i, n - i);
+}
+
+SIMD_TARGET_AVX2
+long long SimdKernels::absDistanceAVX2(const uint8_t* a, const uint8_t* b, int n)
+{
+	__m256i sum = _mm256_setzero_si256();
+	int i = 0;
+	for (; i + 32 <= n; i += 32) {
+		__m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+		__m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+		sum = _mm256_add_epi64(sum, _mm256_sad_epu8(va, vb));
+	}
+	long long partial[4];
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(partial), sum);
+	return partial[0] + partial[1] + partial[2] + partial[3] + absDistanceScalar(a + i, b + i, n - i);
+}
+
+// Ветви atan2 выбираются масками: blendv берет значение по знаковому разряду маски
+SIMD_TARGET_AVX2_NOFMA
+void SimdKernels::gradientPolarAVX2(const double* dx, const double* dy, double* magnitude, double* direction, int n)
+{
+	const __m256d signMask = _mm256_set1_pd(-0.0);
+	const __m256d pi = _mm256_set1_pd(Pi);
+	const __m256d halfPi = _mm256_set1_pd(Pi / 2);
+	const __m256d twoPi = _mm256_set1_pd(2 * Pi);
+	const __m256d one = _mm256_set1_pd(1.0);
+	const __m256d zero = _mm256_setzero_pd();
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m256d gx = _mm256_loadu_pd(dx + i);
+		__m256d gy = _mm256_loadu_pd(dy + i);
+		_mm256_storeu_pd(magnitude + i, _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(gx, gx), _mm256_mul_pd(gy, gy))));
+
+		__m256d x = _mm256_xor_pd(gx, signMask);
+		__m256d y = _mm256_xor_pd(gy, signMask);
+		__m256d ax = _mm256_andnot_pd(signMask, x);
+		__m256d ay = _mm256_andnot_pd(signMask, y);
+		__m256d maxValue = _mm256_max_pd(ax, ay);
+		__m256d z = _mm256_div_pd(_mm256_min_pd(ax, ay), maxValue);
+		z = _mm256_and_pd(z, _mm256_cmp_pd(maxValue, zero, _CMP_GT_OQ));
+		__m256d z2 = _mm256_mul_pd(z, z);
+		__m256d p = _mm256_set1_pd(AtanCoefficients[7]);
+		for (int k = 6; k >= 0; k--) p = _mm256_add_pd(_mm256_mul_pd(p, z2), _mm256_set1_pd(AtanCoefficients[k]));
+		__m256d a = _mm256_mul_pd(z, _mm256_add_pd(one, _mm256_mul_pd(p, z2)));
+		a = _mm256_blendv_pd(a, _mm256_sub_pd(halfPi, a), _mm256_cmp_pd(ay, ax, _CMP_GT_OQ));
+		a = _mm256_blendv_pd(a, _mm256_sub_pd(pi, a), x);
+		a = _mm256_xor_pd(a, _mm256_and_pd(y, signMask));
+		__m256d phi = _mm256_min_pd(_mm256_max_pd(_mm256_add_pd(a, pi), zero), twoPi);
+		_mm256_storeu_pd(direction + i, phi);
+	}
+	gradientPolarScalar(dx + i, dy + i, magnitude + i, direction + i, n - i);
+}
+
+SIMD_TARGET_AVX2_NOFMA
+void SimdKernels::gradientPolarAVX2(const float* dx, const float* dy, float* magnitude, float* direction, int n)
+{
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+	const __m256 pi = _mm256_set1_ps(static_cast<float>(Pi));
+	const __m256 halfPi = _mm256_set1_ps(static_cast<float>(Pi / 2));
+	const __m256 twoPi = _mm256_set1_ps(static_cast<float>(2 * Pi));
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 zero = _mm256_setzero_ps();
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256 gx = _mm256_loadu_ps(dx + i);
+		__m256 gy = _mm256_loadu_ps(dy + i);
+		_mm256_storeu_ps(magnitude + i, _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(gx, gx), _mm256_mul_ps(gy, gy))));
+
+		__m256 x = _mm256_xor_ps(gx, signMask);
+		__m256 y = _mm256_xor_ps(gy, signMask);
+		__m256 ax = _mm256_andnot_ps(signMask, x);
+		__m256 ay = _mm256_andnot_ps(signMask, y);
+		__m256 maxValue = _mm256_max_ps(ax, ay);
+		__m256 z = _mm256_div_ps(_mm256_min_ps(ax, ay), maxValue);
+		z = _mm256_and_ps(z, _mm256_cmp_ps(maxValue, zero, _CMP_GT_OQ));
+		__m256 z2 = _mm256_mul_ps(z, z);
+		__m256 p = _mm256_set1_ps(static_cast<float>(AtanCoefficients[7]));
+		for (int k = 6; k >= 0; k--) p = _mm256_add_ps(_mm256_mul_ps(p, z2), _mm256_set1_ps(static_cast<float>(AtanCoefficients[k])));
+		__m256 a = _mm256_mul_ps(z, _mm256_add_ps(one, _mm256_mul_ps(p, z2)));
+		a = _mm256_blendv_ps(a, _mm256_sub_ps(halfPi, a), _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+		a = _mm256_blendv_ps(a, _mm256_sub_ps(pi, a), x);
+		a = _mm256_xor_ps(a, _mm256_and_ps(y, signMask));
+		__m256 phi = _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(a, pi), zero), twoPi);
+		_mm256_storeu_ps(direction + i, phi);
+	}
+	gradientPolarScalar(dx + i, dy + i, magnitude + i, direction + i, n - i);
+}
+
+// Каналы выделяются сдвигом и маской, яркость считается в double и отбрасывает дробную часть (cvttpd) как static_cast<int>
+SIMD_TARGET_SSE2
+void SimdKernels::lumaSSE2(const uint32_t* pixels, double* dst, int n)
+{
+	const __m128i mask = _mm_set1_epi32(0xff);
+	const __m128d red = _mm_set1_pd(LumaRed);
+	const __m128d green = _mm_set1_pd(LumaGreen);
+	const __m128d blue = _mm_set1_pd(LumaBlue);
+	int i = 0;
+	for (; i + 2 <= n; i += 2) {
+		__m128i p = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pixels + i));
+		__m128d r = _mm_cvtepi32_pd(_mm_and_si128(_mm_srli_epi32(p, 16), mask));
+		__m128d g = _mm_cvtepi32_pd(_mm_and_si128(_mm_srli_epi32(p, 8), mask));
+		__m128d b = _mm_cvtepi32_pd(_mm_and_si128(p, mask));
+		__m128d y = _mm_add_pd(_mm_add_pd(_mm_mul_pd(red, r), _mm_mul_pd(green, g)), _mm_mul_pd(blue, b));
+		_mm_storeu_pd(dst + i, _mm_cvtepi32_pd(_mm_cvttpd_epi32(y)));
+	}
+	lumaScalar(pixels + i, dst + i, n - i);
+}
+
+SIMD_TARGET_SSE2
+void SimdKernels::lumaSSE2(const uint32_t* pixels, float* dst, int n)
+{
+	const __m128i mask = _mm_set1_epi32(0xff);
+	const __m128d red = _mm_set1_pd(LumaRed);
+	const __m128d green = _mm_set1_pd(LumaGreen);
+	const __m128d blue = _mm_set1_pd(LumaBlue);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i));
+		__m128i r = _mm_and_si128(_mm_srli_epi32(p, 16), mask);
+		__m128i g = _mm_and_si128(_mm_srli_epi32(p, 8), mask);
+		__m128i b = _mm_and_si128(p, mask);
+		// Младшая и старшая пары пикселей
+		__m128d yLow = _mm_add_pd(_mm_add_pd(_mm_mul_pd(red, _mm_cvtepi32_pd(r)), _mm_mul_pd(green, _mm_cvtepi32_pd(g))),
+			_mm_mul_pd(blue, _mm_cvtepi32_pd(b)));
+		r = _mm_shuffle_epi32(r, _MM_SHUFFLE(1, 0, 3, 2));
+		g = _mm_shuffle_epi32(g, _MM_SHUFFLE(1, 0, 3, 2));
+		b = _mm_shuffle_epi32(b, _MM_SHUFFLE(1, 0, 3, 2));
+		__m128d yHigh = _mm_add_pd(_mm_add_pd(_mm_mul_pd(red, _mm_cvtepi32_pd(r)), _mm_mul_pd(green, _mm_cvtepi32_pd(g))),
+			_mm_mul_pd(blue, _mm_cvtepi32_pd(b)));
+		__m128i y = _mm_unpacklo_epi64(_mm_cvttpd_epi32(yLow), _mm_cvttpd_epi32(yHigh));
+		_mm_storeu_ps(dst + i, _mm_cvtepi32_ps(y));
+	}
+	lumaScalar(pixels + i, dst + i, n - i);
+}
+
+SIMD_TARGET_AVX2_NOFMA
+void SimdKernels::lumaAVX2(const uint32_t* pixels, double* dst, int n)
+{
+	const __m128i mask = _mm_set1_epi32(0xff);
+	const __m256d red = _mm256_set1_pd(LumaRed);
+	const __m256d green = _mm256_set1_pd(LumaGreen);
+	const __m256d blue = _mm256_set1_pd(LumaBlue);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i));
+		__m256d r = _mm256_cvtepi32_pd(_mm_and_si128(_mm_srli_epi32(p, 16), mask));
+		__m256d g = _mm256_cvtepi32_pd(_mm_and_si128(_mm_srli_epi32(p, 8), mask));
+		__m256d b = _mm256_cvtepi32_pd(_mm_and_si128(p, mask));
+		__m256d y = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(red, r), _mm256_mul_pd(green, g)), _mm256_mul_pd(blue, b));
+		_mm256_storeu_pd(dst + i, _mm256_cvtepi32_pd(_mm256_cvttpd_epi32(y)));
+	}
+	lumaScalar(pixels + i, dst + i, n - i);
+}
+
+SIMD_TARGET_AVX2_NOFMA
+void SimdKernels::lumaAVX2(const uint32_t* pixels, float* dst, int n)
+{
+	const __m128i mask = _mm_set1_epi32(0xff);
+	const __m256d red = _mm256_set1_pd(LumaRed);
+	const __m256d green = _mm256_set1_pd(LumaGreen);
+	const __m256d blue = _mm256_set1_pd(LumaBlue);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i));
+		__m256d r = _mm256_cvtepi32_pd(_mm_and_si128(_mm_srli_epi32(p, 16), mask));
+		__m256d g = _mm256_cvtepi32_pd(_mm_and_si128(_mm_srli_epi32(p, 8), mask));
+		__m256d b = _mm256_cvtepi32_pd(_mm_and_si128(p, mask));
+		__m256d y = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(red, r), _mm256_mul_pd(green, g)), _mm256_mul_pd(blue, b));
+		_mm_storeu_ps(dst + i, _mm_cvtepi32_ps(_mm256_cvttpd_epi32(y)));
+	}
+	lumaScalar(pixels + i, dst + i, n - i);
+}
+
+SIMD_TARGET_SSE2
+void SimdKernels::normalizeSSE2(double* values, int n, double minValue, double maxValue, double newMin, double newMax)
+{
+	const __m128d low = _mm_set1_pd(minValue);
+	const __m128d scale = _mm_set1_pd(newMax - newMin);
+	const __m128d range = _mm_set1_pd(maxValue - minValue);
+	const __m128d offset = _mm_set1_pd(newMin);
+	int i = 0;
+	for (; i + 2 <= n; i += 2) {
+		__m128d x = _mm_loadu_pd(values + i);
+		_mm_storeu_pd(values + i, _mm_add_pd(_mm_div_pd(_mm_mul_pd(_mm_sub_pd(x, low), scale), range), offset));
+	}
+	normalizeScalar(values + i, n - i, minValue, maxValue, newMin, newMax);
+}
+
+SIMD_TARGET_SSE2
+void SimdKernels::normalizeSSE2(float* values, int n, double minValue, double maxValue, double newMin, double newMax)
+{
+	const __m128d low = _mm_set1_pd(minValue);
+	const __m128d scale = _mm_set1_pd(newMax - newMin);
+	const __m128d range = _mm_set1_pd(maxValue - minValue);
+	const __m128d offset = _mm_set1_pd(newMin);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128 x = _mm_loadu_ps(values + i);
+		__m128d xLow = _mm_cvtps_pd(x);
+		__m128d xHigh = _mm_cvtps_pd(_mm_movehl_ps(x, x));
+		xLow = _mm_add_pd(_mm_div_pd(_mm_mul_pd(_mm_sub_pd(xLow, low), scale), range), offset);
+		xHigh = _mm_add_pd(_mm_div_pd(_mm_mul_pd(_mm_sub_pd(xHigh, low), scale), range), offset);
+		_mm_storeu_ps(values + i, _mm_movelh_ps(_mm_cvtpd_ps(xLow), _mm_cvtpd_ps(xHigh)));
+	}
+	normalizeScalar(values + i, n - i, minValue, maxValue, newMin, newMax);
+}
+
+SIMD_TARGET_AVX2_NOFMA
+void SimdKernels::normalizeAVX2(double* values, int n, double minValue, double maxValue, double newMin, double newMax)
+{
+	const __m256d low = _mm256_set1_pd(minValue);
+	const __m256d scale = _mm256_set1_pd(newMax - newMin);
+	const __m256d range = _mm256_set1_pd(maxValue - minValue);
+	const __m256d offset = _mm256_set1_pd(newMin);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m256d x = _mm256_loadu_pd(values + i);
+		_mm256_storeu_pd(values + i, _mm256_add_pd(_mm256_div_pd(_mm256_mul_pd(_mm256_sub_pd(x, low), scale), range), offset));
+	}
+	normalizeScalar(values + i, n - i, minValue, maxValue, newMin, newMax);
+}
+
+SIMD_TARGET_AVX2_NOFMA
+void SimdKernels::normalizeAVX2(float* values, int n, double minValue, double maxValue, double newMin, double newMax)
+{
+	const __m256d low = _mm256_set1_pd(minValue);
+	const __m256d scale = _mm256_set1_pd(newMax - newMin);
+	const __m256d range = _mm256_set1_pd(maxValue - minValue);
+	const __m256d offset = _mm256_set1_pd(newMin);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m256d x = _mm256_cvtps_pd(_mm_loadu_ps(values + i));
+		x = _mm256_add_pd(_mm256_div_pd(_mm256_mul_pd(_mm256_sub_pd(x, low), scale), range), offset);
+		_mm_storeu_ps(values + i, _mm256_cvtpd_ps(x));
+	}
+	normalizeScalar(values + i, n - i, minValue, maxValue, newMin, newMax);
+}
+
+// Значения ограничиваются [0, 255] до cvttpd/cvttps, поэтому packs/packus только сужают типы; по 8 значений за итерацию
+SIMD_TARGET_SSE2
+void SimdKernels::normalizeToBytesSSE2(const double* values, uint8_t* dst, int n, double minValue, double maxValue)
+{
+	const __m128d low = _mm_set1_pd(minValue);
+	const __m128d scale = _mm_set1_pd(255.0);
+	const __m128d range = _mm_set1_pd(maxValue - minValue);
+	const __m128d zero = _mm_setzero_pd();
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i parts[4];
+		for (int k = 0; k < 4; k++) {
+			__m128d x = _mm_div_pd(_mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(values + i + 2 * k), low), scale), range);
+			parts[k] = _mm_cvttpd_epi32(_mm_min_pd(_mm_max_pd(x, zero), scale));
+		}
+		__m128i low32 = _mm_unpacklo_epi64(parts[0], parts[1]);
+		__m128i high32 = _mm_unpacklo_epi64(parts[2], parts[3]);
+		__m128i bytes = _mm_packus_epi16(_mm_packs_epi32(low32, high32), _mm_setzero_si128());
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), bytes);
+	}
+	normalizeToBytesScalar(values + i, dst + i, n - i, minValue, maxValue);
+}
+
+SIMD_TARGET_SSE2
+void SimdKernels::normalizeToBytesSSE2(const float* values, uint8_t* dst, int n, double minValue, double maxValue)
+{
+	const __m128d low = _mm_set1_pd(minValue);
+	const __m128d scale = _mm_set1_pd(255.0);
+	const __m128d range = _mm_set1_pd(maxValue - minValue);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 top = _mm_set1_ps(255.0f);
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i parts[2];
+		for (int k = 0; k < 2; k++) {
+			__m128 x = _mm_loadu_ps(values + i + 4 * k);
+			__m128d xLow = _mm_div_pd(_mm_mul_pd(_mm_sub_pd(_mm_cvtps_pd(x), low), scale), range);
+			__m128d xHigh = _mm_div_pd(_mm_mul_pd(_mm_sub_pd(_mm_cvtps_pd(_mm_movehl_ps(x, x)), low), scale), range);
+			x = _mm_movelh_ps(_mm_cvtpd_ps(xLow), _mm_cvtpd_ps(xHigh));
+			parts[k] = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(x, zero), top));
+		}
+		__m128i bytes = _mm_packus_epi16(_mm_packs_epi32(parts[0], parts[1]), _mm_setzero_si128());
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), bytes);
+	}
+	normalizeToBytesScalar(values + i, dst + i, n - i, minValue, maxValue);
+}
+
+SIMD_TARGET_AVX2_NOFMA
+void SimdKernels::normalizeToBytesAVX2(const double* values, uint8_t* dst, int n, double minValue, double maxValue)
+{
+	const __m256d low = _mm256_set1_pd(minValue);
+	const __m256d scale = _mm256_set1_pd(255.0);
+	const __m256d range = _mm256_set1_pd(maxValue - minValue);
+	const __m256d zero = _mm256_setzero_pd();
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i parts[2];
+		for (int k = 0; k < 2; k++) {
+			__m256d x = _mm256_div_pd(_mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(values + i + 4 * k), low), scale), range);
+			parts[k] = _mm256_cvttpd_epi32(_mm256_min_pd(_mm256_max_pd(x, zero), scale));
+		}
+		__m128i bytes = _mm_packus_epi16(_mm_packs_epi32(parts[0], parts[1]), _mm_setzero_si128());
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), bytes);
+	}
+	normalizeToBytesScalar(values + i, dst + i, n - i, minValue, maxValue);
+}
+
+SIMD_TARGET_AVX2_NOFMA
+void SimdKernels::normalizeToBytesAVX2(const float* values, uint8_t* dst, int n, double minValue, double maxValue)
+{
+	const __m256d low = _mm256_set1_pd(minValue);
+	const __m256d scale = _mm256_set1_pd(255.0);
+	const __m256d range = _mm256_set1_pd(maxValue - minValue);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 top = _mm256_set1_ps(255.0f);
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256d xLow = _mm256_div_pd(_mm256_mul_pd(_mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(values + i)), low), scale), range);
+		__m256d xHigh = _mm256_div_pd(_mm256_mul_pd(_mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(values + i + 4)), low), scale), range);
+		__m256 x = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(xLow)), _mm256_cvtpd_ps(xHigh), 1);
+		__m256i x32 = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(x, zero), top));
+		__m128i bytes = _mm_packus_epi16(_mm_packs_epi32(_mm256_castsi256_si128(x32), _mm256_extracti128_si256(x32, 1)), _mm_setzero_si128());
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), bytes);
+	}
+	normalizeToBytesScalar(values + i, dst + i, n - i, minValue, maxValue);
+}
+
+#else
+
+void SimdKernels::lumaSSE2(const uint32_t* pixels, double* dst, int n)
+{
+	lumaScalar(pixels, dst, n);
+}
+
+void SimdKernels::lumaAVX2(const uint32_t* pixels, double* dst, int n)
+{
+	lumaScalar(pixels, dst, n);
+}
+
+void SimdKernels::lumaSSE2(const uint32_t* pixels, float* dst, int n)
+{
+	lumaScalar(pixels, dst, n);
+}
+
+void SimdKernels::lumaAVX2(const uint32_t* pixels, float* dst, int n)
+{
+	lumaScalar(pixels, dst, n);
+}
+
+void SimdKernels::normalizeSSE2(double* values, int n, double minValue, double maxValue, double newMin, double newMax)
+{
+	normalizeScalar(values, n, minValue, maxValue, newMin, newMax);
+}
+
+void SimdKernels::normalizeAVX2(double* values, int n, double minValue, double maxValue, double newMin, double newMax)
+{
+	normalizeScalar(values, n, minValue, maxValue, newMin, newMax);
+}
+
+void SimdKernels::normalizeSSE2(float* values, int n, double minValue, double maxValue, double newMin, double newMax)
+{
+	normalizeScalar(values, n, minValue, maxValue, newMin, newMax);
+}
+
+void SimdKernels::normalizeAVX2(float* values, int n, double minValue, double maxValue, double newMin, double newMax)
+{
+	normalizeScalar(values, n, minValue, maxValue, newMin, newMax);
+}
+
+void SimdKernels::normalizeToBytesSSE2(const double* values, uint8_t* dst, int n, double minValue, double maxValue)
+{
+	normalizeToBytesScalar(values, dst, n, minValue, maxValue);
+}
+
+void SimdKernels::normalizeToBytesAVX2(const double* values, uint8_t* dst, int n, double minValue, double maxValue)
+{
+	normalizeToBytesScalar(values, dst, n, minValue, maxValue);
+}
+
+void SimdKernels::normalizeToBytesSSE2(const float* values, uint8_t* dst, int n, double minValue, double maxValue)
+{
+	normalizeToBytesScalar(values, dst, n, minValue, maxValue);
+}
+
+void SimdKernels::normalizeToBytesAVX2(const float* values, uint8_t* dst, int n, double minValue, double maxValue)
+{
+	normalizeToBytesScalar(values, dst, n, minValue, maxValue);
+}
+
+void SimdKernels::gradientPolarAVX2(const double* dx, const double* dy, double* magnitude, double* direction, int n)
+{
+	gradientPolarScalar(dx, dy, magnitude, direction, n);
+}
+
+void SimdKernels::gradientPolarAVX2(const float* dx, const float* dy, float* magnitude, float* direction, int n)
+{
+	gradientPolarScalar(dx, dy, magnitude, direction, n);
+}
+
+double SimdKernels::squaredDistanceSSE2(const double* a, const double* b, int n)
+{
+	return distanceScalar(a, b, n, SquareValue());
+}
+
+double SimdKernels::squaredDistanceAVX2(const double* a, const double* b, int n)
+{
+	return distanceScalar(a, b, n, SquareValue());
+}
+
+double SimdKernels::absDistanceSSE2(const double* a, const double* b, int n)
+{
+	return distanceScalar(a, b, n, AbsValue());
+}
+
+double SimdKernels::absDistanceAVX2(const double* a, const double* b, int n)
+{
+	return distanceScalar(a, b, n, AbsValue());
+}
+
+double SimdKernels::squaredDistanceSSE2(const float* a, const float* b, int n)
+{
+	return distanceScalar(a, b, n, SquareValue());
+}
+
+double SimdKernels::squaredDistanceAVX2(const float* a, const float* b, int n)
+{
+	return distanceScalar(a, b, n, SquareValue());
+}
+
+double SimdKernels::absDistanceSSE2(const float* a, const float* b, int n)
+{
+	return distanceScalar(a, b, n, AbsValue());
+}
+
+double SimdKernels::absDistanceAVX2(const float* a, const float* b, int n)
+{
+	return distanceScalar(a, b, n, AbsValue());
+}
+
+long long SimdKernels::squaredDistanceSSE2(const uint8_t* a, const uint8_t* b, int n)
+{
+	return squaredDistanceScalar(a, b, n);
+}
+
+long long SimdKernels::squaredDistanceAVX2(const uint8_t* a, const uint8_t* b, int n)
+{
+	return squaredDistanceScalar(a, b, n);
+}
+
+long long SimdKernels::absDistanceSSE2(const uint8_t* a, const uint8_t* b, int n)
+{
+	return absDistanceScalar(a, b, n);
+}
+
+long long SimdKernels::absDistanceAVX2(const uint8_t* a, const uint8_t* b, int n)
+{
+	return absDistanceScalar(a, b, n);
+}
+
+void SimdKernels::convolveRowSSE2(const double* src, double* dst, int begin, int end, const double* kernel, int kernelSize)
+{
+	convolveRowScalar(src, dst, begin, end, kernel, kernelSize);
+}
+
+void SimdKernels::convolveColSSE2(const double* const* rows, double* dst, int width, const double* kernel, int kernelSize)
+{
+	convolveColScalar(rows, dst, 0, width, kernel, kernelSize);
+}
+
+void SimdKernels::convolveRowAVX2(const double* src, double* dst, int begin, int end, const double* kernel, int kernelSize)
+{
+	convolveRowScalar(src, dst, begin, end, kernel, kernelSize);
+}
+
+void SimdKernels::convolveColAVX2(const double* const* rows, double* dst, int width, const double* kernel, int kernelSize)
+{
+	convolveColScalar(rows, dst, 0, width, kernel, kernelSize);
+}
+
+void SimdKernels::convolveRowSSE2(const float* src, float* dst, int begin, int end, const float* kernel, int kernelSize)
+{
+	convolveRowScalar(src, dst, begin, end, kernel, kernelSize);
+}
+
+void SimdKernels::convolveColSSE2(const float* const* rows, float* dst, int width, const float* kernel, int kernelSize)
+{
+	convolveColScalar(rows, dst, 0, width, kernel, kernelSize);
+}
+
+void SimdKernels::convolveRowAVX2(const float* src, float* dst, int begin, int end, const float* kernel, int kernelSize)
+{
+	convolveRowScalar(src, dst, begin, end, kernel, kernelSize);
+}
+
+void SimdKernels::convolveColAVX2(const float* const* rows, float* dst, int width, const float* kernel, int kernelSize)
+{
+	convolveColScalar(rows, dst, 0, width, kernel, kernelSize);
+}
+
+#endif
@@ -0,0 +1,121 @@
+#pragma once
+#include <cstdint>
+// Векторные ядра для сепарабельной свертки с выбором набора инструкций во время выполнения
+class SimdKernels
+{
+public:
+	// Набор инструкций, используемый ядрами
+	enum class Level
+	{
+		// Скалярная реализация
+		Scalar,
+		// SSE2 (2 double или 4 float за такт)
+		SSE2,
+		// AVX2 + FMA (4 double или 8 float за такт)
+		AVX2
+	};
+
+	// Допустимое расхождение с результатом скалярной реализации для изображений, нормированных в [0, 1].
+	// AVX2 использует FMA, поэтому результат отличается в последних разрядах; SSE2 совпадает со скалярным побитово
+	static constexpr double Epsilon = 1e-12;
+	// То же для матриц float
+	static constexpr double FloatEpsilon = 1e-5;
+	// Наибольшая ошибка направления в gradientPolar (радианы) для double, для float добавляется ошибка округления float
+	static constexpr double FastAtan2Error = 1e-7;
+	// Коэффициенты яркости (как LabImage::getGrayScale)
+	static constexpr double LumaRed = 0.2126;
+	static constexpr double LumaGreen = 0.7152;
+	static constexpr double LumaBlue = 0.0722;
+
+private:
+	static Level currentLevel;
+
+	// Определение набора инструкций, поддерживаемого процессором
+	static Level detectLevel();
+
+	static void convolveRowSSE2(const double* src, double* dst, int begin, int end, const double* kernel, int kernelSize);
+	static void convolveRowAVX2(const double* src, double* dst, int begin, int end, const double* kernel, int kernelSize);
+	static void convolveColSSE2(const double* const* rows, double* dst, int width, const double* kernel, int kernelSize);
+	static void convolveColAVX2(const double* const* rows, double* dst, int width, const double* kernel, int kernelSize);
+	static void convolveRowSSE2(const float* src, float* dst, int begin, int end, const float* kernel, int kernelSize);
+	static void convolveRowAVX2(const float* src, float* dst, int begin, int end, const float* kernel, int kernelSize);
+	static void convolveColSSE2(const float* const* rows, float* dst, int width, const float* kernel, int kernelSize);
+	static void convolveColAVX2(const float* const* rows, float* dst, int width, const float* kernel, int kernelSize);
+	static double squaredDistanceSSE2(const double* a, const double* b, int n);
+	static double squaredDistanceAVX2(const double* a, const double* b, int n);
+	static double absDistanceSSE2(const double* a, const double* b, int n);
+	static double absDistanceAVX2(const double* a, const double* b, int n);
+	static double squaredDistanceSSE2(const float* a, const float* b, int n);
+	static double squaredDistanceAVX2(const float* a, const float* b, int n);
+	static double absDistanceSSE2(const float* a, const float* b, int n);
+	static double absDistanceAVX2(const float* a, const float* b, int n);
+	static long long squaredDistanceSSE2(const uint8_t* a, const uint8_t* b, int n);
+	static long long squaredDistanceAVX2(const uint8_t* a, const uint8_t* b, int n);
+	static long long absDistanceSSE2(const uint8_t* a, const uint8_t* b, int n);
+	static long long absDistanceAVX2(const uint8_t* a, const uint8_t* b, int n);
+	static void gradientPolarAVX2(const double* dx, const double* dy, double* magnitude, double* direction, int n);
+	static void gradientPolarAVX2(const float* dx, const float* dy, float* magnitude, float* direction, int n);
+	static void lumaSSE2(const uint32_t* pixels, double* dst, int n);
+	static void lumaAVX2(const uint32_t* pixels, double* dst, int n);
+	static void lumaSSE2(const uint32_t* pixels, float* dst, int n);
+	static void lumaAVX2(const uint32_t* pixels, float* dst, int n);
+	static void normalizeSSE2(double* values, int n, double minValue, double maxValue, double newMin, double newMax);
+	static void normalizeAVX2(double* values, int n, double minValue, double maxValue, double newMin, double newMax);
+	static void normalizeSSE2(float* values, int n, double minValue, double maxValue, double newMin, double newMax);
+	static void normalizeAVX2(float* values, int n, double minValue, double maxValue, double newMin, double newMax);
+	static void normalizeToBytesSSE2(const double* values, uint8_t* dst, int n, double minValue, double maxValue);
+	static void normalizeToBytesAVX2(const double* values, uint8_t* dst, int n, double minValue, double maxValue);
+	static void normalizeToBytesSSE2(const float* values, uint8_t* dst, int n, double minValue, double maxValue);
+	static void normalizeToBytesAVX2(const float* values, uint8_t* dst, int n, double minValue, double maxValue);
+
+public:
+	static Level getLevel() { return currentLevel; }
+	// Возвращает максимальный набор инструкций, доступный на данном процессоре
+	static Level getSupportedLevel();
+	// Установка набора инструкций (ограничивается поддерживаемым процессором)
+	static void setLevel(Level level);
+	static const char* getLevelName(Level level);
+
+	// Свертка строки: dst[j] = sum(src[j + kernelSize / 2 - t] * kernel[t]) для j из [begin, end).
+	// Все обращения src должны находиться внутри строки
+	static void convolveRow(const double* src, double* dst, int begin, int end, const double* kernel, int kernelSize);
+	// Свертка по столбцу: dst[j] = sum(rows[t][j] * kernel[t]) для j из [0, width),
+	// rows[t] - строка изображения, соответствующая элементу ядра t
+	static void convolveCol(const double* const* rows, double* dst, int width, const double* kernel, int kernelSize);
+	static void convolveRow(const float* src, float* dst, int begin, int end, const float* kernel, int kernelSize);
+	static void convolveCol(const float* const* rows, float* dst, int width, const float* kernel, int kernelSize);
+
+	// Сумма квадратов разностей векторов a и b длины n.
+	// Порядок суммирования (8 частичных сумм) одинаков на всех наборах инструкций, поэтому результат совпадает побитово.
+	// От последовательной суммы результат может отличаться в последних битах: совпадения NNDR меняются только при ничьей
+	// (отношение расстояний на пороге или два ближайших на одном расстоянии), см. Benchmark::benchmarkMatcher
+	static double squaredDistance(const double* a, const double* b, int n);
+	// Сумма модулей разностей векторов a и b длины n (порядок суммирования как в squaredDistance)
+	static double absDistance(const double* a, const double* b, int n);
+	// То же для float: частичные суммы накапливаются во float в том же порядке, результат совпадает побитово
+	static double squaredDistance(const float* a, const float* b, int n);
+	static double absDistance(const float* a, const float* b, int n);
+	// То же для квантованных uint8 векторов: целочисленные суммы точны на всех наборах инструкций
+	// (суммы квадратов накапливаются в 32-битных частичных суммах, n не больше 100000)
+	static long long squaredDistance(const uint8_t* a, const uint8_t* b, int n);
+	static long long absDistance(const uint8_t* a, const uint8_t* b, int n);
+
+	// Модуль sqrt(dx^2 + dy^2) и направление atan2(-dy, -dx) + pi градиента для n элементов.
+	// Направление считается полиномиальным приближением atan2 с ошибкой не больше FastAtan2Error и лежит в [0, 2pi].
+	// Векторная версия только для AVX2 (без blendv в SSE2 выигрыша нет), на остальных уровнях - скалярная
+	static void gradientPolar(const double* dx, const double* dy, double* magnitude, double* direction, int n);
+	static void gradientPolar(const float* dx, const float* dy, float* magnitude, float* direction, int n);
+
+	// Яркость (int)(LumaRed * r + LumaGreen * g + LumaBlue * b) для n пикселей QRgb (0xAARRGGBB).
+	// Вычисления в double в порядке скалярной формулы, поэтому результат совпадает побитово на всех наборах инструкций
+	static void luma(const uint32_t* pixels, double* dst, int n);
+	static void luma(const uint32_t* pixels, float* dst, int n);
+	// Нормирование как Matrix::normalize: (x - minValue) * (newMax - newMin) / (maxValue - minValue) + newMin в double,
+	// результат совпадает побитово на всех наборах инструкций
+	static void normalize(double* values, int n, double minValue, double maxValue, double newMin, double newMax);
+	static void normalize(float* values, int n, double minValue, double maxValue, double newMin, double newMax);
+	// Упаковка в байты: значение normalize(0, 255), приведенное к T, ограничивается [0, 255] и отбрасывает дробную часть
+	// (как static_cast<int> для norm255 и QColor), NaN дает 0. Результат совпадает побитово на всех наборах инструкций
+	static void normalizeToBytes(const double* values, uint8_t* dst, int n, double minValue, double maxValue);
+	static void normalizeToBytes(const float* values, uint8_t* dst, int n, double minValue, double maxValue);
+};
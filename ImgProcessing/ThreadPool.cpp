@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <atomic>
+#include "ThreadPool.h"
+
+std::unique_ptr<ThreadPool> ThreadPool::globalPool;
+std::once_flag ThreadPool::globalPoolFlag;
+
+ThreadPool::ThreadPool(int threadCount): stopping(false)
+{
+	for (int i = 1; i < threadCount; i++) {
+		workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(tasksMutex);
+		stopping = true;
+	}
+	tasksCondition.notify_all();
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::workerLoop()
+{
+	while (true) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(tasksMutex);
+			tasksCondition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+			if (tasks.empty()) return;
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+		task();
+	}
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(tasksMutex);
+		tasks.push_back(std::move(task));
+	}
+	tasksCondition.notify_one();
+}
+
+void ThreadPool::parallelFor(int begin, int end, int minBand, const std::function<void(int, int)>& body)
+{
+	int count = end - begin;
+	if (count <= 0) return;
+	int bandCount = std::min(count / std::max(minBand, 1), getThreadCount() * 4);
+	if (bandCount <= 1) {
+		body(begin, end);
+		return;
+	}
+
+	// Общее состояние живет, пока его не отпустит последний рабочий поток
+	struct State
+	{
+		const std::function<void(int, int)>* body;
+		std::atomic<int> nextBand;
+		int doneBands;
+		std::mutex doneMutex;
+		std::condition_variable doneCondition;
+	};
+	auto state = std::make_shared<State>();
+	state->body = &body;
+	state->nextBand = 0;
+	state->doneBands = 0;
+
+	int bandSize = count / bandCount;
+	int rest = count % bandCount;
+	auto runBands = [state, begin, bandCount, bandSize, rest]() {
+		while (true) {
+			int band = state->nextBand++;
+			if (band >= bandCount) return;
+			int bandBegin = begin + band * bandSize + std::min(band, rest);
+			int bandEnd = bandBegin + bandSize + (band < rest ? 1 : 0);
+			(*state->body)(bandBegin, bandEnd);
+			std::lock_guard<std::mutex> lock(state->doneMutex);
+			if (++state->doneBands == bandCount) state->doneCondition.notify_all();
+		}
+	};
+
+	int helpers = std::min(static_cast<int>(workers.size()), bandCount - 1);
+	for (int i = 0; i < helpers; i++) {
+		submit(runBands);
+	}
+	runBands();
+
+	std::unique_lock<std::mutex> lock(state->doneMutex);
+	state->doneCondition.wait(lock, [&]() { return state->doneBands == bandCount; });
+}
+
+ThreadPool& ThreadPool::global()
+{
+	// Пул мог быть уже создан setGlobalThreadCount
+	std::call_once(globalPoolFlag, []() {
+		if (!globalPool) globalPool.reset(new ThreadPool(getDefaultThreadCount()));
+	});
+	return *globalPool;
+}
+
+void ThreadPool::setGlobalThreadCount(int threadCount)
+{
+	globalPool.reset(new ThreadPool(threadCount > 0 ? threadCount : getDefaultThreadCount()));
+}
+
+int ThreadPool::getDefaultThreadCount()
+{
+	return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+void ThreadPool::parallelRows(int height, int width, const std::function<void(int, int)>& body)
+{
+	global().parallelFor(0, height, std::max(1, MinBandElements / std::max(width, 1)), body);
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+// Пул потоков для параллельной обработки изображений полосами строк
+class ThreadPool
+{
+private:
+	// Общий пул, используемый операциями над матрицами
+	static std::unique_ptr<ThreadPool> globalPool;
+	static std::once_flag globalPoolFlag;
+
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> tasks;
+	std::mutex tasksMutex;
+	std::condition_variable tasksCondition;
+	bool stopping;
+
+	// Цикл рабочего потока
+	void workerLoop();
+	// Добавление задачи в очередь
+	void submit(std::function<void()> task);
+public:
+	// Минимальное число элементов в одной полосе, меньшие объемы работы не распараллеливаются
+	static constexpr int MinBandElements = 16384;
+
+	// threadCount - общее число потоков, включая вызывающий (threadCount - 1 рабочих потоков)
+	explicit ThreadPool(int threadCount);
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	~ThreadPool();
+
+	int getThreadCount() const { return static_cast<int>(workers.size()) + 1; }
+
+	// Вызывает body(bandBegin, bandEnd) для полос, покрывающих [begin, end), каждая полоса не короче minBand.
+	// Вызывающий поток тоже обрабатывает полосы, поэтому вложенные вызовы не блокируют пул
+	void parallelFor(int begin, int end, int minBand, const std::function<void(int, int)>& body);
+
+	// Общий пул (по умолчанию по числу ядер процессора). Создание потокобезопасно:
+	// задания пакетной обработки могут впервые обратиться к пулу одновременно
+	static ThreadPool& global();
+	// Пересоздает общий пул с заданным числом потоков (0 - по числу ядер процессора).
+	// Нельзя вызывать во время выполнения операций в общем пуле
+	static void setGlobalThreadCount(int threadCount);
+	static int getGlobalThreadCount() { return global().getThreadCount(); }
+	// Число потоков по умолчанию
+	static int getDefaultThreadCount();
+	// Параллельная обработка строк изображения шириной width в общем пуле
+	static void parallelRows(int height, int width, const std::function<void(int, int)>& body);
+};